@@ -0,0 +1,95 @@
+#include "bench.hpp"
+
+#include <stdio.h>
+#include <new>
+#include <tl/str.hpp>
+#include <tl/containers/vector.hpp>
+#include <tl/containers/small_vector.hpp>
+
+// Heap allocations avoided by the inline storage of Str and SmallVector. The global operator new is replaced to
+// count the allocations of Str, and the containers use an allocator that counts its calls
+// usage: alloc_count_bench [iterations = 200000]
+
+static u64 g_numNews = 0;
+
+void* operator new(size_t bytes)
+{
+    g_numNews++;
+    if(void* p = malloc(bytes ? bytes : 1))
+        return p;
+    throw std::bad_alloc();
+}
+void* operator new[](size_t bytes) { return operator new(bytes); }
+void operator delete(void* p)noexcept { free(p); }
+void operator delete[](void* p)noexcept { free(p); }
+void operator delete(void* p, size_t)noexcept { free(p); }
+void operator delete[](void* p, size_t)noexcept { free(p); }
+
+struct CountingHeap : tl::HeapAllocator {
+    static u64 numCalls;
+    void* alloc(size_t bytes, size_t align)
+    {
+        numCalls++;
+        return tl::HeapAllocator::alloc(bytes, align);
+    }
+    void* realloc(void* p, size_t oldBytes, size_t newBytes, size_t align)
+    {
+        numCalls++;
+        return tl::HeapAllocator::realloc(p, oldBytes, newBytes, align);
+    }
+};
+u64 CountingHeap::numCalls = 0;
+
+// material names fit inline, the paths don't
+static const char* const k_shortNames[] = {"metal", "rough_plastic", "glass", "emitter_warm"};
+static const char* const k_longNames[] = {"assets/env/sky_4k.hdr", "src/shaders/main_frag.glsl"};
+
+template <size_t N>
+static void benchStr(const char* label, const char* const (&names)[N], int n)
+{
+    tl::Vector<tl::Str> strs;
+    strs.reserve(n);
+    const u64 numNews = g_numNews;
+    const double start = bench::now();
+    for(int i = 0; i < n; i++)
+        strs.emplace_back(names[i % N]);
+    tl::Vector<tl::Str> copies = strs;
+    const double seconds = bench::now() - start;
+    bench::doNotOptimize(copies[n - 1][0]);
+    // the vectors themselves go through HeapAllocator, not operator new
+    printf("%-34s %12.2f %10.1f\n", label, double(g_numNews - numNews) / (2 * n), 1e9 * seconds / (2 * n));
+}
+
+// a list of numEntries shader sources, like the ones passed to glShaderSource
+template <typename V>
+static void benchList(const char* label, int numEntries, int n)
+{
+    CountingHeap::numCalls = 0;
+    u64 check = 0;
+    const double start = bench::now();
+    for(int i = 0; i < n; i++) {
+        V v;
+        for(int e = 0; e < numEntries; e++)
+            v.push_back(k_longNames[(i + e) & 1]);
+        check += v.size();
+        bench::doNotOptimize(v.data());
+    }
+    const double seconds = bench::now() - start;
+    bench::doNotOptimize(check);
+    printf("%-34s %12.2f %10.1f\n", label, double(CountingHeap::numCalls) / n, 1e9 * seconds / n);
+}
+
+int main(int argc, char** argv)
+{
+    const int n = int(bench::argInt(argc, argv, 1, 200000));
+
+    printf("%-34s %12s %10s\n", "Str, construct and copy", "news/str", "ns/str");
+    benchStr("short names (5-13 chars)", k_shortNames, n);
+    benchStr("paths (21-26 chars)", k_longNames, n);
+
+    printf("%-34s %12s %10s\n", "lists of const char*", "allocs/list", "ns/list");
+    benchList<tl::Vector<const char*, CountingHeap>>("Vector, 3 entries", 3, n);
+    benchList<tl::SmallVector<const char*, 4, CountingHeap>>("SmallVector<4>, 3 entries", 3, n);
+    benchList<tl::Vector<const char*, CountingHeap>>("Vector, 6 entries", 6, n);
+    benchList<tl::SmallVector<const char*, 4, CountingHeap>>("SmallVector<4>, 6 entries", 6, n);
+}
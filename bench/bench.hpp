@@ -0,0 +1,58 @@
+#pragma once
+
+#include <stdlib.h>
+#include <chrono>
+#include <tl/int_types.hpp>
+
+// Helpers shared by the benchmarks in bench/. They are only built with -DRAYGL_BENCH=ON, in Release
+
+namespace bench
+{
+
+inline double now()
+{
+    using namespace std::chrono;
+    return duration<double>(steady_clock::now().time_since_epoch()).count();
+}
+
+// keeps the compiler from optimizing away the computation of x
+template <typename T>
+inline void doNotOptimize(const T& x)
+{
+#if defined(__GNUC__)
+    asm volatile("" : : "r,m"(x) : "memory");
+#else
+    static volatile const void* sink;
+    sink = &x;
+#endif
+}
+
+// seconds per call of fn(), the best of 3 rounds of at least minSeconds/3 each. fn() is called once before, to
+// warm up the caches and the allocations
+template <typename Fn>
+double secondsPerCall(const Fn& fn, double minSeconds = 0.3)
+{
+    fn();
+    double best = 1e30;
+    for(int round = 0; round < 3; round++) {
+        u64 numCalls = 0;
+        const double start = now();
+        double elapsed;
+        do {
+            fn();
+            numCalls++;
+            elapsed = now() - start;
+        } while(elapsed < minSeconds / 3);
+        if(elapsed / numCalls < best)
+            best = elapsed / numCalls;
+    }
+    return best;
+}
+
+// the i-th command line argument (1-based) as an integer, or def when there are fewer arguments
+inline i64 argInt(int argc, char** argv, int i, i64 def)
+{
+    return i < argc ? strtoll(argv[i], nullptr, 0) : def;
+}
+
+}
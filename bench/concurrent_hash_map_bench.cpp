@@ -0,0 +1,71 @@
+#include "bench.hpp"
+
+#include <stdio.h>
+#include <atomic>
+#include <thread>
+#include <tl/containers/vector.hpp>
+#include <tl/containers/concurrent_hash_map.hpp>
+
+// Read-mostly workload of ConcurrentHashMap, 90% find and 10% insert, with 1 up to 64 threads. The map is preloaded
+// with 1M keys and the operations pick keys among twice as many, so half of the finds miss and the inserts keep
+// adding keys. The same map with a single shard, i.e. a hash_map behind one reader-writer lock, is the baseline
+// usage: concurrent_hash_map_bench [max threads = 64] [operations = 4000000]
+
+static constexpr size_t k_numPreloaded = 1 << 20;
+
+static u64 xorshift(u64& s)
+{
+    s ^= s << 13;
+    s ^= s >> 7;
+    s ^= s << 17;
+    return s;
+}
+
+// returns millions of operations per second, over all the threads
+template <typename Map>
+static double run(int numThreads, u64 numOps)
+{
+    auto map = new Map;
+    map->reserve(2 * k_numPreloaded);
+    for(size_t i = 0; i < k_numPreloaded; i++)
+        map->insert(i * 7919, i);
+
+    const u64 perThread = numOps / numThreads;
+    std::atomic<u64> sink {0};
+    tl::Vector<std::thread> threads;
+    const double start = bench::now();
+    for(int t = 0; t < numThreads; t++) {
+        threads.emplace_back([&, t] {
+            u64 s = 88172645463325252ull + t;
+            u64 acc = 0, x;
+            for(u64 i = 0; i < perThread; i++) {
+                const u64 r = xorshift(s);
+                const u64 key = (r % (2 * k_numPreloaded)) * 7919;
+                if(r % 10 == 0)
+                    map->insert(key, r);
+                else if(map->find(key, x))
+                    acc += x;
+            }
+            sink += acc;
+        });
+    }
+    for(std::thread& thread : threads)
+        thread.join();
+    const double seconds = bench::now() - start;
+    delete map;
+    return 1e-6 * perThread * numThreads / seconds;
+}
+
+int main(int argc, char** argv)
+{
+    const int maxThreads = int(bench::argInt(argc, argv, 1, 64));
+    const u64 numOps = u64(bench::argInt(argc, argv, 2, 4000000));
+    printf("hardware threads: %u, millions of operations per second\n", std::thread::hardware_concurrency());
+    printf("%8s %12s %12s\n", "threads", "64 shards", "1 shard");
+    for(int numThreads = 1; numThreads <= maxThreads; numThreads *= 2) {
+        const double sharded = run<tl::ConcurrentHashMap<u64, u64>>(numThreads, numOps);
+        const double single =
+            run<tl::ConcurrentHashMap<u64, u64, tl::hash<u64>, rhood::equal_to<u64>, 1>>(numThreads, numOps);
+        printf("%8d %12.1f %12.1f\n", numThreads, sharded, single);
+    }
+}
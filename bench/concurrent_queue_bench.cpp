@@ -0,0 +1,111 @@
+#include "bench.hpp"
+
+#include <stdio.h>
+#include <atomic>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <tl/containers/vector.hpp>
+#include <tl/containers/concurrent_queue.hpp>
+
+// Contention of the bounded queues: SpscQueue with 1 producer and 1 consumer, and MpmcQueue with N producers and
+// N consumers, against a std::deque protected by a mutex with the same capacity. Every producer pushes its share of
+// the items, the consumers pop until all of them went through, and the sum of the items is checked
+// usage: concurrent_queue_bench [max threads = 64] [items = 2000000]
+
+static constexpr size_t k_capacity = 1024;
+
+struct MutexQueue {
+    std::mutex mutex;
+    std::deque<u64> items;
+
+    bool tryPush(u64 x)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if(items.size() >= k_capacity)
+            return false;
+        items.push_back(x);
+        return true;
+    }
+    bool tryPop(u64& x)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if(items.empty())
+            return false;
+        x = items.front();
+        items.pop_front();
+        return true;
+    }
+};
+
+// returns ns per item, or a negative number if an item was lost
+template <typename Queue>
+static double run(Queue& queue, int numProducers, int numConsumers, u64 numItems)
+{
+    const u64 perProducer = numItems / numProducers;
+    const u64 total = perProducer * numProducers;
+    std::atomic<u64> sum {0};
+    std::atomic<u64> numPopped {0};
+    tl::Vector<std::thread> threads;
+    const double start = bench::now();
+    for(int p = 0; p < numProducers; p++) {
+        threads.emplace_back([&, p] {
+            for(u64 i = 0; i < perProducer; i++) {
+                // the items are 1..total
+                while(!queue.tryPush(p * perProducer + i + 1))
+                    std::this_thread::yield();
+            }
+        });
+    }
+    for(int c = 0; c < numConsumers; c++) {
+        threads.emplace_back([&] {
+            u64 localSum = 0;
+            u64 x;
+            while(numPopped.load(std::memory_order_relaxed) < total) {
+                if(queue.tryPop(x)) {
+                    localSum += x;
+                    numPopped.fetch_add(1, std::memory_order_relaxed);
+                }
+                else {
+                    std::this_thread::yield();
+                }
+            }
+            sum += localSum;
+        });
+    }
+    for(std::thread& t : threads)
+        t.join();
+    const double seconds = bench::now() - start;
+    if(sum != total * (total + 1) / 2)
+        return -1;
+    return 1e9 * seconds / total;
+}
+
+int main(int argc, char** argv)
+{
+    const int maxThreads = int(bench::argInt(argc, argv, 1, 64));
+    const u64 numItems = u64(bench::argInt(argc, argv, 2, 2000000));
+    printf("hardware threads: %u, ns per item\n", std::thread::hardware_concurrency());
+
+    {
+        auto spsc = new tl::SpscQueue<u64, k_capacity>;
+        auto mutexQueue = new MutexQueue;
+        printf("%-16s %10s %10s\n", "1:1", "spsc", "mutex");
+        printf("%-16s %10.1f %10.1f\n", "", run(*spsc, 1, 1, numItems), run(*mutexQueue, 1, 1, numItems));
+        delete spsc;
+        delete mutexQueue;
+    }
+
+    printf("%-16s %10s %10s\n", "producers:cons.", "mpmc", "mutex");
+    for(int numThreads = 2; numThreads <= maxThreads; numThreads *= 2) {
+        const int n = numThreads / 2;
+        // new queues every time, the cells are big with their padding
+        auto mpmc = new tl::MpmcQueue<u64, k_capacity>;
+        auto mutexQueue = new MutexQueue;
+        char label[32];
+        snprintf(label, sizeof(label), "%d:%d", n, n);
+        printf("%-16s %10.1f %10.1f\n", label, run(*mpmc, n, n, numItems), run(*mutexQueue, n, n, numItems));
+        delete mpmc;
+        delete mutexQueue;
+    }
+}
@@ -0,0 +1,58 @@
+#include "bench.hpp"
+
+#include <stdio.h>
+#include <tl/basic.hpp>
+#include <tl/containers/vector.hpp>
+#include <tg/img.hpp>
+#include <tg/cubemap.hpp>
+
+// Throughput of the environment map preprocessing for each face resolution: equirectangular to cube, the mip chain
+// and the GGX prefiltering. The equirectangular source has 4 times the side of the faces in width
+// usage: cubemap_bench [max side = 512] [samples per texel of the prefiltering = 64] [prefiltered levels = 5]
+
+using namespace tg;
+
+int main(int argc, char** argv)
+{
+    const int maxSide = int(bench::argInt(argc, argv, 1, 512));
+    const int numSamples = int(bench::argInt(argc, argv, 2, 64));
+    const int maxLevels = int(bench::argInt(argc, argv, 3, 5));
+
+    printf("%6s %20s %20s %20s\n", "side", "equirectToCube", "generateCubeMips", "prefilterGgxCube");
+    printf("%6s %20s %20s %20s\n", "", "ms  Mtexel/s", "ms  Mtexel/s", "ms  Mtexel/s");
+    for(int side = 32; side <= maxSide; side *= 2) {
+        const int w = 4 * side, h = 2 * side;
+        tl::Vector<glm::vec3> equirectData(w * h);
+        for(int y = 0; y < h; y++)
+        for(int x = 0; x < w; x++)
+            equirectData[y * w + x] = {float(x % 61) / 60.f, float(y % 37) / 9.f, float((x ^ y) & 255) / 255.f};
+        const ImgView3f equirect(w, h, equirectData.data());
+
+        const int numMips = cubeNumMips(side);
+        tl::Vector<CubeImg3f> mips(numMips);
+        mips[0] = CubeImg3f(side);
+        const double toCubeSeconds = bench::secondsPerCall([&] {
+            equirectToCube(mips[0], equirect);
+        });
+        const double mipsSeconds = bench::secondsPerCall([&] {
+            generateCubeMips(mips.data(), numMips);
+        });
+        const int numLevels = tl::min(maxLevels, numMips);
+        tl::Vector<CubeImg3f> prefiltered(numLevels);
+        const double prefilterSeconds = bench::secondsPerCall([&] {
+            prefilterGgxCube(prefiltered.data(), numLevels, side, mips.data(), numMips, numSamples);
+        }, 0);
+
+        // texels written by each step
+        const double faceTexels = 6.0 * side * side;
+        double mipTexels = 0, prefilterTexels = 0;
+        for(int i = 1; i < numMips; i++)
+            mipTexels += 6.0 * (side >> i) * (side >> i);
+        for(int i = 0; i < numLevels; i++)
+            prefilterTexels += 6.0 * (side >> i) * (side >> i);
+        printf("%6d %9.2f %10.1f %9.2f %10.1f %9.2f %10.1f\n", side,
+            1e3 * toCubeSeconds, 1e-6 * faceTexels / toCubeSeconds,
+            1e3 * mipsSeconds, 1e-6 * mipTexels / mipsSeconds,
+            1e3 * prefilterSeconds, 1e-6 * prefilterTexels / prefilterSeconds);
+    }
+}
@@ -0,0 +1,91 @@
+#include "bench.hpp"
+
+#include <stdio.h>
+#include <string.h>
+#include <tl/basic.hpp>
+#include <tl/containers/vector.hpp>
+#include <tl/hash/hash.hpp>
+
+// tl::hashBytes against the MurmurHash2 variant of robin_hood that it replaced, and against itself without the
+// AVX2 path (hashBytesBaseline), for inputs from 8 bytes to 1 MB. The calls depend on each other and read at
+// unaligned addresses, like the lookups of a hash map with string keys
+// usage: hash_bench
+
+// robin_hood::hash_bytes, before wyhash
+static size_t oldHashBytes(const void* ptr, size_t len)
+{
+    static constexpr u64 m = 0xc6a4a7935bd1e995ull;
+    static constexpr u64 seed = 0xe17a1465ull;
+    static constexpr unsigned r = 47;
+
+    const u8* data = (const u8*)ptr;
+    u64 h = seed ^ (len * m);
+    const size_t n_blocks = len / 8;
+    for(size_t i = 0; i < n_blocks; ++i) {
+        u64 k;
+        memcpy(&k, data + 8 * i, 8);
+        k *= m;
+        k ^= k >> r;
+        k *= m;
+        h ^= k;
+        h *= m;
+    }
+
+    const u8* data8 = data + 8 * n_blocks;
+    switch(len & 7U) {
+    case 7: h ^= u64(data8[6]) << 48U; [[fallthrough]];
+    case 6: h ^= u64(data8[5]) << 40U; [[fallthrough]];
+    case 5: h ^= u64(data8[4]) << 32U; [[fallthrough]];
+    case 4: h ^= u64(data8[3]) << 24U; [[fallthrough]];
+    case 3: h ^= u64(data8[2]) << 16U; [[fallthrough]];
+    case 2: h ^= u64(data8[1]) << 8U; [[fallthrough]];
+    case 1:
+        h ^= u64(data8[0]);
+        h *= m;
+        break;
+    default: break;
+    }
+
+    h ^= h >> r;
+    h *= m;
+    h ^= h >> r;
+    return size_t(h);
+}
+
+template <typename HashFn>
+static double nsPerHash(const tl::Vector<u8>& buf, size_t n, const HashFn& hash)
+{
+    // about 64 MB hashed per call of secondsPerCall
+    const size_t numHashes = tl::max(size_t(1) << 26, n) / n;
+    return 1e9 / numHashes * bench::secondsPerCall([&] {
+        size_t acc = 0;
+        for(size_t i = 0; i < numHashes; i++)
+            acc += hash(buf.data() + (i & 7) + (acc & 1), n);
+        bench::doNotOptimize(acc);
+    });
+}
+
+int main()
+{
+    const size_t maxSize = 1 << 20;
+    tl::Vector<u8> buf(maxSize + 16);
+    u64 s = 0x2545F4914F6CDD1Dull;
+    for(u8& c : buf) {
+        s ^= s << 13;
+        s ^= s >> 7;
+        s ^= s << 17;
+        c = u8(s);
+    }
+
+    printf("%9s %20s %20s %20s\n", "bytes", "hashBytes", "without AVX2", "robin_hood");
+    printf("%9s %20s %20s %20s\n", "", "ns  GB/s", "ns  GB/s", "ns  GB/s");
+    for(size_t n = 8; n <= maxSize; n *= 2) {
+        if(tl::hashBytes(buf.data() + 3, n) != tl::hashBytesBaseline(buf.data() + 3, n))
+            printf("%9zu: hashBytes and hashBytesBaseline differ\n", n);
+        const double ns = nsPerHash(buf, n, tl::hashBytes);
+        const double baselineNs = nsPerHash(buf, n, tl::hashBytesBaseline);
+        const double oldNs = nsPerHash(buf, n, oldHashBytes);
+        printf("%9zu %9.1f %10.2f %9.1f %10.2f %9.1f %10.2f\n", n,
+            ns, n / ns, baselineNs, n / baselineNs, oldNs, n / oldNs);
+    }
+}
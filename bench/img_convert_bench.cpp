@@ -0,0 +1,65 @@
+#include "bench.hpp"
+
+#include <stdio.h>
+#include <math.h>
+#include <tl/basic.hpp>
+#include <tl/containers/vector.hpp>
+#include <tg/img.hpp>
+
+// Float to 8 bit conversion of the image export: linearToGammaU8() against the scalar loop it replaced, which
+// called pow() for every channel
+// usage: img_convert_bench [width] [height]
+
+using namespace tg;
+
+static void oldScalarPath(u8* dst, const float* src, int numValues)
+{
+    const float invGamma = 1.f / 2.2f;
+    for(int i = 0; i < numValues; i++)
+        dst[i] = (u8)(255 * pow(src[i], invGamma));
+}
+
+int main(int argc, char** argv)
+{
+    const int w = int(bench::argInt(argc, argv, 1, 3840));
+    const int h = int(bench::argInt(argc, argv, 2, 2160));
+    const int numValues = 3 * w * h;
+
+    // gradients, with some values above 1 to go through the clamping
+    tl::Vector<float> src(numValues);
+    for(int i = 0; i < numValues; i++)
+        src[i] = float(i % 997) / 900.f;
+    tl::Vector<u8> oldDst(numValues);
+    tl::Vector<u8> newDst(numValues);
+    const ImgView3f srcView(w, h, (glm::vec3*)src.data());
+    const ImgView3u8 dstView(w, h, (glm::vec<3, u8>*)newDst.data());
+
+    const double oldSeconds = bench::secondsPerCall([&] {
+        oldScalarPath(oldDst.data(), src.data(), numValues);
+        bench::doNotOptimize(oldDst[0]);
+    }, 1);
+    const double newSeconds = bench::secondsPerCall([&] {
+        linearToGammaU8<3>(dstView, srcView);
+        bench::doNotOptimize(newDst[0]);
+    });
+    const double reinhardSeconds = bench::secondsPerCall([&] {
+        linearToGammaU8<3>(dstView, srcView, ETonemap::REINHARD);
+        bench::doNotOptimize(newDst[0]);
+    });
+
+    // the old path truncated instead of rounding, and wrapped around above 1
+    linearToGammaU8<3>(dstView, srcView);
+    int maxDiff = 0;
+    for(int i = 0; i < numValues; i++) {
+        if(src[i] <= 1)
+            maxDiff = tl::max(maxDiff, abs(int(oldDst[i]) - int(newDst[i])));
+    }
+
+    const double megapixels = 1e-6 * w * h;
+    printf("%dx%d, %.1f Mpx\n", w, h, megapixels);
+    printf("255*pow(f, 1/2.2):    %8.2f ms  %8.1f Mpx/s\n", 1e3 * oldSeconds, megapixels / oldSeconds);
+    printf("linearToGammaU8:      %8.2f ms  %8.1f Mpx/s  (x%.1f)\n",
+        1e3 * newSeconds, megapixels / newSeconds, oldSeconds / newSeconds);
+    printf("  with REINHARD:      %8.2f ms  %8.1f Mpx/s\n", 1e3 * reinhardSeconds, megapixels / reinhardSeconds);
+    printf("max difference in [0, 1]: %d\n", maxDiff);
+}
@@ -0,0 +1,45 @@
+#include "bench.hpp"
+
+#include <stdio.h>
+#include <tl/profiler.hpp>
+
+// Cost of a TL_PROFILE_ZONE when TL_PROFILER is defined (without it the macro expands to nothing). The zones are
+// created directly, so it doesn't matter how tl was configured
+// usage: profiler_bench
+
+static constexpr int k_zonesPerCall = 1000;
+
+int main()
+{
+    const double empty = bench::secondsPerCall([] {
+        for(int i = 0; i < k_zonesPerCall; i++)
+            bench::doNotOptimize(i);
+    });
+    const double zone = bench::secondsPerCall([] {
+        for(int i = 0; i < k_zonesPerCall; i++) {
+            tl::profiler::ScopedZone z("zone");
+            bench::doNotOptimize(i);
+        }
+    });
+    const double nested = bench::secondsPerCall([] {
+        for(int i = 0; i < k_zonesPerCall / 2; i++) {
+            tl::profiler::ScopedZone outer("outer");
+            tl::profiler::ScopedZone inner("inner");
+            bench::doNotOptimize(i);
+        }
+    });
+    const double steadyClock = bench::secondsPerCall([] {
+        for(int i = 0; i < k_zonesPerCall; i++)
+            bench::doNotOptimize(tl::profiler::nowSteadyClock());
+    });
+    const double ticks = bench::secondsPerCall([] {
+        for(int i = 0; i < k_zonesPerCall; i++)
+            bench::doNotOptimize(tl::profiler::now());
+    });
+
+    const double toNs = 1e9 / k_zonesPerCall;
+    printf("zone:               %6.1f ns\n", (zone - empty) * toNs);
+    printf("zone, nested:       %6.1f ns\n", (nested - empty / 2) * toNs);
+    printf("profiler::now():    %6.1f ns\n", (ticks - empty) * toNs);
+    printf("nowSteadyClock():   %6.1f ns\n", (steadyClock - empty) * toNs);
+}
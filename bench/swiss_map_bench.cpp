@@ -0,0 +1,100 @@
+#include "bench.hpp"
+
+#include <stdio.h>
+#include <type_traits>
+#include <tl/basic.hpp>
+#include <tl/containers/vector.hpp>
+#include <tl/containers/hash_map.hpp>
+#include <tl/containers/swiss_map.hpp>
+
+// SwissMap against tl::hash_map with u64 keys, for sizes from 1000 up to the maximum given as argument, 10 times
+// bigger each step: insertion (without reserve), successful and unsuccessful lookups in random order, and
+// SwissMap::findBatch. A size of 1e8 needs a few GB of memory
+// usage: swiss_map_bench [max size = 10000000]
+
+static u64 mix(u64 x)
+{
+    x ^= x >> 31;
+    x *= 0x7fb5d329728ea185ull;
+    x ^= x >> 27;
+    x *= 0x81dadef4bc2dd44dull;
+    x ^= x >> 33;
+    return x;
+}
+
+// hash_map::find returns an iterator, adapt it to the pointer of SwissMap
+struct HashMapAdapter : tl::hash_map<u64, u64> {
+    u64* find(u64 key)
+    {
+        auto it = tl::hash_map<u64, u64>::find(key);
+        return it == end() ? nullptr : &it->second;
+    }
+};
+
+struct Result {
+    double insert, hit, miss, batch; // ns per operation
+};
+
+template <typename Map>
+static Result run(const tl::Vector<u64>& keys, const tl::Vector<u64>& hits, const tl::Vector<u64>& misses)
+{
+    const size_t n = keys.size();
+    // the small maps are built several times, to time at least a million insertions
+    const size_t numBuilds = tl::max(size_t(1), 1000000 / n);
+    Result r = {};
+    u64 check = 0;
+    Map map;
+    for(size_t b = 0; b < numBuilds; b++) {
+        map = Map();
+        const double start = bench::now();
+        for(size_t i = 0; i < n; i++)
+            map[keys[i]] = i;
+        r.insert += bench::now() - start;
+    }
+    r.insert *= 1e9 / (n * numBuilds);
+
+    double start = bench::now();
+    for(u64 key : hits)
+        check += *map.find(key);
+    r.hit = 1e9 * (bench::now() - start) / hits.size();
+
+    start = bench::now();
+    for(u64 key : misses)
+        check += map.find(key) != nullptr;
+    r.miss = 1e9 * (bench::now() - start) / misses.size();
+
+    if constexpr(!std::is_same<Map, HashMapAdapter>::value) {
+        tl::Vector<u64*> results(hits.size());
+        start = bench::now();
+        map.findBatch({hits.data(), hits.size()}, {results.data(), results.size()});
+        for(u64* value : results)
+            check += *value;
+        r.batch = 1e9 * (bench::now() - start) / hits.size();
+    }
+    bench::doNotOptimize(check);
+    return r;
+}
+
+int main(int argc, char** argv)
+{
+    const size_t maxN = size_t(bench::argInt(argc, argv, 1, 10000000));
+    printf("ns per operation\n%10s %-10s %8s %8s %8s %8s\n", "size", "map", "insert", "hit", "miss", "batch");
+    for(size_t n = 1000; n <= maxN; n *= 10) {
+        tl::Vector<u64> keys(n);
+        for(size_t i = 0; i < n; i++)
+            keys[i] = mix(i);
+        // between 1M and 10M lookups
+        const size_t numLookups = tl::min(tl::max(n, size_t(1000000)), size_t(10000000));
+        tl::Vector<u64> hits(numLookups);
+        tl::Vector<u64> misses(numLookups);
+        for(size_t i = 0; i < numLookups; i++) {
+            hits[i] = keys[mix(i + n) % n];
+            misses[i] = mix(i + 3 * n + 7);
+        }
+
+        const Result robin = run<HashMapAdapter>(keys, hits, misses);
+        printf("%10zu %-10s %8.1f %8.1f %8.1f %8s\n", n, "hash_map", robin.insert, robin.hit, robin.miss, "-");
+        const Result swiss = run<tl::SwissMap<u64, u64>>(keys, hits, misses);
+        printf("%10s %-10s %8.1f %8.1f %8.1f %8.1f\n", "", "SwissMap", swiss.insert, swiss.hit, swiss.miss, swiss.batch);
+    }
+}
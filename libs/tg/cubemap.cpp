@@ -0,0 +1,380 @@
+#include "cubemap.hpp"
+
+#include <math.h>
+#include <assert.h>
+#include <glm/glm.hpp>
+#include <tl/basic.hpp>
+#include <tl/containers/vector.hpp>
+#include <tl/jobs.hpp>
+#include "simd_math.hpp"
+
+using glm::vec2;
+using glm::vec3;
+
+namespace tg
+{
+
+static constexpr float k_pi = 3.14159265359f;
+
+vec3 equirectDir(vec2 uv)
+{
+    const float phi = 2 * k_pi * uv.x;
+    const float theta = k_pi * uv.y;
+    const float sinTheta = sinf(theta);
+    return vec3(-sinTheta * sinf(phi), cosf(theta), sinTheta * cosf(phi));
+}
+
+vec2 equirectUv(const vec3& dir)
+{
+    float u = atan2f(-dir.x, dir.z) / (2 * k_pi);
+    if(u < 0)
+        u += 1;
+    return vec2(u, acosf(tl::clamp(dir.y, -1.f, 1.f)) / k_pi);
+}
+
+ECubeImgFace cubeFace(const vec3& dir, vec2& uv)
+{
+    const vec3 a = glm::abs(dir);
+    ECubeImgFace face;
+    float sc, tc, ma; // see the table of the major axis in the OpenGL spec
+    if(a.x >= a.y && a.x >= a.z) {
+        face = dir.x > 0 ? ECubeImgFace::RIGHT : ECubeImgFace::LEFT;
+        sc = dir.x > 0 ? -dir.z : dir.z;
+        tc = -dir.y;
+        ma = a.x;
+    }
+    else if(a.y >= a.z) {
+        face = dir.y > 0 ? ECubeImgFace::UP : ECubeImgFace::DOWN;
+        sc = dir.x;
+        tc = dir.y > 0 ? dir.z : -dir.z;
+        ma = a.y;
+    }
+    else {
+        face = dir.z > 0 ? ECubeImgFace::FRONT : ECubeImgFace::BACK;
+        sc = dir.z > 0 ? dir.x : -dir.x;
+        tc = -dir.y;
+        ma = a.z;
+    }
+    uv = 0.5f * (vec2(sc, tc) / ma + 1.f);
+    return face;
+}
+
+vec3 cubeDir(ECubeImgFace face, vec2 uv)
+{
+    const float a = 2 * uv.x - 1;
+    const float b = 2 * uv.y - 1;
+    switch(face) {
+        case ECubeImgFace::LEFT: return vec3(-1, -b, a);
+        case ECubeImgFace::RIGHT: return vec3(1, -b, -a);
+        case ECubeImgFace::DOWN: return vec3(a, -1, -b);
+        case ECubeImgFace::UP: return vec3(a, 1, b);
+        case ECubeImgFace::FRONT: return vec3(a, -b, 1);
+        case ECubeImgFace::BACK: return vec3(-a, -b, -1);
+    }
+    assert(false);
+    return vec3(0);
+}
+
+static vec3* faceRow(CubeImgView3f& cube, int face, int y)
+{
+    const CubeImgView3f::Face& f = (&cube.left)[face];
+    return f.data + y * f.stride;
+}
+
+// bilinear, clamped to the edges of the face
+static vec3 sampleFace(const CubeImgView3f& cube, int face, vec2 uv)
+{
+    const CubeImgView3f::Face& f = (&cube.left)[face];
+    const int s = cube.sidePixels;
+    const vec2 p = glm::clamp(uv * float(s) - 0.5f, vec2(0), vec2(s - 1));
+    const int x0 = int(p.x), y0 = int(p.y);
+    const int x1 = tl::min(x0 + 1, s - 1), y1 = tl::min(y0 + 1, s - 1);
+    const vec2 t = p - vec2(x0, y0);
+    const vec3* row0 = f.data + y0 * f.stride;
+    const vec3* row1 = f.data + y1 * f.stride;
+    return glm::mix(
+        glm::mix(row0[x0], row0[x1], t.x),
+        glm::mix(row1[x0], row1[x1], t.x),
+        t.y);
+}
+
+vec3 sampleCube(const CubeImgView3f& cube, const vec3& dir)
+{
+    vec2 uv;
+    const ECubeImgFace face = cubeFace(dir, uv);
+    return sampleFace(cube, (int)face, uv);
+}
+
+vec3 sampleEquirect(const ImgView3f& equirect, vec2 uv)
+{
+    const int w = equirect.width(), h = equirect.height();
+    const float px = uv.x * w - 0.5f;
+    const float py = tl::clamp(uv.y * h - 0.5f, 0.f, float(h - 1));
+    const float fx0 = floorf(px);
+    int x0 = int(fx0) % w;
+    if(x0 < 0)
+        x0 += w;
+    const int x1 = x0 + 1 < w ? x0 + 1 : 0;
+    const int y0 = int(py);
+    const int y1 = tl::min(y0 + 1, h - 1);
+    const vec2 t(px - fx0, py - y0);
+    return glm::mix(
+        glm::mix(equirect(x0, y0), equirect(x1, y0), t.x),
+        glm::mix(equirect(x0, y1), equirect(x1, y1), t.x),
+        t.y);
+}
+
+void cubeToEquirect(ImgView3f dst, const CubeImgView3f& cube)
+{
+    const int w = dst.width(), h = dst.height();
+    tl::parallelFor(0, h, [&](int yBegin, int yEnd) {
+        for(int y = yBegin; y < yEnd; y++)
+        for(int x = 0; x < w; x++) {
+            const vec2 uv((x + 0.5f) / w, (y + 0.5f) / h);
+            dst(x, y) = sampleCube(cube, equirectDir(uv));
+        }
+    });
+}
+
+void equirectToCube(CubeImgView3f dst, const ImgView3f& equirect)
+{
+    const int s = dst.sidePixels;
+    tl::parallelFor(0, 6 * s, [&](int rowBegin, int rowEnd) {
+        for(int r = rowBegin; r < rowEnd; r++) {
+            const int face = r / s, y = r % s;
+            vec3* row = faceRow(dst, face, y);
+            for(int x = 0; x < s; x++) {
+                const vec3 dir = glm::normalize(cubeDir((ECubeImgFace)face, {(x + 0.5f) / s, (y + 0.5f) / s}));
+                row[x] = sampleEquirect(equirect, equirectUv(dir));
+            }
+        }
+    });
+}
+
+int cubeNumMips(int sidePixels)
+{
+    int n = 1;
+    while((sidePixels >> n) > 0)
+        n++;
+    return n;
+}
+
+void downsampleCube(CubeImgView3f dst, const CubeImgView3f& src)
+{
+    const int s = dst.sidePixels;
+    assert(src.sidePixels == 2 * s);
+    tl::parallelFor(0, 6 * s, [&](int rowBegin, int rowEnd) {
+        // sum of the 2 source rows, in floats
+        const int n = 2 * s * 3;
+        tl::Vector<float> rowSum((size_t)n);
+        CubeImgView3f srcView = src;
+        for(int r = rowBegin; r < rowEnd; r++) {
+            const int face = r / s, y = r % s;
+            const float* a = (const float*)faceRow(srcView, face, 2 * y);
+            const float* b = (const float*)faceRow(srcView, face, 2 * y + 1);
+            float* sum = rowSum.data();
+            int i = 0;
+#if TG_SSE
+            for(; i + 4 <= n; i += 4)
+                _mm_storeu_ps(sum + i, _mm_add_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+#endif
+            for(; i < n; i++)
+                sum[i] = a[i] + b[i];
+            const vec3* sumPixels = (const vec3*)sum;
+            vec3* row = faceRow(dst, face, y);
+            for(int x = 0; x < s; x++)
+                row[x] = 0.25f * (sumPixels[2 * x] + sumPixels[2 * x + 1]);
+        }
+    });
+}
+
+void generateCubeMips(CubeImg3f* mips, int numMips)
+{
+    const int side = mips[0].sidePixels;
+    assert((side & (side - 1)) == 0 && numMips <= cubeNumMips(side));
+    for(int i = 1; i < numMips; i++) {
+        mips[i] = CubeImg3f(side >> i);
+        downsampleCube(mips[i], mips[i - 1]);
+    }
+}
+
+static vec3 sampleFaceLod(const CubeImg3f* mips, int numMips, int face, vec2 uv, float lod)
+{
+    lod = tl::clamp(lod, 0.f, float(numMips - 1));
+    const int l0 = int(lod);
+    const int l1 = tl::min(l0 + 1, numMips - 1);
+    const vec3 c0 = sampleFace(mips[l0], face, uv);
+    if(l1 == l0)
+        return c0;
+    return glm::mix(c0, sampleFace(mips[l1], face, uv), lod - l0);
+}
+
+vec3 sampleCubeLod(const CubeImg3f* mips, int numMips, const vec3& dir, float lod)
+{
+    vec2 uv;
+    const ECubeImgFace face = cubeFace(dir, uv);
+    return sampleFaceLod(mips, numMips, (int)face, uv, lod);
+}
+
+float ggxPrefilterRough2(int level, int numLevels)
+{
+    const float roughness = numLevels > 1 ? float(level) / (numLevels - 1) : 0.f;
+    return roughness * roughness;
+}
+
+// Samples of the GGX lobe around +Z, with N = V. The same for all the texels of a level, the frame of each texel
+// rotates them. Structure of arrays, padded to a multiple of 4 with samples of weight 0
+struct LobeSamples {
+    tl::Vector<float> x, y, z;
+    tl::Vector<float> weight; // NoL
+    tl::Vector<float> lod;
+    float totalWeight;
+};
+
+static float radicalInverse(u32 bits)
+{
+    bits = (bits << 16u) | (bits >> 16u);
+    bits = ((bits & 0x55555555u) << 1u) | ((bits & 0xAAAAAAAAu) >> 1u);
+    bits = ((bits & 0x33333333u) << 2u) | ((bits & 0xCCCCCCCCu) >> 2u);
+    bits = ((bits & 0x0F0F0F0Fu) << 4u) | ((bits & 0xF0F0F0F0u) >> 4u);
+    bits = ((bits & 0x00FF00FFu) << 8u) | ((bits & 0xFF00FF00u) >> 8u);
+    return float(bits) * 2.3283064365386963e-10f;
+}
+
+static void makeGgxSamples(LobeSamples& samples, float rough2, int numSamples, int srcSide, int dstSide)
+{
+    samples = LobeSamples();
+    samples.totalWeight = 0;
+    // reading from a mip finer than the destination would alias
+    const float minLod = log2f(float(srcSide) / dstSide);
+    auto add = [&](vec3 L, float weight, float lod) {
+        samples.x.push_back(L.x);
+        samples.y.push_back(L.y);
+        samples.z.push_back(L.z);
+        samples.weight.push_back(weight);
+        samples.lod.push_back(lod);
+        samples.totalWeight += weight;
+    };
+    if(rough2 == 0) {
+        add(vec3(0, 0, 1), 1, minLod); // mirror
+    }
+    else {
+        const float rough4 = rough2 * rough2;
+        const float texelSolidAngle = 4 * k_pi / (6.f * srcSide * srcSide);
+        for(int i = 0; i < numSamples; i++) {
+            const float phi = 2 * k_pi * (float(i) + 0.5f) / numSamples;
+            const float r = radicalInverse(u32(i));
+            const float cosTheta = sqrtf((1 - r) / (1 + (rough4 - 1) * r));
+            const float sinTheta = sqrtf(1 - cosTheta * cosTheta);
+            const vec3 H(sinTheta * cosf(phi), sinTheta * sinf(phi), cosTheta);
+            const vec3 L = 2 * H.z * H - vec3(0, 0, 1);
+            if(L.z <= 0)
+                continue;
+            // pdf of L: D * NoH / (4 * VoH), and NoH = VoH
+            const float d = cosTheta * cosTheta * (rough4 - 1) + 1;
+            const float pdf = rough4 / (k_pi * d * d) / 4;
+            const float sampleSolidAngle = 1 / (numSamples * pdf);
+            add(L, L.z, tl::max(0.5f * log2f(sampleSolidAngle / texelSolidAngle), minLod));
+        }
+    }
+    while(samples.x.size() % 4)
+        add(vec3(0, 0, 1), 0, 0);
+}
+
+#if TG_SSE
+static __m128 selectSse(__m128 mask, __m128 a, __m128 b)
+{
+    return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+}
+
+// cubeFace() of 4 directions
+static void cubeFaceSse(__m128 x, __m128 y, __m128 z, int* faces, float* us, float* vs)
+{
+    const __m128 signMask = _mm_set1_ps(-0.f);
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 ax = _mm_andnot_ps(signMask, x);
+    const __m128 ay = _mm_andnot_ps(signMask, y);
+    const __m128 az = _mm_andnot_ps(signMask, z);
+    const __m128 isX = _mm_and_ps(_mm_cmpge_ps(ax, ay), _mm_cmpge_ps(ax, az));
+    const __m128 isY = _mm_andnot_ps(isX, _mm_cmpge_ps(ay, az)); // the rest are Z
+    const __m128 xPos = _mm_cmpgt_ps(x, zero);
+    const __m128 yPos = _mm_cmpgt_ps(y, zero);
+    const __m128 zPos = _mm_cmpgt_ps(z, zero);
+    const __m128 negX = _mm_xor_ps(x, signMask);
+    const __m128 negY = _mm_xor_ps(y, signMask);
+    const __m128 negZ = _mm_xor_ps(z, signMask);
+    const __m128 ma = selectSse(isX, ax, selectSse(isY, ay, az));
+    const __m128 sc = selectSse(isX, selectSse(xPos, negZ, z), selectSse(isY, x, selectSse(zPos, x, negX)));
+    const __m128 tc = selectSse(isY, selectSse(yPos, z, negZ), negY);
+    const __m128 face = selectSse(isX, selectSse(xPos, _mm_set1_ps(1), zero),
+        selectSse(isY, selectSse(yPos, _mm_set1_ps(3), _mm_set1_ps(2)), selectSse(zPos, _mm_set1_ps(4), _mm_set1_ps(5))));
+    const __m128 half = _mm_set1_ps(0.5f);
+    const __m128 scale = _mm_div_ps(half, ma);
+    _mm_storeu_ps(us, _mm_add_ps(_mm_mul_ps(sc, scale), half));
+    _mm_storeu_ps(vs, _mm_add_ps(_mm_mul_ps(tc, scale), half));
+    _mm_storeu_si128((__m128i*)faces, _mm_cvttps_epi32(face));
+}
+#endif
+
+static vec3 prefilterTexel(const CubeImg3f* mips, int numMips, const LobeSamples& samples, const vec3& N)
+{
+    const vec3 up = fabsf(N.z) < 0.999f ? vec3(0, 0, 1) : vec3(1, 0, 0);
+    const vec3 tx = glm::normalize(glm::cross(up, N));
+    const vec3 ty = glm::cross(N, tx);
+    vec3 sum(0);
+    const int n = (int)samples.x.size();
+    for(int i = 0; i < n; i += 4) {
+        // the rotation and the choice of the face are done for 4 samples at once, only the lookups are scalar
+        int faces[4];
+        float us[4], vs[4];
+#if TG_SSE
+        const __m128 lx = _mm_loadu_ps(&samples.x[i]);
+        const __m128 ly = _mm_loadu_ps(&samples.y[i]);
+        const __m128 lz = _mm_loadu_ps(&samples.z[i]);
+        auto rotate = [&](float a, float b, float c) {
+            return _mm_add_ps(_mm_add_ps(_mm_mul_ps(lx, _mm_set1_ps(a)), _mm_mul_ps(ly, _mm_set1_ps(b))),
+                _mm_mul_ps(lz, _mm_set1_ps(c)));
+        };
+        cubeFaceSse(rotate(tx.x, ty.x, N.x), rotate(tx.y, ty.y, N.y), rotate(tx.z, ty.z, N.z), faces, us, vs);
+#else
+        for(int k = 0; k < 4; k++) {
+            const vec3 L = samples.x[i + k] * tx + samples.y[i + k] * ty + samples.z[i + k] * N;
+            vec2 uv;
+            faces[k] = (int)cubeFace(L, uv);
+            us[k] = uv.x;
+            vs[k] = uv.y;
+        }
+#endif
+        for(int k = 0; k < 4; k++) {
+            const float weight = samples.weight[i + k];
+            if(weight > 0)
+                sum += weight * sampleFaceLod(mips, numMips, faces[k], {us[k], vs[k]}, samples.lod[i + k]);
+        }
+    }
+    return sum / samples.totalWeight;
+}
+
+void prefilterGgxCube(CubeImg3f* dst, int numLevels, int sidePixels,
+    const CubeImg3f* srcMips, int numSrcMips, int numSamples)
+{
+    const int srcSide = srcMips[0].sidePixels;
+    LobeSamples samples;
+    for(int level = 0; level < numLevels; level++) {
+        const int s = tl::max(1, sidePixels >> level);
+        dst[level] = CubeImg3f(s);
+        makeGgxSamples(samples, ggxPrefilterRough2(level, numLevels), numSamples, srcSide, s);
+        CubeImgView3f& view = dst[level];
+        tl::parallelFor(0, 6 * s, [&](int rowBegin, int rowEnd) {
+            for(int r = rowBegin; r < rowEnd; r++) {
+                const int face = r / s, y = r % s;
+                vec3* row = faceRow(view, face, y);
+                for(int x = 0; x < s; x++) {
+                    const vec3 N = glm::normalize(cubeDir((ECubeImgFace)face, {(x + 0.5f) / s, (y + 0.5f) / s}));
+                    row[x] = prefilterTexel(srcMips, numSrcMips, samples, N);
+                }
+            }
+        });
+    }
+}
+
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <glm/vec2.hpp>
+#include <glm/vec3.hpp>
+#include "img.hpp"
+
+namespace tg
+{
+
+// Conventions of the environment maps, shared with the shaders:
+// - equirectangular (latitude-longitude): u in [0, 1) is the longitude, u = 0.5 looks towards -Z and u grows towards
+//   +X. v in [0, 1] is the latitude, from +Y (v = 0, first row of the image) to -Y
+// - cube: the faces follow the OpenGL convention, LEFT: -X, RIGHT: +X, DOWN: -Y, UP: +Y, FRONT: +Z, BACK: -Z,
+//   and the first row of each face is t = 0 of glTexImage2D
+
+glm::vec3 equirectDir(glm::vec2 uv);
+glm::vec2 equirectUv(const glm::vec3& dir); // dir must be normalized
+
+// uv: position inside the face, in [0, 1]^2
+ECubeImgFace cubeFace(const glm::vec3& dir, glm::vec2& uv);
+glm::vec3 cubeDir(ECubeImgFace face, glm::vec2 uv); // not normalized
+
+// bilinear lookup, clamped to the edges of the face
+glm::vec3 sampleCube(const CubeImgView3f& cube, const glm::vec3& dir);
+// bilinear lookup, u wraps around and v is clamped
+glm::vec3 sampleEquirect(const ImgView3f& equirect, glm::vec2 uv);
+
+// The conversions and filters below process the rows of all the faces in parallel
+
+// resamples a cube map to the equirectangular image dst
+void cubeToEquirect(ImgView3f dst, const CubeImgView3f& cube);
+// resamples an equirectangular image to the cube map dst
+void equirectToCube(CubeImgView3f dst, const ImgView3f& equirect);
+
+// number of levels of a full mip chain, down to 1x1
+int cubeNumMips(int sidePixels);
+// 2x2 box filter of each face. The side of src must be twice the side of dst
+void downsampleCube(CubeImgView3f dst, const CubeImgView3f& src);
+// mips[0] must be filled, with a power of 2 side. The levels [1, numMips) are allocated and computed from it
+void generateCubeMips(CubeImg3f* mips, int numMips);
+// trilinear lookup in a mip chain. lod is clamped to the available levels
+glm::vec3 sampleCubeLod(const CubeImg3f* mips, int numMips, const glm::vec3& dir, float lod);
+
+// Prefiltered specular radiance of the split-sum approximation (Karis 2013, "Real Shading in Unreal Engine 4")
+// Level i is the environment convolved with the GGX lobe of rough2 = ggxPrefilterRough2(i, numLevels), assuming
+// N = V = R, so it's looked up with the reflected direction and lod = sqrt(rough2) * (numLevels - 1)
+// Each texel importance samples the lobe, and reads each sample from the mip whose texels cover the solid angle of
+// the sample (filtered importance sampling), so a few tens of samples are enough
+// dst: numLevels cube maps, allocated here. The side of level i is sidePixels >> i
+// srcMips: full mip chain of the environment, see generateCubeMips
+void prefilterGgxCube(CubeImg3f* dst, int numLevels, int sidePixels,
+    const CubeImg3f* srcMips, int numSrcMips, int numSamples = 64);
+float ggxPrefilterRough2(int level, int numLevels);
+
+}
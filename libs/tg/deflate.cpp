@@ -0,0 +1,559 @@
+#include "deflate.hpp"
+
+#include <assert.h>
+#include <string.h>
+#include <algorithm>
+#include <tl/basic.hpp>
+
+namespace tg
+{
+
+static constexpr int k_windowSize = 1 << 15;
+static constexpr int k_minMatch = 3;
+static constexpr int k_maxMatch = 258;
+static constexpr int k_hashBits = 15;
+static constexpr int k_maxBlockTokens = 1 << 14; // the Huffman codes are rebuilt for each block
+static constexpr int k_maxStoredBlock = 0xFFFF;
+static constexpr int k_numLitCodes = 288; // the last 2 are never used, but they take part in the fixed code
+static constexpr int k_numDistCodes = 30;
+static constexpr int k_numCodeLengthCodes = 19;
+
+struct LevelParams {
+    int maxChain; // max number of candidates checked for each match
+    int niceLength; // the search stops when a match is at least this long
+    bool lazy; // check if the next position has a longer match before emitting one
+};
+static const LevelParams k_levels[10] = {
+    {0, 0, false}, // stored
+    {2, 8, false},
+    {4, 16, false},
+    {6, 32, false},
+    {4, 16, true},
+    {8, 32, true},
+    {16, 128, true},
+    {32, 128, true},
+    {64, k_maxMatch, true},
+    {128, k_maxMatch, true},
+};
+
+static const u16 k_lengthBase[29] = {3,4,5,6,7,8,9,10,11,13,15,17,19,23,27,31,35,43,51,59,67,83,99,115,131,163,195,227,258};
+static const u8 k_lengthExtra[29] = {0,0,0,0,0,0,0,0,1,1,1,1,2,2,2,2,3,3,3,3,4,4,4,4,5,5,5,5,0};
+static const u16 k_distBase[30] = {1,2,3,4,5,7,9,13,17,25,33,49,65,97,129,193,257,385,513,769,1025,1537,2049,3073,4097,6145,
+    8193,12289,16385,24577};
+static const u8 k_distExtra[30] = {0,0,0,0,1,1,2,2,3,3,4,4,5,5,6,6,7,7,8,8,9,9,10,10,11,11,12,12,13,13};
+// order in which the lengths of the code length code are stored in the block header
+static const u8 k_codeLengthOrder[k_numCodeLengthCodes] = {16,17,18,0,8,7,9,6,10,5,11,4,12,3,13,2,14,1,15};
+static const u8 k_codeLengthExtra[3] = {2, 3, 7}; // for the codes 16, 17, 18
+
+struct HuffmanCode {
+    u16 codes[k_numLitCodes]; // bit reversed, because deflate writes the codes starting from the most significant bit
+    u8 lengths[k_numLitCodes];
+};
+
+static u32 reverseBits(u32 x, int numBits)
+{
+    u32 r = 0;
+    for(int i = 0; i < numBits; i++, x >>= 1)
+        r = (r << 1) | (x & 1);
+    return r;
+}
+
+// canonical codes from the lengths
+static void buildCodes(HuffmanCode& code, int n)
+{
+    int count[16] = {};
+    for(int i = 0; i < n; i++)
+        count[code.lengths[i]]++;
+    count[0] = 0;
+    u32 next[16];
+    u32 c = 0;
+    for(int len = 1; len < 16; len++) {
+        c = (c + count[len-1]) << 1;
+        next[len] = c;
+    }
+    for(int i = 0; i < n; i++) {
+        const int len = code.lengths[i];
+        code.codes[i] = len ? reverseBits(next[len]++, len) : 0;
+    }
+}
+
+// lengths of a Huffman code for the frequencies, limited to maxLength bits
+// The code is always complete: if fewer than 2 symbols are used, unused ones are added, which all decoders accept
+static void buildLengths(u8* lengths, const u32* freqs, int n, int maxLength)
+{
+    assert(n <= k_numLitCodes);
+    u32 f[k_numLitCodes];
+    memcpy(f, freqs, n * sizeof(u32));
+    for(;;) {
+        int leaves[k_numLitCodes];
+        int numLeaves = 0;
+        for(int i = 0; i < n; i++)
+            if(f[i])
+                leaves[numLeaves++] = i;
+        memset(lengths, 0, n);
+        if(numLeaves < 2) {
+            const int used = numLeaves ? leaves[0] : 0;
+            lengths[used] = 1;
+            lengths[used ? 0 : 1] = 1;
+            return;
+        }
+        std::sort(leaves, leaves + numLeaves, [&f](int a, int b) {
+            return f[a] < f[b] || (f[a] == f[b] && a < b);
+        });
+
+        // two queues: the leaves sorted by frequency, followed by the inner nodes, which are created in non decreasing order
+        u32 nodeFreq[2 * k_numLitCodes];
+        int parent[2 * k_numLitCodes];
+        for(int i = 0; i < numLeaves; i++)
+            nodeFreq[i] = f[leaves[i]];
+        int nextLeaf = 0, nextInner = numLeaves, numNodes = numLeaves;
+        auto popSmallest = [&]() {
+            if(nextLeaf < numLeaves && (nextInner == numNodes || nodeFreq[nextLeaf] <= nodeFreq[nextInner]))
+                return nextLeaf++;
+            return nextInner++;
+        };
+        while(numNodes < 2 * numLeaves - 1) {
+            const int a = popSmallest();
+            const int b = popSmallest();
+            nodeFreq[numNodes] = nodeFreq[a] + nodeFreq[b];
+            parent[a] = parent[b] = numNodes;
+            numNodes++;
+        }
+
+        // the parents are always after their children, so the depths can be propagated from the root in one pass
+        int depth[2 * k_numLitCodes];
+        depth[numNodes - 1] = 0;
+        for(int i = numNodes - 2; i >= 0; i--)
+            depth[i] = depth[parent[i]] + 1;
+        int maxDepth = 0;
+        for(int i = 0; i < numLeaves; i++) {
+            lengths[leaves[i]] = u8(depth[i]);
+            maxDepth = tl::max(maxDepth, depth[i]);
+        }
+        if(maxDepth <= maxLength)
+            return;
+        // flatten the distribution until the tree is shallow enough. In the limit all the frequencies are 1
+        for(int i = 0; i < n; i++)
+            if(f[i])
+                f[i] = (f[i] >> 1) | 1;
+    }
+}
+
+struct Tables {
+    u8 lengthSymbol[k_maxMatch + 1]; // match length -> index in k_lengthBase
+    u8 distSymbol[512]; // see distSymbol()
+    u32 crc[256];
+    HuffmanCode fixedLit, fixedDist;
+    Tables();
+};
+Tables::Tables()
+{
+    // 258 belongs to both the symbols 27 and 28, the last one wins
+    for(int s = 0; s < 29; s++)
+    for(int len = k_lengthBase[s]; len < k_lengthBase[s] + (1 << k_lengthExtra[s]) && len <= k_maxMatch; len++)
+        lengthSymbol[len] = u8(s);
+    for(int s = 0; s < 30; s++)
+    for(int d = k_distBase[s] - 1; d < k_distBase[s] - 1 + (1 << k_distExtra[s]); d++)
+        distSymbol[d < 256 ? d : 256 + (d >> 7)] = u8(s);
+
+    for(u32 i = 0; i < 256; i++) {
+        u32 c = i;
+        for(int k = 0; k < 8; k++)
+            c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+        crc[i] = c;
+    }
+
+    for(int i = 0; i < k_numLitCodes; i++)
+        fixedLit.lengths[i] = i < 144 ? 8 : i < 256 ? 9 : i < 280 ? 7 : 8;
+    buildCodes(fixedLit, k_numLitCodes);
+    for(int i = 0; i < k_numDistCodes; i++)
+        fixedDist.lengths[i] = 5;
+    buildCodes(fixedDist, k_numDistCodes);
+}
+static const Tables& tables()
+{
+    static const Tables t;
+    return t;
+}
+
+static int distSymbol(const Tables& t, int dist)
+{
+    const int d = dist - 1;
+    return t.distSymbol[d < 256 ? d : 256 + (d >> 7)];
+}
+
+u32 crc32(const u8* data, size_t n, u32 crc)
+{
+    const u32* table = tables().crc;
+    crc = ~crc;
+    for(size_t i = 0; i < n; i++)
+        crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    return ~crc;
+}
+
+static constexpr u32 k_adlerMod = 65521;
+
+u32 adler32(const u8* data, size_t n)
+{
+    u32 a = 1, b = 0;
+    while(n) {
+        // the largest number of bytes that can be summed before b overflows
+        const size_t k = tl::min(n, size_t(5552));
+        for(size_t i = 0; i < k; i++) {
+            a += data[i];
+            b += a;
+        }
+        a %= k_adlerMod;
+        b %= k_adlerMod;
+        data += k;
+        n -= k;
+    }
+    return a | (b << 16);
+}
+
+u32 adler32Combine(u32 adler1, u32 adler2, size_t size2)
+{
+    const u32 rem = u32(size2 % k_adlerMod);
+    u32 a = adler1 & 0xFFFF;
+    u32 b = u32((u64(rem) * a) % k_adlerMod);
+    a += (adler2 & 0xFFFF) + k_adlerMod - 1;
+    b += (adler1 >> 16) + (adler2 >> 16) + k_adlerMod - rem;
+    if(a >= k_adlerMod) a -= k_adlerMod;
+    if(a >= k_adlerMod) a -= k_adlerMod;
+    if(b >= 2 * k_adlerMod) b -= 2 * k_adlerMod;
+    if(b >= k_adlerMod) b -= k_adlerMod;
+    return a | (b << 16);
+}
+
+struct BitWriter {
+    tl::Vector<u8>& out;
+    u64 bits = 0;
+    int numBits = 0;
+
+    BitWriter(tl::Vector<u8>& out) : out(out) {}
+    void put(u32 value, int n)
+    {
+        bits |= u64(value) << numBits;
+        numBits += n;
+        if(numBits >= 32) {
+            const u8 bytes[4] = {u8(bits), u8(bits >> 8), u8(bits >> 16), u8(bits >> 24)};
+            out.append(bytes);
+            bits >>= 32;
+            numBits -= 32;
+        }
+    }
+    // pads with zeros, and writes all the pending bytes
+    void alignToByte()
+    {
+        numBits = (numBits + 7) & ~7;
+        for(; numBits > 0; numBits -= 8, bits >>= 8)
+            out.push_back(u8(bits));
+        bits = 0;
+        numBits = 0;
+    }
+};
+
+struct Token {
+    u16 litOrLength;
+    u16 dist; // 0 for literals
+};
+
+static void writeStored(BitWriter& bw, const u8* data, int n, bool final)
+{
+    do {
+        const int size = tl::min(n, k_maxStoredBlock);
+        bw.put(final && size == n, 1);
+        bw.put(0, 2);
+        bw.alignToByte();
+        bw.put(size, 16);
+        bw.put(~size & 0xFFFF, 16);
+        bw.alignToByte();
+        bw.out.append({data, size_t(size)});
+        data += size;
+        n -= size;
+    } while(n > 0);
+}
+
+static u64 dataBits(const u32* litFreqs, const u32* distFreqs, const u8* litLengths, const u8* distLengths)
+{
+    u64 bits = 0;
+    for(int i = 0; i < 286; i++)
+        bits += u64(litFreqs[i]) * (litLengths[i] + (i > 256 ? k_lengthExtra[i - 257] : 0));
+    for(int i = 0; i < k_numDistCodes; i++)
+        bits += u64(distFreqs[i]) * (distLengths[i] + k_distExtra[i]);
+    return bits;
+}
+
+static void writeTokens(BitWriter& bw, const Token* tokens, int numTokens, const HuffmanCode& lit, const HuffmanCode& dist)
+{
+    const Tables& t = tables();
+    for(int i = 0; i < numTokens; i++) {
+        const Token& token = tokens[i];
+        if(token.dist == 0) {
+            bw.put(lit.codes[token.litOrLength], lit.lengths[token.litOrLength]);
+            continue;
+        }
+        const int ls = t.lengthSymbol[token.litOrLength];
+        bw.put(lit.codes[257 + ls], lit.lengths[257 + ls]);
+        bw.put(token.litOrLength - k_lengthBase[ls], k_lengthExtra[ls]);
+        const int ds = distSymbol(t, token.dist);
+        bw.put(dist.codes[ds], dist.lengths[ds]);
+        bw.put(token.dist - k_distBase[ds], k_distExtra[ds]);
+    }
+    bw.put(lit.codes[256], lit.lengths[256]);
+}
+
+// writes the tokens as a block with dynamic or fixed Huffman codes, or the raw data as stored, whatever is smaller
+static void writeBlock(BitWriter& bw, const Token* tokens, int numTokens, const u8* raw, int rawSize, bool final)
+{
+    const Tables& t = tables();
+    u32 litFreqs[k_numLitCodes] = {};
+    u32 distFreqs[k_numDistCodes] = {};
+    for(int i = 0; i < numTokens; i++) {
+        const Token& token = tokens[i];
+        if(token.dist == 0) {
+            litFreqs[token.litOrLength]++;
+        }
+        else {
+            litFreqs[257 + t.lengthSymbol[token.litOrLength]]++;
+            distFreqs[distSymbol(t, token.dist)]++;
+        }
+    }
+    litFreqs[256] = 1;
+
+    HuffmanCode lit, dist;
+    buildLengths(lit.lengths, litFreqs, 286, 15);
+    buildLengths(dist.lengths, distFreqs, k_numDistCodes, 15);
+    int numLit = 286, numDist = k_numDistCodes;
+    while(numLit > 257 && lit.lengths[numLit - 1] == 0)
+        numLit--;
+    while(numDist > 1 && dist.lengths[numDist - 1] == 0)
+        numDist--;
+
+    // the lengths of both codes are run length encoded with the symbols 16 (repeat the previous), 17 and 18 (zeros)
+    u8 allLengths[286 + k_numDistCodes];
+    memcpy(allLengths, lit.lengths, numLit);
+    memcpy(allLengths + numLit, dist.lengths, numDist);
+    const int numLengths = numLit + numDist;
+    u8 rleSymbols[286 + k_numDistCodes];
+    u8 rleExtras[286 + k_numDistCodes];
+    int numRle = 0;
+    u32 clFreqs[k_numCodeLengthCodes] = {};
+    auto emitRle = [&](int symbol, int extra) {
+        rleSymbols[numRle] = u8(symbol);
+        rleExtras[numRle] = u8(extra);
+        numRle++;
+        clFreqs[symbol]++;
+    };
+    for(int i = 0; i < numLengths; ) {
+        const int len = allLengths[i];
+        int run = 1;
+        while(i + run < numLengths && allLengths[i + run] == len)
+            run++;
+        i += run;
+        if(len == 0) {
+            for(; run >= 11; run -= tl::min(run, 138))
+                emitRle(18, tl::min(run, 138) - 11);
+            if(run >= 3) {
+                emitRle(17, run - 3);
+                run = 0;
+            }
+        }
+        else {
+            emitRle(len, 0);
+            run--;
+            for(; run >= 3; run -= tl::min(run, 6))
+                emitRle(16, tl::min(run, 6) - 3);
+        }
+        for(; run > 0; run--)
+            emitRle(len, 0);
+    }
+    HuffmanCode cl;
+    buildLengths(cl.lengths, clFreqs, k_numCodeLengthCodes, 7);
+    buildCodes(cl, k_numCodeLengthCodes);
+    int numCl = k_numCodeLengthCodes;
+    while(numCl > 4 && cl.lengths[k_codeLengthOrder[numCl - 1]] == 0)
+        numCl--;
+
+    u64 dynamicBits = 3 + 5 + 5 + 4 + 3 * numCl + dataBits(litFreqs, distFreqs, lit.lengths, dist.lengths);
+    for(int i = 0; i < numRle; i++)
+        dynamicBits += cl.lengths[rleSymbols[i]] + (rleSymbols[i] >= 16 ? k_codeLengthExtra[rleSymbols[i] - 16] : 0);
+    const u64 fixedBits = 3 + dataBits(litFreqs, distFreqs, t.fixedLit.lengths, t.fixedDist.lengths);
+    const u64 storedBits = 8 * (u64(rawSize) + 5 * (rawSize / k_maxStoredBlock + 1)) + 7;
+
+    if(storedBits < tl::min(dynamicBits, fixedBits)) {
+        writeStored(bw, raw, rawSize, final);
+    }
+    else if(fixedBits <= dynamicBits) {
+        bw.put(final, 1);
+        bw.put(1, 2);
+        writeTokens(bw, tokens, numTokens, t.fixedLit, t.fixedDist);
+    }
+    else {
+        buildCodes(lit, numLit);
+        buildCodes(dist, numDist);
+        bw.put(final, 1);
+        bw.put(2, 2);
+        bw.put(numLit - 257, 5);
+        bw.put(numDist - 1, 5);
+        bw.put(numCl - 4, 4);
+        for(int i = 0; i < numCl; i++)
+            bw.put(cl.lengths[k_codeLengthOrder[i]], 3);
+        for(int i = 0; i < numRle; i++) {
+            const int s = rleSymbols[i];
+            bw.put(cl.codes[s], cl.lengths[s]);
+            if(s >= 16)
+                bw.put(rleExtras[i], k_codeLengthExtra[s - 16]);
+        }
+        writeTokens(bw, tokens, numTokens, lit, dist);
+    }
+}
+
+static int matchLength(const u8* a, const u8* b, int maxLength)
+{
+    int len = 0;
+    for(; len + 8 <= maxLength; len += 8) {
+        u64 x, y;
+        memcpy(&x, a + len, 8);
+        memcpy(&y, b + len, 8);
+        if(x != y)
+            break;
+    }
+    while(len < maxLength && a[len] == b[len])
+        len++;
+    return len;
+}
+
+// LZ77 with hash chains, the matches can't reach outside of the strip
+struct MatchFinder {
+    const u8* data;
+    int n;
+    LevelParams params;
+    tl::Vector<int> head;
+    tl::Vector<int> prev;
+
+    MatchFinder(const u8* data, int n, const LevelParams& params)
+        : data(data), n(n), params(params), head(size_t(1) << k_hashBits, -1), prev(k_windowSize) {}
+
+    u32 hash(int pos)const
+    {
+        const u32 x = data[pos] | (data[pos+1] << 8) | (data[pos+2] << 16);
+        return (x * 2654435761u) >> (32 - k_hashBits);
+    }
+    void insert(int pos)
+    {
+        if(n - pos < k_minMatch)
+            return;
+        const u32 h = hash(pos);
+        prev[pos & (k_windowSize - 1)] = head[h];
+        head[h] = pos;
+    }
+    // the length is 0 if there is no match
+    void find(int pos, int& bestLen, int& bestDist)const
+    {
+        bestLen = 0;
+        bestDist = 0;
+        if(n - pos < k_minMatch)
+            return;
+        const int maxLen = tl::min(k_maxMatch, n - pos);
+        int len = k_minMatch - 1;
+        int c = head[hash(pos)];
+        // the positions in the chain are always older, and the ones that are still in the window were not overwritten
+        for(int chain = params.maxChain; c >= 0 && pos - c <= k_windowSize && chain > 0; chain--) {
+            if(data[c + len] == data[pos + len]) {
+                const int l = matchLength(data + c, data + pos, maxLen);
+                if(l > len) {
+                    len = l;
+                    bestLen = l;
+                    bestDist = pos - c;
+                    if(l >= params.niceLength || l == maxLen)
+                        break;
+                }
+            }
+            c = prev[c & (k_windowSize - 1)];
+        }
+    }
+};
+
+void deflate(tl::Vector<u8>& out, const u8* data, size_t size, int level, bool isFinal)
+{
+    assert(size < (1u << 31));
+    const int n = int(size);
+    level = tl::clamp(level, 0, 9);
+    BitWriter bw(out);
+    if(level == 0) {
+        writeStored(bw, data, n, isFinal);
+    }
+    else {
+        MatchFinder finder(data, n, k_levels[level]);
+        // a lazy match can emit up to k_maxMatch literals before it
+        tl::Vector<Token> tokens(k_maxBlockTokens + k_maxMatch + 1);
+        int numTokens = 0;
+        int blockStart = 0;
+        int pos = 0;
+        while(pos < n) {
+            if(numTokens >= k_maxBlockTokens) {
+                writeBlock(bw, tokens.data(), numTokens, data + blockStart, pos - blockStart, false);
+                numTokens = 0;
+                blockStart = pos;
+            }
+            int len, dist;
+            finder.find(pos, len, dist);
+            finder.insert(pos);
+            if(finder.params.lazy) {
+                while(len >= k_minMatch && len < finder.params.niceLength && pos + 1 < n) {
+                    int nextLen, nextDist;
+                    finder.find(pos + 1, nextLen, nextDist);
+                    if(nextLen <= len)
+                        break;
+                    tokens[numTokens++] = {data[pos], 0};
+                    pos++;
+                    finder.insert(pos);
+                    len = nextLen;
+                    dist = nextDist;
+                }
+            }
+            if(len >= k_minMatch) {
+                tokens[numTokens++] = {u16(len), u16(dist)};
+                for(int i = 1; i < len; i++)
+                    finder.insert(pos + i);
+                pos += len;
+            }
+            else {
+                tokens[numTokens++] = {data[pos], 0};
+                pos++;
+            }
+        }
+        if(numTokens || isFinal)
+            writeBlock(bw, tokens.data(), numTokens, data + blockStart, pos - blockStart, isFinal);
+    }
+
+    if(!isFinal) {
+        // empty stored block: leaves the stream byte aligned without ending it
+        bw.put(0, 3);
+        bw.alignToByte();
+        bw.put(0xFFFF0000u, 32);
+    }
+    bw.alignToByte();
+}
+
+void zlibHeader(u8 (&header)[2], int level)
+{
+    header[0] = 0x78;
+    // the check bits make the header a multiple of 31
+    header[1] = level < 2 ? 0x01 : level < 6 ? 0x5E : level == 6 ? 0x9C : 0xDA;
+}
+
+void zlibCompress(tl::Vector<u8>& out, const u8* data, size_t size, int level)
+{
+    u8 header[2];
+    zlibHeader(header, level);
+    out.push_back(header[0]);
+    out.push_back(header[1]);
+    deflate(out, data, size, level, true);
+    const u32 adler = adler32(data, size);
+    for(int i = 3; i >= 0; i--)
+        out.push_back(u8(adler >> (8 * i)));
+}
+
+}
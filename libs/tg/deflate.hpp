@@ -0,0 +1,28 @@
+#pragma once
+
+#include <stddef.h>
+#include <tl/int_types.hpp>
+#include <tl/containers/vector.hpp>
+
+namespace tg
+{
+
+// Appends a raw deflate stream (RFC 1951) to out. LZ77 with hash chains, and for each block the smallest of dynamic
+// Huffman, fixed Huffman or stored
+// level: [0, 9] like zlib. 0 stores the data without compression
+// If it's not the final part, it ends with a sync flush (empty stored block): the output is byte aligned, and parts
+// compressed independently, even in different threads, can be concatenated. The matches don't reach into previous parts
+void deflate(tl::Vector<u8>& out, const u8* data, size_t size, int level, bool isFinal = true);
+
+// zlib stream (RFC 1950): header, final deflate stream and adler32
+void zlibCompress(tl::Vector<u8>& out, const u8* data, size_t size, int level);
+// the 2 bytes that start a zlib stream: deflate with a 32KB window, and a hint of the level
+void zlibHeader(u8 (&header)[2], int level);
+
+u32 adler32(const u8* data, size_t size);
+// adler32 of the concatenation of 2 buffers, from the adler32 of each, and the size of the second one
+u32 adler32Combine(u32 adler1, u32 adler2, size_t size2);
+// crc: the result of the previous part, to compute it in several steps
+u32 crc32(const u8* data, size_t size, u32 crc = 0);
+
+}
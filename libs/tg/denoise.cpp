@@ -0,0 +1,215 @@
+#include "denoise.hpp"
+
+#include <assert.h>
+#include <math.h>
+#include <tl/basic.hpp>
+#include <tl/containers/vector.hpp>
+#include <tl/jobs.hpp>
+#include "simd_math.hpp"
+
+namespace tg
+{
+
+static const float k_kernel[5] = {1.f/16, 1.f/4, 3.f/8, 1.f/4, 1.f/16}; // B3 spline
+static constexpr float k_minDepth2 = 1e-6f;
+
+// the images are converted to planes of floats, so consecutive pixels can be loaded in a SIMD register
+enum EGuidePlane { NX, NY, NZ, DEPTH, AR, AG, AB, NUM_GUIDE_PLANES };
+
+struct ATrousPass {
+    int w, h;
+    int step; // distance between the taps
+    float invSigmaColor2, invSigmaNormal2, invSigmaDepth2, invSigmaAlbedo2;
+    const float* guide[NUM_GUIDE_PLANES];
+    const float* src[3];
+    float* dst[3];
+};
+
+static void filterPixel(const ATrousPass& pass, int x, int y)
+{
+    const int w = pass.w, h = pass.h;
+    const int i = x + y * w;
+    float c[3], g[NUM_GUIDE_PLANES];
+    for(int k = 0; k < 3; k++)
+        c[k] = pass.src[k][i];
+    for(int k = 0; k < NUM_GUIDE_PLANES; k++)
+        g[k] = pass.guide[k][i];
+    const float invSigmaDepth2 = pass.invSigmaDepth2 / tl::max(g[DEPTH] * g[DEPTH], k_minDepth2);
+
+    float sum[3] = {0, 0, 0};
+    float sumW = 0;
+    for(int ky = -2; ky <= 2; ky++) {
+        const int qy = y + ky * pass.step;
+        if(qy < 0 || qy >= h)
+            continue;
+        for(int kx = -2; kx <= 2; kx++) {
+            const int qx = x + kx * pass.step;
+            if(qx < 0 || qx >= w)
+                continue;
+            const int j = qx + qy * w;
+            float dc2 = 0, dn2 = 0, da2 = 0;
+            for(int k = 0; k < 3; k++) {
+                const float dc = pass.src[k][j] - c[k];
+                const float dn = pass.guide[NX + k][j] - g[NX + k];
+                const float da = pass.guide[AR + k][j] - g[AR + k];
+                dc2 += dc * dc;
+                dn2 += dn * dn;
+                da2 += da * da;
+            }
+            const float dd = pass.guide[DEPTH][j] - g[DEPTH];
+            const float e = dc2 * pass.invSigmaColor2 + dn2 * pass.invSigmaNormal2 +
+                dd * dd * invSigmaDepth2 + da2 * pass.invSigmaAlbedo2;
+            const float weight = k_kernel[kx + 2] * k_kernel[ky + 2] * expf(-e);
+            for(int k = 0; k < 3; k++)
+                sum[k] += weight * pass.src[k][j];
+            sumW += weight;
+        }
+    }
+    // the center tap always has a positive weight
+    for(int k = 0; k < 3; k++)
+        pass.dst[k][i] = sum[k] / sumW;
+}
+
+#if TG_SSE
+// filters the pixels [x, x+4). All the taps must be inside the row
+static void filter4Pixels(const ATrousPass& pass, int x, int y)
+{
+    const int w = pass.w, h = pass.h;
+    const int i = x + y * w;
+    __m128 c[3], g[NUM_GUIDE_PLANES];
+    for(int k = 0; k < 3; k++)
+        c[k] = _mm_loadu_ps(pass.src[k] + i);
+    for(int k = 0; k < NUM_GUIDE_PLANES; k++)
+        g[k] = _mm_loadu_ps(pass.guide[k] + i);
+    const __m128 depth2 = _mm_max_ps(_mm_mul_ps(g[DEPTH], g[DEPTH]), _mm_set1_ps(k_minDepth2));
+    const __m128 invSigmaDepth2 = _mm_div_ps(_mm_set1_ps(pass.invSigmaDepth2), depth2);
+    const __m128 invSigmaColor2 = _mm_set1_ps(pass.invSigmaColor2);
+    const __m128 invSigmaNormal2 = _mm_set1_ps(pass.invSigmaNormal2);
+    const __m128 invSigmaAlbedo2 = _mm_set1_ps(pass.invSigmaAlbedo2);
+
+    __m128 sum[3] = {_mm_setzero_ps(), _mm_setzero_ps(), _mm_setzero_ps()};
+    __m128 sumW = _mm_setzero_ps();
+    for(int ky = -2; ky <= 2; ky++) {
+        const int qy = y + ky * pass.step;
+        if(qy < 0 || qy >= h)
+            continue;
+        for(int kx = -2; kx <= 2; kx++) {
+            const int j = x + kx * pass.step + qy * w;
+            __m128 q[3];
+            __m128 dc2 = _mm_setzero_ps(), dn2 = _mm_setzero_ps(), da2 = _mm_setzero_ps();
+            for(int k = 0; k < 3; k++) {
+                q[k] = _mm_loadu_ps(pass.src[k] + j);
+                const __m128 dc = _mm_sub_ps(q[k], c[k]);
+                const __m128 dn = _mm_sub_ps(_mm_loadu_ps(pass.guide[NX + k] + j), g[NX + k]);
+                const __m128 da = _mm_sub_ps(_mm_loadu_ps(pass.guide[AR + k] + j), g[AR + k]);
+                dc2 = _mm_add_ps(dc2, _mm_mul_ps(dc, dc));
+                dn2 = _mm_add_ps(dn2, _mm_mul_ps(dn, dn));
+                da2 = _mm_add_ps(da2, _mm_mul_ps(da, da));
+            }
+            const __m128 dd = _mm_sub_ps(_mm_loadu_ps(pass.guide[DEPTH] + j), g[DEPTH]);
+            __m128 e = _mm_mul_ps(dc2, invSigmaColor2);
+            e = _mm_add_ps(e, _mm_mul_ps(dn2, invSigmaNormal2));
+            e = _mm_add_ps(e, _mm_mul_ps(_mm_mul_ps(dd, dd), invSigmaDepth2));
+            e = _mm_add_ps(e, _mm_mul_ps(da2, invSigmaAlbedo2));
+            const __m128 weight = _mm_mul_ps(_mm_set1_ps(k_kernel[kx + 2] * k_kernel[ky + 2]),
+                expSse(_mm_sub_ps(_mm_setzero_ps(), e)));
+            for(int k = 0; k < 3; k++)
+                sum[k] = _mm_add_ps(sum[k], _mm_mul_ps(weight, q[k]));
+            sumW = _mm_add_ps(sumW, weight);
+        }
+    }
+    for(int k = 0; k < 3; k++)
+        _mm_storeu_ps(pass.dst[k] + i, _mm_div_ps(sum[k], sumW));
+}
+#endif
+
+static void filterRows(const ATrousPass& pass, int yBegin, int yEnd)
+{
+    const int border = 2 * pass.step;
+    for(int y = yBegin; y < yEnd; y++) {
+        int x = 0;
+    #if TG_SSE
+        // the pixels near the left and right edges have taps outside of the image, those go through the scalar path.
+        // The images narrower than 2 * border + 4 are all scalar
+        if(pass.w >= 2 * border + 4) {
+            for(; x < border; x++)
+                filterPixel(pass, x, y);
+            for(; x + 4 + border <= pass.w; x += 4)
+                filter4Pixels(pass, x, y);
+        }
+    #endif
+        for(; x < pass.w; x++)
+            filterPixel(pass, x, y);
+    }
+}
+
+void denoiseATrous(ImgView3f dst, const ImgView3f& color, const ImgView4f& normalDepth, const ImgView3f& albedo,
+    const ATrousParams& params)
+{
+    const int w = color.width();
+    const int h = color.height();
+    assert(dst.width() == w && dst.height() == h);
+    assert(normalDepth.width() == w && normalDepth.height() == h);
+    assert(albedo.width() == w && albedo.height() == h);
+    if(w == 0 || h == 0)
+        return;
+
+    // guide planes, then two sets of color planes for ping-ponging between iterations
+    const size_t n = size_t(w) * h;
+    tl::Vector<float> planes((NUM_GUIDE_PLANES + 6) * n);
+    float* guide[NUM_GUIDE_PLANES];
+    for(int k = 0; k < NUM_GUIDE_PLANES; k++)
+        guide[k] = planes.data() + k * n;
+    float* colors[2][3];
+    for(int k = 0; k < 6; k++)
+        colors[k / 3][k % 3] = planes.data() + (NUM_GUIDE_PLANES + k) * n;
+
+    tl::parallelFor(0, h, [&](int yBegin, int yEnd) {
+        for(int y = yBegin; y < yEnd; y++)
+        for(int x = 0; x < w; x++) {
+            const size_t i = x + size_t(y) * w;
+            const glm::vec4& nd = normalDepth(x, y);
+            const glm::vec3& a = albedo(x, y);
+            const glm::vec3& c = color(x, y);
+            for(int k = 0; k < 3; k++) {
+                guide[NX + k][i] = nd[k];
+                guide[AR + k][i] = a[k];
+                colors[0][k][i] = c[k];
+            }
+            guide[DEPTH][i] = nd.w;
+        }
+    });
+
+    int src = 0;
+    for(int iteration = 0; iteration < params.numIterations; iteration++) {
+        const float sigmaColor = params.sigmaColor / float(1 << iteration);
+        ATrousPass pass;
+        pass.w = w;
+        pass.h = h;
+        pass.step = 1 << iteration;
+        pass.invSigmaColor2 = 1 / (sigmaColor * sigmaColor);
+        pass.invSigmaNormal2 = 1 / (params.sigmaNormal * params.sigmaNormal);
+        pass.invSigmaDepth2 = 1 / (params.sigmaDepth * params.sigmaDepth);
+        pass.invSigmaAlbedo2 = 1 / (params.sigmaAlbedo * params.sigmaAlbedo);
+        for(int k = 0; k < NUM_GUIDE_PLANES; k++)
+            pass.guide[k] = guide[k];
+        for(int k = 0; k < 3; k++) {
+            pass.src[k] = colors[src][k];
+            pass.dst[k] = colors[1 - src][k];
+        }
+        tl::parallelFor(0, h, [&pass](int yBegin, int yEnd) {
+            filterRows(pass, yBegin, yEnd);
+        });
+        src = 1 - src;
+    }
+
+    tl::parallelFor(0, h, [&](int yBegin, int yEnd) {
+        for(int y = yBegin; y < yEnd; y++)
+        for(int x = 0; x < w; x++) {
+            const size_t i = x + size_t(y) * w;
+            dst(x, y) = glm::vec3(colors[src][0][i], colors[src][1][i], colors[src][2][i]);
+        }
+    });
+}
+
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+#include "img.hpp"
+
+namespace tg
+{
+
+struct ATrousParams {
+    int numIterations = 5; // the footprint of the filter doubles in each iteration: 5x5, 9x9, 17x17...
+    // the edge stopping weights are exp(-dist^2 / sigma^2)
+    float sigmaColor = 1.f; // halved in each iteration, so the finer details survive
+    float sigmaNormal = 0.3f;
+    float sigmaDepth = 0.05f; // relative to the depth of the center pixel
+    float sigmaAlbedo = 0.1f;
+};
+
+// Edge-avoiding à-trous wavelet filter [Dammertz et al. 2010], guided by the first hit of the path
+// normalDepth: world normal in xyz and distance to the camera in w (0 if the ray escaped)
+// The rows are split between threads, and each thread filters 4 consecutive pixels at a time with SSE
+void denoiseATrous(ImgView3f dst, const ImgView3f& color, const ImgView4f& normalDepth, const ImgView3f& albedo,
+    const ATrousParams& params = {});
+
+}
@@ -0,0 +1,133 @@
+#include "env_sampling.hpp"
+
+#include <math.h>
+#include <tl/basic.hpp>
+#include <tl/jobs.hpp>
+
+namespace tg
+{
+
+static constexpr float k_pi = 3.14159265359f;
+
+static float luminance(const glm::vec3& c)
+{
+    const float lum = 0.2126f * c.r + 0.7152f * c.g + 0.0722f * c.b;
+    return lum > 0 ? lum : 0; // also discards NaNs
+}
+
+// Vose's method. weights: n values >= 0 that add up to sum. q, small, large: scratch of n elements
+// Only prob and alias are written
+static void buildAliasTable(EnvAliasEntry* entries, const float* weights, int n, double sum,
+    double* q, u32* small, u32* large)
+{
+    int numSmall = 0, numLarge = 0;
+    if(sum > 0) {
+        const double scale = n / sum;
+        for(int i = 0; i < n; i++) {
+            q[i] = weights[i] * scale;
+            if(q[i] < 1)
+                small[numSmall++] = u32(i);
+            else
+                large[numLarge++] = u32(i);
+        }
+        // each small bucket is filled up to 1 with a piece of a large one
+        while(numSmall && numLarge) {
+            const u32 s = small[--numSmall];
+            const u32 l = large[numLarge - 1];
+            entries[s].prob = float(q[s]);
+            entries[s].alias = l;
+            q[l] = (q[l] + q[s]) - 1;
+            if(q[l] < 1) {
+                numLarge--;
+                small[numSmall++] = l;
+            }
+        }
+    }
+    else {
+        // nothing to sample, make the table uniform so it's still valid
+        for(int i = 0; i < n; i++)
+            large[numLarge++] = u32(i);
+    }
+    // what is left is 1 up to rounding errors
+    for(int i = 0; i < numSmall; i++)
+        entries[small[i]] = {1, small[i], 0};
+    for(int i = 0; i < numLarge; i++)
+        entries[large[i]] = {1, large[i], 0};
+}
+
+void buildEnvAliasTable(tl::Vector<EnvAliasEntry>& table, const ImgView3f& equirect)
+{
+    const int w = equirect.width();
+    const int h = equirect.height();
+    table.resize(0);
+    table.resize(size_t(h) + size_t(w) * h);
+    EnvAliasEntry* rows = table.data();
+    EnvAliasEntry* pixels = rows + h;
+
+    // the conditional tables of the rows are independent
+    tl::Vector<float> rowWeights((size_t)h);
+    tl::parallelFor(0, h, [&](int yBegin, int yEnd) {
+        tl::Vector<float> lums((size_t)w);
+        tl::Vector<double> q((size_t)w);
+        tl::Vector<u32> small((size_t)w), large((size_t)w);
+        for(int y = yBegin; y < yEnd; y++) {
+            double sum = 0;
+            for(int x = 0; x < w; x++) {
+                lums[x] = luminance(equirect(x, y));
+                sum += lums[x];
+            }
+            EnvAliasEntry* rowPixels = pixels + size_t(y) * w;
+            buildAliasTable(rowPixels, lums.data(), w, sum, q.data(), small.data(), large.data());
+            // pdf in u of the pixel given the row, it's multiplied by the pdf of the row below
+            for(int x = 0; x < w; x++)
+                rowPixels[x].pdf = sum > 0 ? float(lums[x] * w / sum) : 0;
+            // all the pixels of a row cover the same solid angle
+            rowWeights[y] = float(sum * sinf(k_pi * (y + 0.5f) / h));
+        }
+    });
+
+    double total = 0;
+    for(float rowWeight : rowWeights)
+        total += rowWeight;
+    {
+        tl::Vector<double> q((size_t)h);
+        tl::Vector<u32> small((size_t)h), large((size_t)h);
+        buildAliasTable(rows, rowWeights.data(), h, total, q.data(), small.data(), large.data());
+    }
+    for(int y = 0; y < h; y++)
+        rows[y].pdf = total > 0 ? float(rowWeights[y] * h / total) : 0;
+
+    tl::parallelFor(0, h, [&](int yBegin, int yEnd) {
+        for(int y = yBegin; y < yEnd; y++)
+        for(int x = 0; x < w; x++)
+            pixels[size_t(y) * w + x].pdf *= rows[y].pdf;
+    });
+}
+
+// chooses a bucket of the table, and rescales the fraction of rnd left to [0, 1), so it can be reused
+static int sampleAliasTable(const EnvAliasEntry* entries, int n, float& rnd)
+{
+    const float r = rnd * n;
+    int i = tl::min(int(r), n - 1);
+    rnd = r - i;
+    const EnvAliasEntry& e = entries[i];
+    if(rnd < e.prob) {
+        rnd /= e.prob;
+    }
+    else {
+        i = int(e.alias);
+        rnd = (rnd - e.prob) / (1 - e.prob);
+    }
+    return i;
+}
+
+glm::vec2 sampleEnvAliasTable(const EnvAliasEntry* table, int w, int h, glm::vec2 rnd, float& pdf)
+{
+    const int y = sampleAliasTable(table, h, rnd.y);
+    const int x = sampleAliasTable(table + h + size_t(y) * w, w, rnd.x);
+    pdf = table[h + size_t(y) * w + x].pdf;
+    // the fractions left place the sample inside the pixel
+    return glm::vec2((x + rnd.x) / w, (y + rnd.y) / h);
+}
+
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <glm/vec2.hpp>
+#include <tl/int_types.hpp>
+#include <tl/containers/vector.hpp>
+#include "img.hpp"
+
+namespace tg
+{
+
+// Entry of an alias table (Vose): a bucket is chosen uniformly, and then it's kept with probability prob, otherwise
+// it's replaced by alias. The layout matches the std430 struct EnvAliasEntry of main_frag.glsl
+struct EnvAliasEntry {
+    float prob;
+    u32 alias;
+    float pdf; // of the bucket, with respect to the area of the uv square [0, 1]^2
+};
+
+// Builds the 2D alias table to importance sample the directions of an equirectangular environment map (see cubemap.hpp)
+// in proportion to the luminance of the pixels times the solid angle they cover
+// table: h entries to choose the row, followed by a table of w entries for each row to choose the pixel
+// Choosing a pixel costs two lookups, whatever the resolution. The rows are built in parallel
+// The pdf of a direction, with respect to the solid angle, is the pdf of its pixel / (2 * PI^2 * sin(theta))
+void buildEnvAliasTable(tl::Vector<EnvAliasEntry>& table, const ImgView3f& equirect);
+
+// CPU version of sampleEnv() in main_frag.glsl. Returns the sampled uv, and the pdf of its pixel
+glm::vec2 sampleEnvAliasTable(const EnvAliasEntry* table, int w, int h, glm::vec2 rnd, float& pdf);
+
+}
@@ -3,7 +3,13 @@
 #include <stb/stbi.h>
 #include <stb/stb_image_write.h>
 #include <math.h>
+#include <string.h>
 #include <glm/glm.hpp>
+#include <tl/basic.hpp>
+#include <tl/jobs.hpp>
+#include "png.hpp"
+#include "simd_math.hpp"
+#include "tiled_img_writer.hpp"
 
 using glm::vec3;
 using glm::vec4;
@@ -40,8 +46,66 @@ template Img<4, float> Img<4, float>::load(const char*);
 template Img<3, u8> Img<3, u8>::load(const char*);
 template Img<4, u8> Img<4, u8>::load(const char*);
 
+static u8 linearToGammaU8(float x, bool isAlpha, ETonemap tonemap, float invGamma)
+{
+    x = tl::max(x, 0.f);
+    if(!isAlpha) {
+        if(tonemap == ETonemap::REINHARD)
+            x = x / (x + 1);
+        x = powf(x, invGamma);
+    }
+    return (u8)(255 * tl::min(x, 1.f) + 0.5f);
+}
+
 template <int NC>
-static int saveImgFloatN(const char* fileName, const void* data, int w, int h, int stride, int quality)
+static void linearToGammaU8Row(u8* dst, const float* src, int n, ETonemap tonemap, float invGamma)
+{
+    int i = 0;
+#if TG_SSE
+    // with 4 channels each register is a pixel, and the alpha lane keeps the linear value
+    const __m128 alphaMask = NC == 4 ? _mm_castsi128_ps(_mm_setr_epi32(0, 0, 0, -1)) : _mm_setzero_ps();
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 one = _mm_set1_ps(1.f);
+    const __m128 invGammaV = _mm_set1_ps(invGamma);
+    for(; i + 4 <= n; i += 4) {
+        const __m128 x = _mm_max_ps(_mm_loadu_ps(src + i), zero);
+        __m128 c = x;
+        if(tonemap == ETonemap::REINHARD)
+            c = _mm_div_ps(c, _mm_add_ps(c, one));
+        c = powSse(c, invGammaV);
+        c = _mm_or_ps(_mm_and_ps(alphaMask, x), _mm_andnot_ps(alphaMask, c));
+        c = _mm_add_ps(_mm_mul_ps(_mm_min_ps(c, one), _mm_set1_ps(255.f)), _mm_set1_ps(0.5f));
+        __m128i v = _mm_cvttps_epi32(c);
+        v = _mm_packs_epi32(v, v);
+        v = _mm_packus_epi16(v, v);
+        const int packed = _mm_cvtsi128_si32(v);
+        memcpy(dst + i, &packed, 4);
+    }
+#endif
+    for(; i < n; i++)
+        dst[i] = linearToGammaU8(src[i], NC == 4 && i % 4 == 3, tonemap, invGamma);
+}
+
+template <int NC>
+void linearToGammaU8(ImgView<NC, u8> dst, const ImgView<NC, float>& src, ETonemap tonemap, float gamma)
+{
+    assert(dst.width() == src.width() && dst.height() == src.height());
+    const int w = src.width();
+    const float invGamma = 1.f / gamma;
+    tl::parallelFor(0, src.height(), [&](int yBegin, int yEnd) {
+        for(int y = yBegin; y < yEnd; y++) {
+            auto dstRow = (u8*)&dst(0, y);
+            auto srcRow = (const float*)&src(0, y);
+            linearToGammaU8Row<NC>(dstRow, srcRow, w * NC, tonemap, invGamma);
+        }
+    });
+}
+template void linearToGammaU8<3>(ImgView<3, u8>, const ImgView<3, float>&, ETonemap, float);
+template void linearToGammaU8<4>(ImgView<4, u8>, const ImgView<4, float>&, ETonemap, float);
+
+template <int NC>
+static int saveImgFloatN(const char* fileName, const ImgView<NC, float>& img, int quality, ETonemap tonemap,
+    const PngSaveOptions& png)
 {
     const char* ext = nullptr;
     for(const char* c = fileName; *c; c++)
@@ -50,16 +114,34 @@ static int saveImgFloatN(const char* fileName, const void* data, int w, int h, i
     if(!ext)
         return false;
     ext++;
-    auto dataF = (const float*)data;
+    const int w = img.width();
+    const int h = img.height();
+    if(strcmp(ext, "pfm") == 0 || strcmp(ext, "exr") == 0) {
+        // full float precision, without tonemapping. The tiles are compressed in parallel
+        TiledImgWriter writer;
+        if(!writer.open(fileName, w, h, NC))
+            return false;
+        const int tileSize = writer.tileSize();
+        tl::parallelFor(0, writer.numTilesY(), [&](int tyBegin, int tyEnd) {
+            for(int ty = tyBegin; ty < tyEnd; ty++)
+            for(int tx = 0; tx < writer.numTilesX(); tx++)
+                writer.writeTile(tx, ty, (const float*)&img(tx * tileSize, ty * tileSize), img.stride() * NC);
+        });
+        return writer.close();
+    }
     u8* dataU8 = nullptr;
     if(ext[0] == 'b' || ext[0] == 'p' || ext[0] == 'j' || ext[0] == 't') {
         dataU8 = new u8[w*h*NC];
-        const float invGamma = 1.f / 2.2f;
-        int i = 0;
+        linearToGammaU8<NC>(ImgView<NC, u8>(w, h, (glm::vec<NC, u8>*)dataU8), img, tonemap);
+    }
+    // the 8 bit data is packed, the float data only if the stride matches the width
+    const float* dataF = (const float*)img.data();
+    float* packedF = nullptr;
+    if(ext[0] == 'h' && img.stride() != w) {
+        packedF = new float[w*h*NC];
         for(int y = 0; y < h; y++)
-        for(int x = 0; x < w; x++)
-        for(int c = 0; c < NC; c++, i++)
-            dataU8[i] = (u8)(255 * pow(dataF[i], invGamma));
+            memcpy(packedF + y*w*NC, &img(0, y), w*NC*sizeof(float));
+        dataF = packedF;
     }
     int okay = 0;
     switch (ext[0])
@@ -68,7 +150,10 @@ static int saveImgFloatN(const char* fileName, const void* data, int w, int h, i
             okay = stbi_write_bmp(fileName, w, h, NC, dataU8);
             break;
         case 'p':
-            okay = stbi_write_png(fileName, w, h, NC, dataU8, stride*sizeof(u8)*NC);
+            if(png.parallel)
+                okay = writePng(fileName, w, h, NC, dataU8, w*sizeof(u8)*NC, png.compressionLevel);
+            else
+                okay = stbi_write_png(fileName, w, h, NC, dataU8, w*sizeof(u8)*NC);
             break;
         case 'j':
             okay = stbi_write_jpg(fileName, w, h, NC, dataU8, quality);
@@ -81,13 +166,14 @@ static int saveImgFloatN(const char* fileName, const void* data, int w, int h, i
             break;
     }
     delete[] dataU8;
+    delete[] packedF;
     return okay;
 }
 
 template <>
-bool Img<3, float>::save(const char* fileName, int quality)
+bool Img<3, float>::save(const char* fileName, int quality, ETonemap tonemap, const PngSaveOptions& png)
 {
-    return saveImgFloatN<3>(fileName, _data, _w, _h, _stride, quality);
+    return saveImgFloatN<3>(fileName, *this, quality, tonemap, png);
 }
 
 }
@@ -40,6 +40,16 @@ protected:
     VecT* _data;
 };
 
+enum class ETonemap {
+    NONE, // values above 1 are clamped
+    REINHARD, // c / (c + 1), same as postpro.glsl
+};
+
+struct PngSaveOptions {
+    bool parallel = true; // compress strips of rows in parallel with tg::writePng, instead of stbi_write_png
+    int compressionLevel = 6; // [0, 9] like zlib, only used by the parallel encoder
+};
+
 template <int NC, typename T>
 class Img : public ImgView<NC, T>
 {
@@ -47,13 +57,16 @@ public:
     using VecT = glm::vec<NC, T, glm::defaultp>;
     using ImgViewT = ImgView<NC, T>;
     Img() : ImgViewT() {}
-    Img(int w, int h) : ImgViewT(w, h, (T*)malloc(sizeof(T)*w*h)) {}
+    Img(int w, int h) : ImgViewT(w, h, (VecT*)malloc(sizeof(VecT)*w*h)) {}
     Img(Img&& o);
     Img& operator=(Img&& o);
     ~Img() { free(ImgViewT::_data); }
 
     static Img load(const char* fileName);
-    bool save(const char* fileName, int quality = 90); // quality is only used for jpeg and should be in range [1, 100]
+    // quality is only used for jpeg and should be in range [1, 100]
+    // float images are gamma corrected when saved to 8 bit formats, the tonemap is applied before
+    // .pfm and .exr keep the float values as they are, see TiledImgWriter
+    bool save(const char* fileName, int quality = 90, ETonemap tonemap = ETonemap::NONE, const PngSaveOptions& png = {});
 };
 
 enum class ECubeImgFace { LEFT, RIGHT, DOWN, UP, FRONT, BACK };
@@ -74,6 +87,20 @@ struct CubeImgView
     ImgViewConstT operator[](ECubeImgFace eFace)const;
 };
 
+// cube map that owns its pixels: the faces are stored one after the other, in the order of ECubeImgFace
+template <int NC, typename T>
+class CubeImg : public CubeImgView<NC, T>
+{
+public:
+    using VecT = glm::vec<NC, T, glm::defaultp>;
+    using CubeImgViewT = CubeImgView<NC, T>;
+    CubeImg();
+    explicit CubeImg(int sidePixels);
+    CubeImg(CubeImg&& o);
+    CubeImg& operator=(CubeImg&& o);
+    ~CubeImg() { free(CubeImgViewT::left.data); }
+};
+
 template <int NC, typename T>
 using CImg = ImgView<NC, const T>;
 template <int NC, typename T>
@@ -89,9 +116,11 @@ typedef ImgView<4, float> ImgView4f;
 typedef ImgView<3, uint8_t> ImgView3u8;
 typedef ImgView<4, uint8_t> ImgView4u8;
 typedef CubeImgView<3, float> CubeImgView3f;
-typedef CubeImgView<3, float> CubeImgView4f;
+typedef CubeImgView<4, float> CubeImgView4f;
 typedef CubeImgView<3, uint8_t> CubeImgView3u8;
 typedef CubeImgView<4, uint8_t> CubeImgView4u8;
+typedef CubeImg<3, float> CubeImg3f;
+typedef CubeImg<4, float> CubeImg4f;
 
 typedef CImg<3, float> CImg3f;
 typedef CImg<4, float> CImg4f;
@@ -102,6 +131,12 @@ typedef CCubeImg<4, float> CCubeImg4f;
 typedef CCubeImg<3, uint8_t> CCubeImg3u8;
 typedef CCubeImg<4, uint8_t> CCubeImg4u8;
 
+// converts linear float colors to gamma corrected 8 bit, optionally tonemapped. The alpha channel stays linear
+// the rows are converted in parallel, with SSE
+template <int NC>
+void linearToGammaU8(ImgView<NC, uint8_t> dst, const ImgView<NC, float>& src,
+    ETonemap tonemap = ETonemap::NONE, float gamma = 2.2f);
+
 // --- impl -------------------------------------------------------------------------------------------------------
 
 template <int NC, typename T>
@@ -154,6 +189,39 @@ ImgView<NC, const T> CubeImgView<NC, T>::operator[](ECubeImgFace eFace)const {
     return ImgView<NC, const T>(sidePixels, sidePixels, face.stride, face.data);
 }
 
+template <int NC, typename T>
+CubeImg<NC, T>::CubeImg()
+{
+    CubeImgViewT::sidePixels = 0;
+    for(int i = 0; i < 6; i++)
+        (&this->left)[i] = {nullptr, 0};
+}
+
+template <int NC, typename T>
+CubeImg<NC, T>::CubeImg(int sidePixels)
+{
+    const size_t facePixels = size_t(sidePixels) * sidePixels;
+    VecT* data = (VecT*)malloc(6 * facePixels * sizeof(VecT));
+    CubeImgViewT::sidePixels = sidePixels;
+    for(int i = 0; i < 6; i++)
+        (&this->left)[i] = {data + i * facePixels, sidePixels};
+}
+
+template <int NC, typename T>
+CubeImg<NC, T>::CubeImg(CubeImg&& o)
+    : CubeImgViewT(o)
+{
+    o.CubeImgViewT::operator=(CubeImg());
+}
+
+template <int NC, typename T>
+CubeImg<NC, T>& CubeImg<NC, T>::operator=(CubeImg&& o)
+{
+    free(CubeImgViewT::left.data);
+    CubeImgViewT::operator=(o);
+    o.CubeImgViewT::operator=(CubeImg()); // the pixels belong to this now
+    return *this;
+}
 
 template <int NC, typename T>
 Img<NC, T>::Img(Img&& o)
@@ -0,0 +1,134 @@
+#include "mapped_img.hpp"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#ifdef _WIN32
+    #define WIN32_LEAN_AND_MEAN
+    #define NOMINMAX
+    #include <windows.h>
+#else
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
+
+namespace tg
+{
+
+// copy on write mapping of the whole file. Returns nullptr on failure
+static void* mapFile(const char* fileName, size_t& size)
+{
+#ifdef _WIN32
+    HANDLE file = CreateFileA(fileName, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if(file == INVALID_HANDLE_VALUE)
+        return nullptr;
+    LARGE_INTEGER fileSize;
+    void* data = nullptr;
+    if(GetFileSizeEx(file, &fileSize) && fileSize.QuadPart > 0) {
+        // the view keeps the mapping alive after closing the handles
+        HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_WRITECOPY, 0, 0, nullptr);
+        if(mapping) {
+            data = MapViewOfFile(mapping, FILE_MAP_COPY, 0, 0, 0);
+            CloseHandle(mapping);
+        }
+        size = size_t(fileSize.QuadPart);
+    }
+    CloseHandle(file);
+    return data;
+#else
+    const int fd = open(fileName, O_RDONLY);
+    if(fd < 0)
+        return nullptr;
+    struct stat st;
+    void* data = nullptr;
+    if(fstat(fd, &st) == 0 && st.st_size > 0) {
+        // the mapping keeps the file alive after closing the descriptor
+        data = mmap(nullptr, size_t(st.st_size), PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+        if(data == MAP_FAILED)
+            data = nullptr;
+        size = size_t(st.st_size);
+    }
+    close(fd);
+    return data;
+#endif
+}
+
+static void unmapFile(void* data, size_t size)
+{
+#ifdef _WIN32
+    (void)size;
+    UnmapViewOfFile(data);
+#else
+    munmap(data, size);
+#endif
+}
+
+// PFM header: "PF" (RGB) or "Pf" (gray), width, height and scale, separated by whitespace
+// A single whitespace character separates the header from the pixels
+static bool parsePfmHeader(const char* data, size_t size, int& numChannels, int& w, int& h, float& scale, size_t& dataOffset)
+{
+    if(size < 3 || data[0] != 'P' || (data[1] != 'F' && data[1] != 'f'))
+        return false;
+    numChannels = data[1] == 'F' ? 3 : 1;
+    // the header is short, copy it to a null terminated string so it can be parsed safely
+    char header[128];
+    const size_t headerSize = size < sizeof(header) - 1 ? size : sizeof(header) - 1;
+    memcpy(header, data, headerSize);
+    header[headerSize] = 0;
+    int n = 0;
+    if(sscanf(header + 2, "%d %d %f%n", &w, &h, &scale, &n) != 3 || w <= 0 || h <= 0)
+        return false;
+    const size_t end = 2 + n;
+    if(end >= headerSize || !isspace((unsigned char)header[end]))
+        return false;
+    dataOffset = end + 1;
+    return true;
+}
+
+template <int NC>
+MappedImg<NC> MappedImg<NC>::map(const char* fileName)
+{
+    MappedImg img;
+    size_t size = 0;
+    void* mapping = mapFile(fileName, size);
+    if(!mapping)
+        return img;
+    int numChannels, w, h;
+    float scale;
+    size_t dataOffset;
+    const bool ok = parsePfmHeader((const char*)mapping, size, numChannels, w, h, scale, dataOffset) &&
+        numChannels == NC && scale < 0 && // big endian files would need a conversion
+        size >= dataOffset + size_t(w) * h * sizeof(glm::vec<NC, float>);
+    if(!ok) {
+        unmapFile(mapping, size);
+        return img;
+    }
+    img._mapping = mapping;
+    img._mappingSize = size;
+    // the first row of the file is the bottom one
+    auto rows = (glm::vec<NC, float>*)((char*)mapping + dataOffset);
+    img._w = w;
+    img._h = h;
+    img._stride = -w;
+    img._data = rows + size_t(h - 1) * w;
+    return img;
+}
+
+template <int NC>
+void MappedImg<NC>::unmap()
+{
+    if(_mapping)
+        unmapFile(_mapping, _mappingSize);
+    _mapping = nullptr;
+    _mappingSize = 0;
+    ImgViewT::_w = ImgViewT::_h = ImgViewT::_stride = 0;
+    ImgViewT::_data = nullptr;
+}
+
+template class MappedImg<1>;
+template class MappedImg<3>;
+
+}
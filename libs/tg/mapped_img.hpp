@@ -0,0 +1,59 @@
+#pragma once
+
+#include <glm/ext/vector_float1.hpp>
+#include "img.hpp"
+
+namespace tg
+{
+
+// Image whose pixels are a memory mapping of an uncompressed float file, so opening is instant whatever the size,
+// and the OS pages the pixels in lazily as they are accessed
+// The mapping is copy on write: the pixels can be modified, but the changes never reach the file
+// Supported format: little endian PFM (negative scale), with 1 or 3 channels. Big endian files can't be viewed in place
+// PFM stores the rows bottom-up, so the view has a negative stride and row 0 is the top one, like in Img::load
+template <int NC>
+class MappedImg : public ImgView<NC, float>
+{
+public:
+    using ImgViewT = ImgView<NC, float>;
+    MappedImg() : ImgViewT() {}
+    MappedImg(MappedImg&& o);
+    MappedImg& operator=(MappedImg&& o);
+    ~MappedImg() { unmap(); }
+
+    // returns an empty image (null data) if the file can't be mapped, or its number of channels is not NC
+    static MappedImg map(const char* fileName);
+
+private:
+    void unmap();
+
+    void* _mapping = nullptr;
+    size_t _mappingSize = 0;
+};
+
+typedef MappedImg<1> MappedImg1f;
+typedef MappedImg<3> MappedImg3f;
+
+template <int NC>
+MappedImg<NC>::MappedImg(MappedImg&& o)
+    : ImgViewT(o)
+    , _mapping(o._mapping)
+    , _mappingSize(o._mappingSize)
+{
+    o._data = nullptr;
+    o._mapping = nullptr;
+}
+
+template <int NC>
+MappedImg<NC>& MappedImg<NC>::operator=(MappedImg&& o)
+{
+    unmap();
+    ImgViewT::operator=(o);
+    _mapping = o._mapping;
+    _mappingSize = o._mappingSize;
+    o._data = nullptr;
+    o._mapping = nullptr;
+    return *this;
+}
+
+}
@@ -0,0 +1,173 @@
+#include "png.hpp"
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <tl/basic.hpp>
+#include <tl/int_types.hpp>
+#include <tl/containers/vector.hpp>
+#include <tl/jobs.hpp>
+#include "deflate.hpp"
+
+namespace tg
+{
+
+static constexpr size_t k_minStripBytes = 256 << 10; // smaller strips lose too much compression to the window restart
+
+static u8 paeth(int a, int b, int c)
+{
+    const int p = a + b - c;
+    const int pa = abs(p - a), pb = abs(p - b), pc = abs(p - c);
+    if(pa <= pb && pa <= pc)
+        return u8(a);
+    return u8(pb <= pc ? b : c);
+}
+
+// PNG filter of one row: the filter type byte followed by the filtered bytes
+// prevRow is all zeros for the first row of the image
+static void filterRow(u8* dst, const u8* row, const u8* prevRow, int rowBytes, int bpp, int filter)
+{
+    dst[0] = u8(filter);
+    dst++;
+    for(int i = 0; i < rowBytes; i++) {
+        const int a = i >= bpp ? row[i - bpp] : 0;
+        const int b = prevRow[i];
+        const int c = i >= bpp ? prevRow[i - bpp] : 0;
+        int pred = 0;
+        switch(filter) {
+            case 1: pred = a; break;
+            case 2: pred = b; break;
+            case 3: pred = (a + b) >> 1; break;
+            case 4: pred = paeth(a, b, c); break;
+            default: break;
+        }
+        dst[i] = u8(row[i] - pred);
+    }
+}
+
+// the same heuristic as libpng and stb: the filter with the minimum sum of absolute values, as signed bytes
+static void filterRowAdaptive(u8* dst, u8* scratch, const u8* row, const u8* prevRow, int rowBytes, int bpp)
+{
+    u64 bestSum = ~u64(0);
+    for(int filter = 0; filter < 5; filter++) {
+        filterRow(scratch, row, prevRow, rowBytes, bpp, filter);
+        u64 sum = 0;
+        for(int i = 1; i <= rowBytes; i++)
+            sum += abs(int(i8(scratch[i])));
+        if(sum < bestSum) {
+            bestSum = sum;
+            memcpy(dst, scratch, rowBytes + 1);
+        }
+    }
+}
+
+static void putU32BE(u8* p, u32 x)
+{
+    p[0] = u8(x >> 24);
+    p[1] = u8(x >> 16);
+    p[2] = u8(x >> 8);
+    p[3] = u8(x);
+}
+
+// the crc covers the chunk type and the data
+static bool writeChunk(FILE* f, const char* type, const u8* data, u32 size, u32 crc)
+{
+    u8 header[8];
+    putU32BE(header, size);
+    memcpy(header + 4, type, 4);
+    u8 footer[4];
+    putU32BE(footer, crc);
+    // data is null for the empty chunks, like IEND
+    return fwrite(header, 1, 8, f) == 8 && (size == 0 || fwrite(data, 1, size, f) == size) &&
+        fwrite(footer, 1, 4, f) == 4;
+}
+static bool writeChunk(FILE* f, const char* type, const u8* data, u32 size)
+{
+    u32 crc = crc32((const u8*)type, 4);
+    if(size)
+        crc = crc32(data, size, crc);
+    return writeChunk(f, type, data, size, crc);
+}
+
+struct Strip {
+    tl::Vector<u8> compressed;
+    size_t rawSize;
+    u32 adler;
+    u32 crc; // of the IDAT chunk
+};
+
+bool writePng(const char* fileName, int w, int h, int numChannels, const uint8_t* data, int strideInBytes,
+    int compressionLevel)
+{
+    assert(numChannels >= 1 && numChannels <= 4);
+    if(w <= 0 || h <= 0)
+        return false;
+    const int level = tl::clamp(compressionLevel, 0, 9);
+    const int rowBytes = w * numChannels;
+    const size_t filteredRowBytes = size_t(rowBytes) + 1;
+    // the strips don't depend on the number of threads, so the output is deterministic
+    const int rowsPerStrip = (int)tl::max(size_t(1), k_minStripBytes / filteredRowBytes);
+    const int numStrips = (h + rowsPerStrip - 1) / rowsPerStrip;
+    Strip* strips = new Strip[numStrips];
+    defer(delete[] strips);
+
+    tl::parallelFor(0, numStrips, [&](int stripBegin, int stripEnd) {
+        tl::Vector<u8> filtered(rowsPerStrip * filteredRowBytes);
+        tl::Vector<u8> scratch(filteredRowBytes);
+        const tl::Vector<u8> zeros(size_t(rowBytes), 0);
+        for(int s = stripBegin; s < stripEnd; s++) {
+            const int yBegin = s * rowsPerStrip;
+            const int yEnd = tl::min(h, yBegin + rowsPerStrip);
+            for(int y = yBegin; y < yEnd; y++) {
+                u8* dst = filtered.data() + (y - yBegin) * filteredRowBytes;
+                const u8* row = data + size_t(y) * strideInBytes;
+                const u8* prevRow = y ? row - strideInBytes : zeros.data();
+                if(level == 0)
+                    filterRow(dst, row, prevRow, rowBytes, numChannels, 0);
+                else
+                    filterRowAdaptive(dst, scratch.data(), row, prevRow, rowBytes, numChannels);
+            }
+            Strip& strip = strips[s];
+            strip.rawSize = (yEnd - yBegin) * filteredRowBytes;
+            strip.adler = adler32(filtered.data(), strip.rawSize);
+            strip.compressed.reserve(strip.rawSize / 2);
+            deflate(strip.compressed, filtered.data(), strip.rawSize, level, s + 1 == numStrips);
+            strip.crc = crc32(strip.compressed.data(), strip.compressed.size(), crc32((const u8*)"IDAT", 4));
+        }
+    });
+
+    FILE* f = fopen(fileName, "wb");
+    if(!f)
+        return false;
+    static const u8 signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+    static const u8 colorTypes[5] = {0, 0, 4, 2, 6}; // by number of channels
+    u8 ihdr[13];
+    putU32BE(ihdr, w);
+    putU32BE(ihdr + 4, h);
+    ihdr[8] = 8; // bit depth
+    ihdr[9] = colorTypes[numChannels];
+    ihdr[10] = 0; // deflate
+    ihdr[11] = 0; // adaptive filters
+    ihdr[12] = 0; // no interlace
+    bool ok = fwrite(signature, 1, 8, f) == 8;
+    ok = ok && writeChunk(f, "IHDR", ihdr, 13);
+
+    u8 header[2];
+    zlibHeader(header, level);
+    ok = ok && writeChunk(f, "IDAT", header, 2);
+    u32 adler = 1;
+    for(int s = 0; s < numStrips; s++) {
+        const Strip& strip = strips[s];
+        ok = ok && writeChunk(f, "IDAT", strip.compressed.data(), strip.compressed.size(), strip.crc);
+        adler = adler32Combine(adler, strip.adler, strip.rawSize);
+    }
+    u8 zlibFooter[4];
+    putU32BE(zlibFooter, adler);
+    ok = ok && writeChunk(f, "IDAT", zlibFooter, 4);
+    ok = ok && writeChunk(f, "IEND", nullptr, 0);
+    ok = (fclose(f) == 0) && ok;
+    return ok;
+}
+
+}
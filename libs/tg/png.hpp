@@ -0,0 +1,17 @@
+#pragma once
+
+#include <stdint.h>
+
+namespace tg
+{
+
+// PNG writer for large images. The rows are split in horizontal strips that are filtered and deflated in parallel
+// Each strip ends with a sync flush (empty stored block), so the compressed strips are byte aligned and are written
+// one after the other, each in its own IDAT chunk. The adler32 of the zlib stream is combined from the ones of the strips
+// The LZ77 window restarts at every strip, which costs a tiny bit of compression ratio
+// compressionLevel: [0, 9] like zlib. 0 stores the rows without compression
+// numChannels: 1 (gray), 2 (gray + alpha), 3 (RGB) or 4 (RGBA)
+bool writePng(const char* fileName, int w, int h, int numChannels, const uint8_t* data, int strideInBytes,
+    int compressionLevel = 6);
+
+}
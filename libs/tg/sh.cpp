@@ -0,0 +1,168 @@
+#include "sh.hpp"
+
+#include <math.h>
+#include <glm/geometric.hpp>
+#include <tl/basic.hpp>
+#include <tl/containers/vector.hpp>
+#include <tl/jobs.hpp>
+#include "cubemap.hpp"
+#include "simd_math.hpp"
+
+using glm::vec3;
+
+namespace tg
+{
+
+static constexpr float k_pi = 3.14159265359f;
+static const float k_shConsts[5] = {0.282095f, 0.488603f, 1.092548f, 0.315392f, 0.546274f};
+
+static void evalBasis(float (&basis)[9], float x, float y, float z)
+{
+    basis[0] = k_shConsts[0];
+    basis[1] = k_shConsts[1] * y;
+    basis[2] = k_shConsts[1] * z;
+    basis[3] = k_shConsts[1] * x;
+    basis[4] = k_shConsts[2] * x * y;
+    basis[5] = k_shConsts[2] * y * z;
+    basis[6] = k_shConsts[3] * (3 * z * z - 1);
+    basis[7] = k_shConsts[2] * x * z;
+    basis[8] = k_shConsts[4] * (x * x - y * y);
+}
+
+// sums of one row of a face: the 9 RGB coefficients, and the solid angle
+static constexpr int k_rowSumSize = 9 * 3 + 1;
+
+// the directions of the texels of a face are origin + a * uAxis + b * vAxis, with a and b in [-1, 1]
+// the solid angle of a texel is texelArea / |dir|^3
+static void projectRow(double* rowSum, const vec3* row, int s, const vec3& origin, const vec3& uAxis, const vec3& vAxis,
+    float b)
+{
+    const float texelArea = 4.f / (float(s) * s);
+    const float da = 2.f / s;
+    const vec3 rowOrigin = origin + b * vAxis;
+    int x = 0;
+#if TG_SSE
+    __m128 acc[k_rowSumSize];
+    for(__m128& a : acc)
+        a = _mm_setzero_ps();
+    const __m128 one = _mm_set1_ps(1);
+    const __m128 b2 = _mm_set1_ps(1 + b * b);
+    for(; x < s; x += 4) {
+        const int n = tl::min(4, s - x);
+        alignas(16) float as[4], rs[4], gs[4], bs[4], valid[4];
+        for(int k = 0; k < 4; k++) {
+            const bool isValid = k < n;
+            const vec3 c = isValid ? row[x + k] : vec3(0);
+            as[k] = -1 + (x + k + 0.5f) * da;
+            rs[k] = c.r;
+            gs[k] = c.g;
+            bs[k] = c.b;
+            valid[k] = isValid ? texelArea : 0;
+        }
+        const __m128 a = _mm_load_ps(as);
+        const __m128 len2 = _mm_add_ps(b2, _mm_mul_ps(a, a));
+        const __m128 invLen = _mm_div_ps(one, _mm_sqrt_ps(len2));
+        const __m128 w = _mm_mul_ps(_mm_load_ps(valid), _mm_mul_ps(invLen, _mm_mul_ps(invLen, invLen)));
+        auto axis = [&](float o, float u) {
+            return _mm_mul_ps(_mm_add_ps(_mm_set1_ps(o), _mm_mul_ps(a, _mm_set1_ps(u))), invLen);
+        };
+        const __m128 dx = axis(rowOrigin.x, uAxis.x);
+        const __m128 dy = axis(rowOrigin.y, uAxis.y);
+        const __m128 dz = axis(rowOrigin.z, uAxis.z);
+        auto shConst = [](int i) { return _mm_set1_ps(k_shConsts[i]); };
+        const __m128 basis[9] = {
+            shConst(0),
+            _mm_mul_ps(shConst(1), dy),
+            _mm_mul_ps(shConst(1), dz),
+            _mm_mul_ps(shConst(1), dx),
+            _mm_mul_ps(shConst(2), _mm_mul_ps(dx, dy)),
+            _mm_mul_ps(shConst(2), _mm_mul_ps(dy, dz)),
+            _mm_mul_ps(shConst(3), _mm_sub_ps(_mm_mul_ps(_mm_set1_ps(3), _mm_mul_ps(dz, dz)), one)),
+            _mm_mul_ps(shConst(2), _mm_mul_ps(dx, dz)),
+            _mm_mul_ps(shConst(4), _mm_sub_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy))),
+        };
+        const __m128 wc[3] = {
+            _mm_mul_ps(w, _mm_load_ps(rs)),
+            _mm_mul_ps(w, _mm_load_ps(gs)),
+            _mm_mul_ps(w, _mm_load_ps(bs)),
+        };
+        for(int i = 0; i < 9; i++)
+        for(int c = 0; c < 3; c++)
+            acc[3 * i + c] = _mm_add_ps(acc[3 * i + c], _mm_mul_ps(basis[i], wc[c]));
+        acc[k_rowSumSize - 1] = _mm_add_ps(acc[k_rowSumSize - 1], w);
+    }
+    for(int i = 0; i < k_rowSumSize; i++) {
+        alignas(16) float lanes[4];
+        _mm_store_ps(lanes, acc[i]);
+        rowSum[i] = double(lanes[0]) + lanes[1] + lanes[2] + lanes[3];
+    }
+#else
+    for(int i = 0; i < k_rowSumSize; i++)
+        rowSum[i] = 0;
+    for(; x < s; x++) {
+        const float a = -1 + (x + 0.5f) * da;
+        const vec3 dir = rowOrigin + a * uAxis;
+        const float len2 = glm::dot(dir, dir);
+        const float w = texelArea / (len2 * sqrtf(len2));
+        const vec3 d = dir / sqrtf(len2);
+        float basis[9];
+        evalBasis(basis, d.x, d.y, d.z);
+        for(int i = 0; i < 9; i++)
+        for(int c = 0; c < 3; c++)
+            rowSum[3 * i + c] += basis[i] * w * row[x][c];
+        rowSum[k_rowSumSize - 1] += w;
+    }
+#endif
+}
+
+ShL2 projectSh(const CubeImgView3f& cube)
+{
+    const int s = cube.sidePixels;
+    const int numRows = 6 * s;
+    // the sums of each row are added at the end in order, so the result doesn't depend on the number of threads
+    tl::Vector<double> rowSums(size_t(numRows) * k_rowSumSize);
+    tl::parallelFor(0, numRows, [&](int rowBegin, int rowEnd) {
+        for(int r = rowBegin; r < rowEnd; r++) {
+            const int face = r / s, y = r % s;
+            const CubeImgView3f::Face& f = (&cube.left)[face];
+            const vec3 origin = cubeDir(ECubeImgFace(face), {0.5f, 0.5f});
+            const vec3 uAxis = cubeDir(ECubeImgFace(face), {1, 0.5f}) - origin;
+            const vec3 vAxis = cubeDir(ECubeImgFace(face), {0.5f, 1}) - origin;
+            const float b = -1 + (y + 0.5f) * 2.f / s;
+            projectRow(&rowSums[size_t(r) * k_rowSumSize], f.data + y * f.stride, s, origin, uAxis, vAxis, b);
+        }
+    });
+
+    double total[k_rowSumSize] = {};
+    for(int r = 0; r < numRows; r++)
+    for(int i = 0; i < k_rowSumSize; i++)
+        total[i] += rowSums[size_t(r) * k_rowSumSize + i];
+    // the solid angles of the texels are approximated at their centers, make them add up to the whole sphere
+    const double normalization = 4 * k_pi / total[k_rowSumSize - 1];
+    ShL2 sh;
+    for(int i = 0; i < 9; i++)
+    for(int c = 0; c < 3; c++)
+        sh.coefs[i][c] = float(total[3 * i + c] * normalization);
+    return sh;
+}
+
+ShL2 shIrradiance(const ShL2& radiance)
+{
+    const float bandFactors[3] = {k_pi, 2 * k_pi / 3, k_pi / 4};
+    ShL2 sh;
+    for(int i = 0; i < 9; i++)
+        sh.coefs[i] = radiance.coefs[i] * bandFactors[i == 0 ? 0 : i < 4 ? 1 : 2];
+    return sh;
+}
+
+vec3 evalSh(const ShL2& sh, const vec3& dir)
+{
+    float basis[9];
+    evalBasis(basis, dir.x, dir.y, dir.z);
+    vec3 result(0);
+    for(int i = 0; i < 9; i++)
+        result += basis[i] * sh.coefs[i];
+    return result;
+}
+
+}
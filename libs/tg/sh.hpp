@@ -0,0 +1,24 @@
+#pragma once
+
+#include <glm/vec3.hpp>
+#include "img.hpp"
+
+namespace tg
+{
+
+// Real spherical harmonics up to band 2 (9 coefficients) of an RGB function over the sphere
+// Order of the coefficients: Y00, Y1-1 (y), Y10 (z), Y11 (x), Y2-2 (xy), Y2-1 (yz), Y20 (3z^2 - 1), Y21 (xz), Y22 (x^2 - y^2)
+// The layout matches the vec3[9] uniform of sh_preview.glsl
+struct ShL2 {
+    glm::vec3 coefs[9];
+};
+
+// Projection of a cube map: integral of the radiance times each basis function, each texel weighted by its solid angle
+// The rows of all the faces are reduced in parallel, 4 texels at a time with SSE
+ShL2 projectSh(const CubeImgView3f& cube);
+// convolution with the clamped cosine lobe (Ramamoorthi and Hanrahan 2001, "An Efficient Representation for
+// Irradiance Environment Maps"): turns the projection of the radiance into the irradiance of each normal
+ShL2 shIrradiance(const ShL2& radiance);
+glm::vec3 evalSh(const ShL2& sh, const glm::vec3& dir); // dir must be normalized
+
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+// SSE approximations of transcendental functions, for the CPU image processing
+#if defined(__SSE2__) || defined(_M_X64)
+    #include <emmintrin.h>
+    #define TG_SSE 1
+#else
+    #define TG_SSE 0
+#endif
+
+namespace tg
+{
+
+#if TG_SSE
+// 2^x = 2^n * 2^f, with n = round(x) and f in [-0.5, 0.5]. Relative error ~1e-6
+inline __m128 exp2Sse(__m128 x)
+{
+    x = _mm_max_ps(x, _mm_set1_ps(-126.f));
+    x = _mm_min_ps(x, _mm_set1_ps(127.f));
+    const __m128i n = _mm_cvtps_epi32(x);
+    const __m128 f = _mm_sub_ps(x, _mm_cvtepi32_ps(n));
+    __m128 p = _mm_set1_ps(1.535336188e-4f);
+    p = _mm_add_ps(_mm_mul_ps(p, f), _mm_set1_ps(1.339887440e-3f));
+    p = _mm_add_ps(_mm_mul_ps(p, f), _mm_set1_ps(9.618437357e-3f));
+    p = _mm_add_ps(_mm_mul_ps(p, f), _mm_set1_ps(5.550332471e-2f));
+    p = _mm_add_ps(_mm_mul_ps(p, f), _mm_set1_ps(2.402264791e-1f));
+    p = _mm_add_ps(_mm_mul_ps(p, f), _mm_set1_ps(6.931472028e-1f));
+    p = _mm_add_ps(_mm_mul_ps(p, f), _mm_set1_ps(1.f));
+    const __m128 pow2n = _mm_castsi128_ps(_mm_slli_epi32(_mm_add_epi32(n, _mm_set1_epi32(127)), 23));
+    return _mm_mul_ps(p, pow2n);
+}
+
+inline __m128 expSse(__m128 x)
+{
+    return exp2Sse(_mm_mul_ps(x, _mm_set1_ps(1.44269504f)));
+}
+
+// x must be positive and normalized. Absolute error ~1e-5
+inline __m128 log2Sse(__m128 x)
+{
+    const __m128i bits = _mm_castps_si128(x);
+    const __m128 e = _mm_cvtepi32_ps(_mm_sub_epi32(_mm_srli_epi32(bits, 23), _mm_set1_epi32(127)));
+    // mantissa in [1, 2)
+    const __m128 m = _mm_or_ps(_mm_castsi128_ps(_mm_and_si128(bits, _mm_set1_epi32(0x007FFFFF))), _mm_set1_ps(1.f));
+    // log2(m) = (m - 1) * p(m)
+    __m128 p = _mm_set1_ps(-3.4436006e-2f);
+    p = _mm_add_ps(_mm_mul_ps(p, m), _mm_set1_ps(3.1821337e-1f));
+    p = _mm_add_ps(_mm_mul_ps(p, m), _mm_set1_ps(-1.2315303f));
+    p = _mm_add_ps(_mm_mul_ps(p, m), _mm_set1_ps(2.5988452f));
+    p = _mm_add_ps(_mm_mul_ps(p, m), _mm_set1_ps(-3.3241990f));
+    p = _mm_add_ps(_mm_mul_ps(p, m), _mm_set1_ps(3.1157899f));
+    return _mm_add_ps(_mm_mul_ps(p, _mm_sub_ps(m, _mm_set1_ps(1.f))), e);
+}
+
+// x^y for x >= 0. Values of x below 1e-20 are treated as 1e-20
+inline __m128 powSse(__m128 x, __m128 y)
+{
+    x = _mm_max_ps(x, _mm_set1_ps(1e-20f));
+    return exp2Sse(_mm_mul_ps(y, log2Sse(x)));
+}
+#endif
+
+}
@@ -0,0 +1,258 @@
+#include "tiled_img_writer.hpp"
+
+#include <string.h>
+#include <tl/basic.hpp>
+#include <tl/endian.hpp>
+#include "deflate.hpp"
+
+// the float data is written as it is in memory: both PFM (with a negative scale) and EXR are little endian
+
+namespace tg
+{
+
+static constexpr int k_exrZipLevel = 4; // same default as the OpenEXR library
+// EXR channels are sorted by name. Indices of the components of our pixels in that order
+static const char* const k_exrChannelNames[5][4] = {{}, {"Y"}, {"A", "Y"}, {"B", "G", "R"}, {"A", "B", "G", "R"}};
+static const int k_exrChannelOrder[5][4] = {{}, {0}, {1, 0}, {2, 1, 0}, {3, 2, 1, 0}};
+
+static bool seek(FILE* f, u64 offset)
+{
+#ifdef _WIN32
+    return _fseeki64(f, i64(offset), SEEK_SET) == 0;
+#else
+    return fseeko(f, off_t(offset), SEEK_SET) == 0;
+#endif
+}
+
+template <typename T>
+static void put(tl::Vector<u8>& out, T x)
+{
+    u8 bytes[sizeof(T)];
+    tl::writeLittleEndian((char*)bytes, x);
+    out.append(bytes);
+}
+static void putFloat(tl::Vector<u8>& out, float x)
+{
+    u32 bits;
+    memcpy(&bits, &x, 4);
+    put(out, bits);
+}
+static void putStr(tl::Vector<u8>& out, const char* str)
+{
+    out.append({(const u8*)str, strlen(str) + 1});
+}
+// name, type, size of the value. The value must be appended after
+static void putExrAttrib(tl::Vector<u8>& out, const char* name, const char* type, int size)
+{
+    putStr(out, name);
+    putStr(out, type);
+    put(out, i32(size));
+}
+
+bool TiledImgWriter::open(const char* fileName, int w, int h, int numChannels, int tileSize, ECompression compression)
+{
+    assert(!_file);
+    assert(w > 0 && h > 0 && tileSize > 0);
+    assert(numChannels >= 1 && numChannels <= 4);
+    const char* ext = strrchr(fileName, '.');
+    if(!ext)
+        return false;
+    if(strcmp(ext, ".pfm") == 0) {
+        if(numChannels != 1 && numChannels != 3)
+            return false;
+        _format = EFormat::PFM;
+    }
+    else if(strcmp(ext, ".exr") == 0) {
+        _format = EFormat::EXR;
+    }
+    else {
+        return false;
+    }
+
+    _w = w;
+    _h = h;
+    _numChannels = numChannels;
+    _tileSize = tileSize;
+    _compression = compression;
+    _ok = true;
+    _tileOffsets.resize(0);
+    _tileOffsets.resize(size_t(numTilesX()) * numTilesY(), 0);
+    _file = fopen(fileName, "wb");
+    if(!_file)
+        return false;
+
+    tl::Vector<u8> header;
+    if(_format == EFormat::PFM) {
+        char str[64];
+        const int n = snprintf(str, sizeof(str), "%s\n%d %d\n-1.", numChannels == 3 ? "PF" : "Pf", w, h);
+        header.append({(const u8*)str, size_t(n)});
+        // the scale is padded with zeros so the pixels are aligned to floats, for MappedImg
+        do {
+            header.push_back('0');
+        } while((header.size() + 1) % 4);
+        header.push_back('\n');
+        _dataOffset = header.size();
+        _fileEnd = _dataOffset + u64(w) * h * numChannels * sizeof(float);
+    }
+    else {
+        put(header, u32(20000630)); // magic number
+        put(header, u32(2 | 0x200)); // version 2, single part tiled
+
+        putExrAttrib(header, "channels", "chlist", 18 * numChannels + 1);
+        for(int c = 0; c < numChannels; c++) {
+            header.push_back(u8(k_exrChannelNames[numChannels][c][0]));
+            header.push_back(0);
+            put(header, i32(2)); // FLOAT
+            put(header, u32(0)); // pLinear and reserved
+            put(header, i32(1)); // x sampling
+            put(header, i32(1)); // y sampling
+        }
+        header.push_back(0);
+        putExrAttrib(header, "compression", "compression", 1);
+        header.push_back(compression == ECompression::ZIP ? 3 : 0);
+        for(const char* window : {"dataWindow", "displayWindow"}) {
+            putExrAttrib(header, window, "box2i", 16);
+            put(header, i32(0));
+            put(header, i32(0));
+            put(header, i32(w - 1));
+            put(header, i32(h - 1));
+        }
+        putExrAttrib(header, "lineOrder", "lineOrder", 1);
+        header.push_back(2); // RANDOM_Y: the tiles are stored in the order they are written
+        putExrAttrib(header, "pixelAspectRatio", "float", 4);
+        putFloat(header, 1);
+        putExrAttrib(header, "screenWindowCenter", "v2f", 8);
+        putFloat(header, 0);
+        putFloat(header, 0);
+        putExrAttrib(header, "screenWindowWidth", "float", 4);
+        putFloat(header, 1);
+        putExrAttrib(header, "tiles", "tiledesc", 9);
+        put(header, u32(tileSize));
+        put(header, u32(tileSize));
+        header.push_back(0); // ONE_LEVEL, ROUND_DOWN
+        header.push_back(0); // end of the header
+
+        // the table of offsets is filled when closing
+        _dataOffset = header.size();
+        for(size_t i = 0; i < _tileOffsets.size(); i++)
+            put(header, u64(0));
+        _fileEnd = header.size();
+    }
+
+    _ok = fwrite(header.data(), 1, header.size(), _file) == header.size();
+    if(_format == EFormat::PFM) {
+        // give the file its final size, so the tiles can be written anywhere
+        const u8 zero = 0;
+        _ok = _ok && seek(_file, _fileEnd - 1) && fwrite(&zero, 1, 1, _file) == 1;
+    }
+    return _ok;
+}
+
+int TiledImgWriter::tileWidth(int tileX)const
+{
+    return tl::min(_tileSize, _w - tileX * _tileSize);
+}
+int TiledImgWriter::tileHeight(int tileY)const
+{
+    return tl::min(_tileSize, _h - tileY * _tileSize);
+}
+
+bool TiledImgWriter::writeTile(int tileX, int tileY, const float* data, int strideInFloats)
+{
+    assert(_file);
+    assert(tileX >= 0 && tileX < numTilesX() && tileY >= 0 && tileY < numTilesY());
+    if(_format == EFormat::PFM)
+        return writeTilePfm(tileX, tileY, data, strideInFloats);
+    return writeTileExr(tileX, tileY, data, strideInFloats);
+}
+
+bool TiledImgWriter::writeTilePfm(int tileX, int tileY, const float* data, int strideInFloats)
+{
+    const int x0 = tileX * _tileSize;
+    const int y0 = tileY * _tileSize;
+    const int tw = tileWidth(tileX);
+    const int th = tileHeight(tileY);
+    std::lock_guard<std::mutex> lock(_mutex);
+    bool ok = true;
+    for(int y = 0; y < th && ok; y++) {
+        const u64 fileRow = _h - 1 - (y0 + y);
+        const u64 offset = _dataOffset + (fileRow * _w + x0) * _numChannels * sizeof(float);
+        const size_t n = size_t(tw) * _numChannels;
+        ok = seek(_file, offset) && fwrite(data + size_t(y) * strideInFloats, sizeof(float), n, _file) == n;
+    }
+    _tileOffsets[tileX + tileY * numTilesX()] = 1;
+    _ok = _ok && ok;
+    return ok;
+}
+
+bool TiledImgWriter::writeTileExr(int tileX, int tileY, const float* data, int strideInFloats)
+{
+    const int tw = tileWidth(tileX);
+    const int th = tileHeight(tileY);
+    const int nc = _numChannels;
+    // each line of the tile has the channels one after the other
+    const size_t lineSize = size_t(tw) * nc * sizeof(float);
+    tl::Vector<u8> pixels(lineSize * th);
+    for(int y = 0; y < th; y++) {
+        const float* row = data + size_t(y) * strideInFloats;
+        float* dst = (float*)(pixels.data() + y * lineSize);
+        for(int c = 0; c < nc; c++) {
+            const int srcC = k_exrChannelOrder[nc][c];
+            for(int x = 0; x < tw; x++)
+                *(dst++) = row[x * nc + srcC];
+        }
+    }
+
+    tl::Vector<u8> compressed;
+    const u8* chunkData = pixels.data();
+    size_t chunkSize = pixels.size();
+    if(_compression == ECompression::ZIP) {
+        // the predictor of the EXR ZIP compression: the even bytes go in the first half, the odd ones in the second
+        // half, and then each byte is replaced by the difference with the previous one
+        const size_t n = pixels.size();
+        tl::Vector<u8> tmp(n);
+        const size_t half = (n + 1) / 2;
+        for(size_t i = 0; i < n; i++)
+            tmp[(i & 1) ? half + i / 2 : i / 2] = pixels[i];
+        for(size_t i = n - 1; i > 0; i--)
+            tmp[i] = u8(int(tmp[i]) - int(tmp[i - 1]) + 128);
+        zlibCompress(compressed, tmp.data(), n, k_exrZipLevel);
+        // the readers know the data is not compressed when the size is the same as the uncompressed one
+        if(compressed.size() < n) {
+            chunkData = compressed.data();
+            chunkSize = compressed.size();
+        }
+    }
+
+    u8 chunkHeader[20];
+    const i32 headerValues[5] = {tileX, tileY, 0, 0, i32(chunkSize)}; // tile, level, size
+    for(int i = 0; i < 5; i++)
+        tl::writeLittleEndian((char*)chunkHeader + 4 * i, headerValues[i]);
+
+    std::lock_guard<std::mutex> lock(_mutex);
+    const bool ok = fwrite(chunkHeader, 1, 20, _file) == 20 && fwrite(chunkData, 1, chunkSize, _file) == chunkSize;
+    _tileOffsets[tileX + tileY * numTilesX()] = _fileEnd;
+    _fileEnd += 20 + chunkSize;
+    _ok = _ok && ok;
+    return ok;
+}
+
+bool TiledImgWriter::close()
+{
+    if(!_file)
+        return false;
+    bool ok = _ok;
+    for(u64 offset : _tileOffsets)
+        ok = ok && offset != 0;
+    if(_format == EFormat::EXR) {
+        tl::Vector<u8> table;
+        for(u64 offset : _tileOffsets)
+            put(table, offset);
+        ok = seek(_file, _dataOffset) && fwrite(table.data(), 1, table.size(), _file) == table.size() && ok;
+    }
+    ok = fclose(_file) == 0 && ok;
+    _file = nullptr;
+    return ok;
+}
+
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <stdio.h>
+#include <assert.h>
+#include <mutex>
+#include <tl/int_types.hpp>
+#include <tl/containers/vector.hpp>
+#include "img.hpp"
+
+namespace tg
+{
+
+// Writes a float image to disk tile by tile, as the tiles are finished and in any order, so a render that doesn't fit
+// in memory can be streamed to the file. Only the tile being written is kept in memory
+// The format is chosen from the extension of the file:
+// - .pfm: uncompressed, 1 or 3 channels. Each tile is written in its place, the rows of the file are bottom-up
+// - .exr: tiled OpenEXR with 32 bit float channels, uncompressed or ZIP. The tiles are appended in the order they
+//   arrive, and close() fills the table of offsets at the start of the file
+// writeTile() can be called from several threads at the same time. The tiles are compressed before taking the lock
+class TiledImgWriter
+{
+public:
+    enum class ECompression { NONE, ZIP }; // only for EXR
+
+    ~TiledImgWriter() { close(); }
+
+    bool open(const char* fileName, int w, int h, int numChannels, int tileSize = 64,
+        ECompression compression = ECompression::ZIP);
+    // data: the pixels of the tile, numChannels floats each, row 0 is the top one
+    // The tiles in the right and bottom edges are clipped to the image
+    bool writeTile(int tileX, int tileY, const float* data, int strideInFloats);
+    template <int NC>
+    bool writeTile(int tileX, int tileY, const ImgView<NC, float>& tile);
+    // returns false if there was any error since open(), or some tile was not written
+    bool close();
+
+    bool isOpen()const { return _file != nullptr; }
+    int tileSize()const { return _tileSize; }
+    int numTilesX()const { return (_w + _tileSize - 1) / _tileSize; }
+    int numTilesY()const { return (_h + _tileSize - 1) / _tileSize; }
+    int tileWidth(int tileX)const;
+    int tileHeight(int tileY)const;
+
+private:
+    enum class EFormat { PFM, EXR };
+    bool writeTilePfm(int tileX, int tileY, const float* data, int strideInFloats);
+    bool writeTileExr(int tileX, int tileY, const float* data, int strideInFloats);
+
+    FILE* _file = nullptr;
+    EFormat _format;
+    ECompression _compression;
+    int _w, _h;
+    int _numChannels;
+    int _tileSize;
+    u64 _dataOffset; // PFM: start of the pixels. EXR: start of the table of offsets
+    u64 _fileEnd;
+    tl::Vector<u64> _tileOffsets; // EXR: 0 for the tiles not written yet. PFM: 1 for the tiles already written
+    bool _ok;
+    std::mutex _mutex;
+};
+
+template <int NC>
+bool TiledImgWriter::writeTile(int tileX, int tileY, const ImgView<NC, float>& tile)
+{
+    assert(NC == _numChannels);
+    assert(tile.width() == tileWidth(tileX) && tile.height() == tileHeight(tileY));
+    return writeTile(tileX, tileY, (const float*)tile.data(), tile.stride() * NC);
+}
+
+}
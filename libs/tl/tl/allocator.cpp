@@ -0,0 +1,79 @@
+#include "allocator.hpp"
+
+#include <stdlib.h>
+#include "basic.hpp"
+#include "fmt.hpp"
+
+namespace tl
+{
+
+Arena::Arena(const char* name, size_t blockSize)
+    : _name(name)
+    , _blockSize(blockSize)
+{}
+
+Arena::~Arena()
+{
+    release();
+}
+
+void* Arena::allocSlow(size_t bytes, size_t align)
+{
+    // the block header is aligned to max_align_t, so a fresh block only needs extra room for bigger alignments
+    const size_t headerSize = (sizeof(Block) + alignof(max_align_t) - 1) & ~(alignof(max_align_t) - 1);
+    const size_t padding = align > alignof(max_align_t) ? align : 0;
+    const size_t size = tl::max(_blockSize, headerSize + padding + bytes);
+    Block* block = (Block*)malloc(size);
+    assert(block);
+    block->prev = _block;
+    block->size = size;
+    _block = block;
+    _cursor = (u8*)block + headerSize;
+    _end = (u8*)block + size;
+    _stats.bytesReserved += size;
+    _stats.numBlocks++;
+    return alloc(bytes, align);
+}
+
+void Arena::reset()
+{
+    if(_block && _block->prev) {
+        // merge the blocks, the next frame will probably need as much memory as this one
+        const size_t total = _stats.bytesReserved;
+        release();
+        _blockSize = tl::max(_blockSize, total);
+        return;
+    }
+    _stats.numAllocs = 0;
+    _stats.bytesAllocated = 0;
+    _stats.bytesUsed = 0;
+    _last = nullptr;
+    if(_block) {
+        const size_t headerSize = (sizeof(Block) + alignof(max_align_t) - 1) & ~(alignof(max_align_t) - 1);
+        _cursor = (u8*)_block + headerSize;
+    }
+}
+
+void Arena::release()
+{
+    while(_block) {
+        Block* prev = _block->prev;
+        ::free(_block);
+        _block = prev;
+    }
+    _cursor = _end = _last = _lastStart = nullptr;
+    _stats.numAllocs = 0;
+    _stats.bytesAllocated = 0;
+    _stats.bytesUsed = 0;
+    _stats.bytesReserved = 0;
+    _stats.numBlocks = 0;
+}
+
+void Arena::printStats()const
+{
+    println(_name, ": ", _stats.numAllocs, " allocs, ", _stats.bytesAllocated, " bytes allocated, ",
+        _stats.bytesUsed, " used (peak ", _stats.peakBytesUsed, "), ",
+        _stats.bytesReserved, " reserved in ", _stats.numBlocks, " blocks");
+}
+
+}
@@ -0,0 +1,177 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <new>
+#include "int_types.hpp"
+
+// Allocators of the containers (Vector, hash_map). They are small handles, copied along with the containers:
+//   void* alloc(size_t bytes, size_t align);
+//   void free(void* p); // p can be nullptr
+//   bool grow(void* p, size_t newBytes); // tries to extend the allocation p in place
+//   // moves the first oldBytes of p to an allocation of newBytes, in place when possible. p can be nullptr
+//   void* realloc(void* p, size_t oldBytes, size_t newBytes, size_t align);
+
+namespace tl
+{
+
+// malloc/free, the default of the containers. realloc() can extend the allocation in place, or remap its pages
+// instead of copying them when it's big
+struct HeapAllocator {
+    void* alloc(size_t bytes, size_t align)
+    {
+        assert(align <= alignof(max_align_t));
+        (void)align;
+        return ::malloc(bytes);
+    }
+    void free(void* p) { ::free(p); }
+    bool grow(void*, size_t) { return false; }
+    void* realloc(void* p, size_t, size_t newBytes, size_t align)
+    {
+        assert(align <= alignof(max_align_t));
+        (void)align;
+        return ::realloc(p, newBytes);
+    }
+};
+
+struct ArenaStats {
+    u64 numAllocs = 0; // since the last reset
+    u64 bytesAllocated = 0; // requested since the last reset, including the ones given back by free()
+    u64 bytesUsed = 0; // currently used, including the padding for alignment
+    u64 peakBytesUsed = 0; // maximum of bytesUsed since the arena was created
+    u64 bytesReserved = 0; // blocks currently owned
+    u32 numBlocks = 0;
+};
+
+// Monotonic allocator: allocations bump a cursor inside big blocks of memory, and everything is freed at once
+// with reset(). free() only gives the memory back when it's the last allocation, which is what a container growing
+// at the top of the arena needs
+// After a reset the blocks are merged into one big enough for everything allocated before it, so an arena that is
+// reset every frame settles to a single block and no calls to the heap
+// Not thread safe
+class Arena {
+public:
+    explicit Arena(const char* name = "arena", size_t blockSize = 64 << 10);
+    ~Arena();
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+
+    void* alloc(size_t bytes, size_t align = alignof(max_align_t))
+    {
+        const size_t p = ((size_t)_cursor + align - 1) & ~(align - 1);
+        // without a block _cursor and _end are null, and alloc(0) would fit
+        if(p + bytes > (size_t)_end || !_block)
+            return allocSlow(bytes, align);
+        addUsed(p + bytes - (size_t)_cursor);
+        _stats.numAllocs++;
+        _stats.bytesAllocated += bytes;
+        _lastStart = _cursor;
+        _last = (u8*)p;
+        _cursor = (u8*)p + bytes;
+        return _last;
+    }
+    template <typename T>
+    T* allocArray(size_t n) { return (T*)alloc(n * sizeof(T), alignof(T)); }
+    void free(void* p)
+    {
+        if(p && p == _last) {
+            // the alignment padding is given back too
+            _stats.bytesUsed -= _cursor - _lastStart;
+            _cursor = _lastStart;
+            _last = nullptr;
+        }
+    }
+    bool grow(void* p, size_t newBytes)
+    {
+        if(!p || p != _last || newBytes > size_t(_end - _last))
+            return false;
+        u8* newCursor = _last + newBytes;
+        if(newCursor > _cursor) {
+            const size_t extra = newCursor - _cursor;
+            addUsed(extra);
+            _stats.bytesAllocated += extra;
+        }
+        else {
+            _stats.bytesUsed -= _cursor - newCursor;
+        }
+        _cursor = newCursor;
+        return true;
+    }
+    void* realloc(void* p, size_t oldBytes, size_t newBytes, size_t align = alignof(max_align_t))
+    {
+        if(grow(p, newBytes))
+            return p;
+        void* q = alloc(newBytes, align);
+        if(p)
+            memcpy(q, p, oldBytes);
+        return q;
+    }
+
+    void reset(); // everything allocated is invalidated, the memory is kept
+    void release(); // reset, and the memory is given back to the heap
+
+    const ArenaStats& stats()const { return _stats; }
+    const char* name()const { return _name; }
+    void printStats()const;
+
+private:
+    struct Block {
+        Block* prev;
+        size_t size; // including this header
+    };
+
+    void* allocSlow(size_t bytes, size_t align);
+    void addUsed(size_t bytes)
+    {
+        _stats.bytesUsed += bytes;
+        if(_stats.bytesUsed > _stats.peakBytesUsed)
+            _stats.peakBytesUsed = _stats.bytesUsed;
+    }
+
+    const char* _name; // must have static storage duration
+    size_t _blockSize;
+    Block* _block = nullptr; // the current one, linked to the previous ones
+    u8* _cursor = nullptr;
+    u8* _end = nullptr;
+    u8* _last = nullptr; // last allocation, if it can still be freed
+    u8* _lastStart = nullptr; // _cursor before the last allocation, i.e. before its alignment padding
+    ArenaStats _stats;
+};
+
+// Per-frame linear allocator: beginFrame() switches to the other arena and resets it, so the data allocated during
+// a frame stays valid during the next one too, e.g. while another thread consumes it
+class FrameArena {
+public:
+    explicit FrameArena(const char* name = "frame arena", size_t blockSize = 64 << 10)
+        : _arenas{Arena(name, blockSize), Arena(name, blockSize)} {}
+
+    void beginFrame()
+    {
+        _current ^= 1;
+        _arenas[_current].reset();
+    }
+    Arena& arena() { return _arenas[_current]; }
+    Arena& prevArena() { return _arenas[_current ^ 1]; }
+
+private:
+    Arena _arenas[2];
+    int _current = 0;
+};
+
+// allocator handle for the containers. The arena must outlive them
+struct ArenaAllocator {
+    Arena* arena;
+
+    ArenaAllocator(Arena& arena) : arena(&arena) {}
+    void* alloc(size_t bytes, size_t align) { return arena->alloc(bytes, align); }
+    void free(void* p) { arena->free(p); }
+    bool grow(void* p, size_t newBytes) { return arena->grow(p, newBytes); }
+    void* realloc(void* p, size_t oldBytes, size_t newBytes, size_t align)
+    {
+        return arena->realloc(p, oldBytes, newBytes, align);
+    }
+};
+
+}
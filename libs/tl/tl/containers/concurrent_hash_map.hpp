@@ -0,0 +1,206 @@
+#pragma once
+
+#include <shared_mutex>
+#include <mutex>
+#include <tl/int_types.hpp>
+#include <tl/move.hpp>
+#include <tl/containers/hash_map.hpp>
+#include <tl/containers/concurrent_queue.hpp>
+
+// hash_map that can be used from several threads at the same time
+// The keys are split in NumShards independent hash_maps, each with its own reader-writer lock: the lookups of a
+// shard run in parallel, and an insertion only blocks the threads that use the same shard. With more shards than
+// threads the threads rarely wait for each other
+// The values are never exposed outside of the lock: the lookups copy them out, or pass them to a callback that runs
+// with the shard locked. The callbacks must not use the same map
+
+namespace tl
+{
+
+template <typename Key, typename T, typename Hash = tl::hash<Key>, typename KeyEqual = rhood::equal_to<Key>,
+          size_t NumShards = 64>
+class ConcurrentHashMap
+{
+public:
+    static_assert(NumShards >= 1 && (NumShards & (NumShards - 1)) == 0, "the number of shards must be a power of 2");
+
+    ConcurrentHashMap() = default;
+    ConcurrentHashMap(const ConcurrentHashMap&) = delete;
+    ConcurrentHashMap& operator=(const ConcurrentHashMap&) = delete;
+
+    // copies the value to out
+    bool find(const Key& key, T& out)const;
+    bool contains(const Key& key)const;
+    // calls fn(const T&) with the shard locked for reading
+    template <typename Fn>
+    bool visit(const Key& key, const Fn& fn)const;
+    // calls fn(T&) with the shard locked for writing
+    template <typename Fn>
+    bool update(const Key& key, const Fn& fn);
+
+    // returns false, without modifying the value, when the key was already there
+    template <typename... Args>
+    bool emplace(const Key& key, Args&&... args);
+    bool insert(const Key& key, const T& value) { return emplace(key, value); }
+    bool insert(const Key& key, T&& value) { return emplace(key, tl::move(value)); }
+    // returns a copy of the value, inserting make() first if the key wasn't there. make() is called with the shard
+    // locked, and only by one thread when several miss the same key, which suits the caches that are expensive to fill
+    template <typename MakeFn>
+    T findOrInsert(const Key& key, const MakeFn& make);
+    bool erase(const Key& key);
+
+    // these lock the shards one at a time: with concurrent writers the result doesn't correspond to a single moment
+    size_t size()const;
+    void clear();
+    void reserve(size_t n);
+    // fn(const Key&, const T&)
+    template <typename Fn>
+    void forEach(const Fn& fn)const;
+
+private:
+    typedef hash_map<Key, T, Hash, KeyEqual> Map;
+    struct alignas(k_cacheLineSize) Shard {
+        std::shared_mutex mutex;
+        Map map;
+    };
+
+    // the shard is taken from the top bits of the hash multiplied by a 64 bit constant. hash_map indexes its table
+    // with the low bits of the hash, so the keys of a shard are still spread all over the table of the shard
+    Shard& shard(const Key& key)const
+    {
+        const u64 h = u64(Hash{}(key)) * 0x9E3779B97F4A7C15ull;
+        return _shards[NumShards == 1 ? 0 : size_t(h >> (64 - log2NumShards()))];
+    }
+    static constexpr u32 log2NumShards()
+    {
+        u32 n = 0;
+        while((size_t(1) << n) < NumShards)
+            n++;
+        return n;
+    }
+
+    mutable Shard _shards[NumShards];
+};
+
+template <typename Key, typename T, typename Hash, typename KeyEqual, size_t NumShards>
+bool ConcurrentHashMap<Key, T, Hash, KeyEqual, NumShards>::find(const Key& key, T& out)const
+{
+    return visit(key, [&out](const T& value) {
+        out = value;
+    });
+}
+
+template <typename Key, typename T, typename Hash, typename KeyEqual, size_t NumShards>
+bool ConcurrentHashMap<Key, T, Hash, KeyEqual, NumShards>::contains(const Key& key)const
+{
+    Shard& s = shard(key);
+    std::shared_lock<std::shared_mutex> lock(s.mutex);
+    return s.map.find(key) != s.map.end();
+}
+
+template <typename Key, typename T, typename Hash, typename KeyEqual, size_t NumShards>
+template <typename Fn>
+bool ConcurrentHashMap<Key, T, Hash, KeyEqual, NumShards>::visit(const Key& key, const Fn& fn)const
+{
+    Shard& s = shard(key);
+    std::shared_lock<std::shared_mutex> lock(s.mutex);
+    auto it = s.map.find(key);
+    if(it == s.map.end())
+        return false;
+    fn((const T&)it->second);
+    return true;
+}
+
+template <typename Key, typename T, typename Hash, typename KeyEqual, size_t NumShards>
+template <typename Fn>
+bool ConcurrentHashMap<Key, T, Hash, KeyEqual, NumShards>::update(const Key& key, const Fn& fn)
+{
+    Shard& s = shard(key);
+    std::lock_guard<std::shared_mutex> lock(s.mutex);
+    auto it = s.map.find(key);
+    if(it == s.map.end())
+        return false;
+    fn(it->second);
+    return true;
+}
+
+template <typename Key, typename T, typename Hash, typename KeyEqual, size_t NumShards>
+template <typename... Args>
+bool ConcurrentHashMap<Key, T, Hash, KeyEqual, NumShards>::emplace(const Key& key, Args&&... args)
+{
+    Shard& s = shard(key);
+    std::lock_guard<std::shared_mutex> lock(s.mutex);
+    return s.map.emplace(key, T(tl::forward<Args>(args)...)).sucess;
+}
+
+template <typename Key, typename T, typename Hash, typename KeyEqual, size_t NumShards>
+template <typename MakeFn>
+T ConcurrentHashMap<Key, T, Hash, KeyEqual, NumShards>::findOrInsert(const Key& key, const MakeFn& make)
+{
+    Shard& s = shard(key);
+    {
+        // the common case, a hit, only takes the shared lock
+        std::shared_lock<std::shared_mutex> lock(s.mutex);
+        auto it = s.map.find(key);
+        if(it != s.map.end())
+            return it->second;
+    }
+    std::lock_guard<std::shared_mutex> lock(s.mutex);
+    // another thread could have inserted it in between
+    auto it = s.map.find(key);
+    if(it != s.map.end())
+        return it->second;
+    return s.map.emplace(key, make()).it->second;
+}
+
+template <typename Key, typename T, typename Hash, typename KeyEqual, size_t NumShards>
+bool ConcurrentHashMap<Key, T, Hash, KeyEqual, NumShards>::erase(const Key& key)
+{
+    Shard& s = shard(key);
+    std::lock_guard<std::shared_mutex> lock(s.mutex);
+    return s.map.erase(key) != 0;
+}
+
+template <typename Key, typename T, typename Hash, typename KeyEqual, size_t NumShards>
+size_t ConcurrentHashMap<Key, T, Hash, KeyEqual, NumShards>::size()const
+{
+    size_t n = 0;
+    for(Shard& s : _shards) {
+        std::shared_lock<std::shared_mutex> lock(s.mutex);
+        n += s.map.size();
+    }
+    return n;
+}
+
+template <typename Key, typename T, typename Hash, typename KeyEqual, size_t NumShards>
+void ConcurrentHashMap<Key, T, Hash, KeyEqual, NumShards>::clear()
+{
+    for(Shard& s : _shards) {
+        std::lock_guard<std::shared_mutex> lock(s.mutex);
+        s.map.clear();
+    }
+}
+
+template <typename Key, typename T, typename Hash, typename KeyEqual, size_t NumShards>
+void ConcurrentHashMap<Key, T, Hash, KeyEqual, NumShards>::reserve(size_t n)
+{
+    // the keys are spread evenly, with some margin for the unlucky shards
+    const size_t perShard = n / NumShards + n / (4 * NumShards) + 1;
+    for(Shard& s : _shards) {
+        std::lock_guard<std::shared_mutex> lock(s.mutex);
+        s.map.reserve(perShard);
+    }
+}
+
+template <typename Key, typename T, typename Hash, typename KeyEqual, size_t NumShards>
+template <typename Fn>
+void ConcurrentHashMap<Key, T, Hash, KeyEqual, NumShards>::forEach(const Fn& fn)const
+{
+    for(Shard& s : _shards) {
+        std::shared_lock<std::shared_mutex> lock(s.mutex);
+        for(auto& kv : s.map)
+            fn((const Key&)kv.first, (const T&)kv.second);
+    }
+}
+
+}
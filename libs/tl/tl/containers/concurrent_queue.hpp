@@ -0,0 +1,190 @@
+#pragma once
+
+#include <atomic>
+#include <new>
+#include <tl/int_types.hpp>
+#include <tl/move.hpp>
+
+// Bounded lock-free queues with a fixed capacity N (a power of 2). The operations never block: tryPush() fails when
+// the queue is full and tryPop() when it's empty
+// The indices written by different threads are in different cache lines, so the producers and the consumers don't
+// invalidate each other's lines on every operation
+
+namespace tl
+{
+
+constexpr size_t k_cacheLineSize = 64;
+
+// Single producer, single consumer ring buffer
+// Each side keeps a cached copy of the index of the other side, and only reloads it when the queue looks full (or
+// empty), so in the common case an operation touches no line written by the other thread
+template <typename T, size_t N>
+class SpscQueue
+{
+public:
+    static_assert(N >= 2 && (N & (N - 1)) == 0, "the capacity must be a power of 2");
+
+    SpscQueue() = default;
+    SpscQueue(const SpscQueue&) = delete;
+    SpscQueue& operator=(const SpscQueue&) = delete;
+    // no other thread uses the queue anymore, the elements left are destroyed in place
+    ~SpscQueue()
+    {
+        const size_t tail = _tail.load(std::memory_order_acquire);
+        for(size_t i = _head.load(std::memory_order_relaxed); i != tail; i++)
+            slot(i)->~T();
+    }
+
+    // --- producer ---
+    bool tryPush(const T& x) { return emplace(x); }
+    bool tryPush(T&& x) { return emplace(tl::move(x)); }
+    template <typename... Args>
+    bool emplace(Args&&... args)
+    {
+        const size_t tail = _tail.load(std::memory_order_relaxed);
+        if(tail - _headCache == N) {
+            _headCache = _head.load(std::memory_order_acquire);
+            if(tail - _headCache == N)
+                return false;
+        }
+        new (slot(tail)) T(tl::forward<Args>(args)...);
+        _tail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    // --- consumer ---
+    bool tryPop(T& x)
+    {
+        const size_t head = _head.load(std::memory_order_relaxed);
+        if(head == _tailCache) {
+            _tailCache = _tail.load(std::memory_order_acquire);
+            if(head == _tailCache)
+                return false;
+        }
+        T* p = slot(head);
+        x = tl::move(*p);
+        p->~T();
+        _head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    // exact only when called from one of the two threads while the other is idle
+    size_t sizeApprox()const
+    {
+        return _tail.load(std::memory_order_acquire) - _head.load(std::memory_order_acquire);
+    }
+    static constexpr size_t capacity() { return N; }
+
+private:
+    T* slot(size_t i) { return reinterpret_cast<T*>(_data + (i & (N - 1)) * sizeof(T)); }
+
+    alignas(k_cacheLineSize) std::atomic<size_t> _head {0}; // written by the consumer
+    size_t _tailCache = 0; // consumer's copy of _tail
+    alignas(k_cacheLineSize) std::atomic<size_t> _tail {0}; // written by the producer
+    size_t _headCache = 0; // producer's copy of _head
+    alignas(k_cacheLineSize) alignas(T) u8 _data[N * sizeof(T)];
+};
+
+// Multiple producers, multiple consumers (Vyukov's bounded queue)
+// Each cell has a sequence number that says whose turn it is: a producer claims a cell with a CAS on the enqueue
+// position when the sequence equals the position, and a consumer when it equals the position + 1. Contention is
+// only on the two positions, and a thread is never blocked by a stalled one that isn't working on the same cell
+template <typename T, size_t N>
+class MpmcQueue
+{
+public:
+    static_assert(N >= 2 && (N & (N - 1)) == 0, "the capacity must be a power of 2");
+
+    MpmcQueue()
+    {
+        for(size_t i = 0; i < N; i++)
+            _cells[i].sequence.store(i, std::memory_order_relaxed);
+    }
+    MpmcQueue(const MpmcQueue&) = delete;
+    MpmcQueue& operator=(const MpmcQueue&) = delete;
+    // no other thread uses the queue anymore, the elements left are destroyed in place. A cell is full when its
+    // sequence is its position + 1
+    ~MpmcQueue()
+    {
+        const size_t enqueuePos = _enqueuePos.load(std::memory_order_acquire);
+        for(size_t pos = _dequeuePos.load(std::memory_order_relaxed); pos != enqueuePos; pos++) {
+            Cell& cell = _cells[pos & (N - 1)];
+            if(cell.sequence.load(std::memory_order_acquire) == pos + 1)
+                reinterpret_cast<T*>(cell.data)->~T();
+        }
+    }
+
+    bool tryPush(const T& x) { return emplace(x); }
+    bool tryPush(T&& x) { return emplace(tl::move(x)); }
+    template <typename... Args>
+    bool emplace(Args&&... args)
+    {
+        size_t pos = _enqueuePos.load(std::memory_order_relaxed);
+        Cell* cell;
+        while(true) {
+            cell = &_cells[pos & (N - 1)];
+            const size_t seq = cell->sequence.load(std::memory_order_acquire);
+            const intptr_t diff = intptr_t(seq) - intptr_t(pos);
+            if(diff == 0) {
+                if(_enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    break;
+            }
+            else if(diff < 0) {
+                return false; // full: the cell still holds the value of the previous lap
+            }
+            else {
+                pos = _enqueuePos.load(std::memory_order_relaxed);
+            }
+        }
+        new (cell->data) T(tl::forward<Args>(args)...);
+        cell->sequence.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool tryPop(T& x)
+    {
+        size_t pos = _dequeuePos.load(std::memory_order_relaxed);
+        Cell* cell;
+        while(true) {
+            cell = &_cells[pos & (N - 1)];
+            const size_t seq = cell->sequence.load(std::memory_order_acquire);
+            const intptr_t diff = intptr_t(seq) - intptr_t(pos + 1);
+            if(diff == 0) {
+                if(_dequeuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    break;
+            }
+            else if(diff < 0) {
+                return false; // empty
+            }
+            else {
+                pos = _dequeuePos.load(std::memory_order_relaxed);
+            }
+        }
+        T* p = reinterpret_cast<T*>(cell->data);
+        x = tl::move(*p);
+        p->~T();
+        // the cell is free for the producers of the next lap
+        cell->sequence.store(pos + N, std::memory_order_release);
+        return true;
+    }
+
+    size_t sizeApprox()const
+    {
+        const size_t enqueuePos = _enqueuePos.load(std::memory_order_relaxed);
+        const size_t dequeuePos = _dequeuePos.load(std::memory_order_relaxed);
+        return enqueuePos > dequeuePos ? enqueuePos - dequeuePos : 0;
+    }
+    static constexpr size_t capacity() { return N; }
+
+private:
+    struct Cell {
+        std::atomic<size_t> sequence;
+        alignas(T) u8 data[sizeof(T)];
+    };
+
+    alignas(k_cacheLineSize) std::atomic<size_t> _enqueuePos {0};
+    alignas(k_cacheLineSize) std::atomic<size_t> _dequeuePos {0};
+    alignas(k_cacheLineSize) Cell _cells[N];
+};
+
+}
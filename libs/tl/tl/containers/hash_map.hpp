@@ -46,13 +46,15 @@
 #include <tl/hash/hash.hpp>
 #include <tl/basic_math.hpp>
 #include <tl/move.hpp>
-#include <tl/swap.hpp>
+#include <tl/basic.hpp>
 #include <tl/type_traits/is_same_type.hpp>
 #include <tl/type_traits/conditional_type.hpp>
 #include <tl/type_traits/declval.hpp>
 #include <tl/pair.hpp>
+#include <tl/allocator.hpp>
 #include <new>
 #include <initializer_list>
+#include <type_traits>
 #include <stdlib.h>
 #include <string.h>
 #include <assert.h>
@@ -283,19 +285,23 @@ T* assertNotNull(T* t, Args&&... args) {
 
 // Allocates bulks of memory for objects of type T. This deallocates the memory in the destructor,
 // and keeps a linked list of the allocated memory around. Overhead per allocation is the size of a
-// pointer.
-template <typename T, size_t MinNumAllocs = 4, size_t MaxNumAllocs = 256>
-class BulkPoolAllocator {
+// pointer. The bulks come from Alloc (see tl/allocator.hpp)
+template <typename T, size_t MinNumAllocs = 4, size_t MaxNumAllocs = 256, typename Alloc = tl::HeapAllocator>
+class BulkPoolAllocator : public Alloc {
 public:
     BulkPoolAllocator() noexcept = default;
+    explicit BulkPoolAllocator(const Alloc& alloc) noexcept
+        : Alloc(alloc) {}
 
-    // does not copy anything, just creates a new allocator.
-    BulkPoolAllocator(const BulkPoolAllocator& ROBIN_HOOD_UNUSED(o) /*unused*/) noexcept
-        : mHead(nullptr)
+    // does not copy anything but the allocator handle, just creates a new pool.
+    BulkPoolAllocator(const BulkPoolAllocator& o) noexcept
+        : Alloc(static_cast<const Alloc&>(o))
+        , mHead(nullptr)
         , mListForFree(nullptr) {}
 
     BulkPoolAllocator(BulkPoolAllocator&& o) noexcept
-        : mHead(o.mHead)
+        : Alloc(static_cast<const Alloc&>(o))
+        , mHead(o.mHead)
         , mListForFree(o.mListForFree) {
         o.mListForFree = nullptr;
         o.mHead = nullptr;
@@ -303,6 +309,7 @@ public:
 
     BulkPoolAllocator& operator=(BulkPoolAllocator&& o) noexcept {
         reset();
+        Alloc::operator=(static_cast<const Alloc&>(o));
         mHead = o.mHead;
         mListForFree = o.mListForFree;
         o.mListForFree = nullptr;
@@ -324,7 +331,7 @@ public:
     void reset() noexcept {
         while (mListForFree) {
             T* tmp = *mListForFree;
-            free(mListForFree);
+            Alloc::free(mListForFree);
             mListForFree = reinterpret_cast_no_cast_align_warning<T**>(tmp);
         }
         mHead = nullptr;
@@ -353,19 +360,20 @@ public:
     }
 
     // Adds an already allocated block of memory to the allocator. This allocator is from now on
-    // responsible for freeing the data (with free()). If the provided data is not large enough to
+    // responsible for freeing the data (with Alloc::free()). If the provided data is not large enough to
     // make use of, it is immediately freed. Otherwise it is reused and freed in the destructor.
     void addOrFree(void* ptr, const size_t numBytes) noexcept {
         // calculate number of available elements in ptr
         if (numBytes < ALIGNMENT + ALIGNED_SIZE) {
             // not enough data for at least one element. Free and return.
-            free(ptr);
+            Alloc::free(ptr);
         } else {
             add(ptr, numBytes);
         }
     }
 
-    void swap(BulkPoolAllocator<T, MinNumAllocs, MaxNumAllocs>& other) noexcept {
+    void swap(BulkPoolAllocator<T, MinNumAllocs, MaxNumAllocs, Alloc>& other) noexcept {
+        tl::swap(static_cast<Alloc&>(*this), static_cast<Alloc&>(other));
         tl::swap(mHead, other.mHead);
         tl::swap(mListForFree, other.mListForFree);
     }
@@ -425,7 +433,7 @@ private:
         // alloc new memory: [prev |T, T, ... T]
         // std::cout << (sizeof(T*) + ALIGNED_SIZE * numElementsToAlloc) << " bytes" << std::endl;
         size_t const bytes = ALIGNMENT + ALIGNED_SIZE * numElementsToAlloc;
-        void* memory = malloc(bytes);
+        void* memory = Alloc::alloc(bytes, ALIGNMENT);
         assert(memory != nullptr);
         add(memory, bytes);
         return mHead;
@@ -454,21 +462,37 @@ private:
     T** mListForFree{nullptr};
 };
 
-template <typename T, size_t MinSize, size_t MaxSize, bool IsFlatMap>
+template <typename T, size_t MinSize, size_t MaxSize, bool IsFlatMap, typename Alloc>
 struct NodeAllocator;
 
-// dummy allocator that does nothing
-template <typename T, size_t MinSize, size_t MaxSize>
-struct NodeAllocator<T, MinSize, MaxSize, true> {
+// dummy allocator that only holds Alloc
+template <typename T, size_t MinSize, size_t MaxSize, typename Alloc>
+struct NodeAllocator<T, MinSize, MaxSize, true, Alloc> : public Alloc {
+    NodeAllocator() noexcept = default;
+    explicit NodeAllocator(const Alloc& alloc) noexcept
+        : Alloc(alloc) {}
+    NodeAllocator(const NodeAllocator& o) noexcept = default;
+    NodeAllocator(NodeAllocator&& o) noexcept = default;
+    // like BulkPoolAllocator, the copy keeps the allocator that owns the memory of the map
+    NodeAllocator& operator=(const NodeAllocator& ROBIN_HOOD_UNUSED(o) /*unused*/) noexcept {
+        return *this;
+    }
+    NodeAllocator& operator=(NodeAllocator&& o) noexcept {
+        Alloc::operator=(static_cast<const Alloc&>(o));
+        return *this;
+    }
 
     // we are not using the data, so just free it.
     void addOrFree(void* ptr, size_t ROBIN_HOOD_UNUSED(numBytes) /*unused*/) noexcept {
-        free(ptr);
+        Alloc::free(ptr);
     }
 };
 
-template <typename T, size_t MinSize, size_t MaxSize>
-struct NodeAllocator<T, MinSize, MaxSize, false> : public BulkPoolAllocator<T, MinSize, MaxSize> {};
+template <typename T, size_t MinSize, size_t MaxSize, typename Alloc>
+struct NodeAllocator<T, MinSize, MaxSize, false, Alloc>
+    : public BulkPoolAllocator<T, MinSize, MaxSize, Alloc> {
+    using BulkPoolAllocator<T, MinSize, MaxSize, Alloc>::BulkPoolAllocator;
+};
 
 // dummy hash, unsed as mixer when robin_hood::hash is already used
 template <typename T>
@@ -521,14 +545,16 @@ namespace detail {
 // According to STL, order of templates has effect on throughput. That's why I've moved the boolean
 // to the front.
 // https://www.reddit.com/r/cpp/comments/ahp6iu/compile_time_binary_size_reductions_and_cs_future/eeguck4/
+// Alloc: allocator handle of the table and the nodes, see tl/allocator.hpp. It's copied by the copy constructor and
+// taken by the move operations, but the copy assignment keeps the one of the destination
 template <bool IsFlatMap, size_t MaxLoadFactor100, typename Key, typename T, typename Hash,
-          typename KeyEqual>
+          typename KeyEqual, typename Alloc>
 class unordered_map
     : public Hash,
       public KeyEqual,
       detail::NodeAllocator<
           tl::Pair<typename tl::conditional_type<IsFlatMap, Key, Key const>::type, T>, 4, 16384,
-          IsFlatMap> {
+          IsFlatMap, Alloc> {
 public:
     using key_type = Key;
     using mapped_type = T;
@@ -537,8 +563,9 @@ public:
     using size_type = size_t;
     using hasher = Hash;
     using key_equal = KeyEqual;
+    using allocator_type = Alloc;
     using Self =
-        unordered_map<IsFlatMap, MaxLoadFactor100, key_type, mapped_type, hasher, key_equal>;
+        unordered_map<IsFlatMap, MaxLoadFactor100, key_type, mapped_type, hasher, key_equal, Alloc>;
     static constexpr bool is_flat_map = IsFlatMap;
 
 private:
@@ -552,7 +579,7 @@ private:
     static constexpr uint32_t InitialInfoNumBits = 5;
     static constexpr uint8_t InitialInfoInc = 1U << InitialInfoNumBits;
     static constexpr uint8_t InitialInfoHashShift = sizeof(size_t) * 8 - InitialInfoNumBits;
-    using DataPool = detail::NodeAllocator<value_type, 4, 16384, IsFlatMap>;
+    using DataPool = detail::NodeAllocator<value_type, 4, 16384, IsFlatMap, Alloc>;
 
     // type needs to be wider than uint8_t.
     using InfoType = uint32_t;
@@ -586,7 +613,7 @@ private:
             : mData(val) {}
 
         DataNode(M& ROBIN_HOOD_UNUSED(map), value_type&& val)
-            noexcept(noexcept(mData(tl::move(val))))
+            noexcept(noexcept(value_type(tl::move(val))))
             : mData(tl::move(val)) {}
 
         // doesn't do anything
@@ -863,7 +890,7 @@ private:
         }
 
         friend class unordered_map<IsFlatMap, MaxLoadFactor100, key_type, mapped_type, hasher,
-                                   key_equal>;
+                                   key_equal, Alloc>;
         NodePtr mKeyVals{nullptr};
         uint8_t const* mInfo{nullptr};
     };
@@ -1061,6 +1088,19 @@ public:
         ROBIN_HOOD_TRACE(this);
     }
 
+    explicit unordered_map(const Alloc& alloc, const Hash& h = Hash{},
+                           const KeyEqual& equal = KeyEqual{}) noexcept(noexcept(Hash(h)) &&
+                                                                        noexcept(KeyEqual(equal)))
+        : Hash(h)
+        , KeyEqual(equal)
+        , DataPool(alloc) {
+        ROBIN_HOOD_TRACE(this);
+    }
+
+    const Alloc& get_allocator() const noexcept {
+        return static_cast<const Alloc&>(*this);
+    }
+
     template <typename Iter>
     unordered_map(Iter first, Iter last, size_t ROBIN_HOOD_UNUSED(bucket_count) /*unused*/ = 0,
                   const Hash& h = Hash{}, const KeyEqual& equal = KeyEqual{})
@@ -1133,7 +1173,7 @@ public:
             // not empty: create an exact copy. it is also possible to just iterate through all
             // elements and insert them, but copying is probably faster.
 
-            mKeyVals = static_cast<Node*>(malloc(calcNumBytesTotal(o.mMask + 1)));
+            mKeyVals = static_cast<Node*>(DataPool::alloc(calcNumBytesTotal(o.mMask + 1), alignof(Node)));
             assert(mKeyVals);
             // no need for calloc because clonData does memcpy
             mInfo = reinterpret_cast<uint8_t*>(mKeyVals + o.mMask + 1);
@@ -1180,10 +1220,10 @@ public:
             // no luck: we don't have the same array size allocated, so we need to realloc.
             if (0 != mMask) {
                 // only deallocate if we actually have data!
-                free(mKeyVals);
+                DataPool::free(mKeyVals);
             }
 
-            mKeyVals = static_cast<Node*>(malloc(calcNumBytesTotal(o.mMask + 1)));
+            mKeyVals = static_cast<Node*>(DataPool::alloc(calcNumBytesTotal(o.mMask + 1), alignof(Node)));
             assert(mKeyVals);
 
             // no need for calloc here because cloneData performs a memcpy.
@@ -1275,21 +1315,15 @@ public:
         }
     }
 
+    // the pair is built from args, then moved into the node only if its key wasn't there
     template <typename... Args>
     DoInsertResult emplace(Args&&... args) {
         ROBIN_HOOD_TRACE(this);
-        Node n{*this, tl::forward<Args>(args)...};
-        auto r = doInsert(tl::move(n));
-        if (!r.sucess) {
-            // insertion not possible: destroy node
-            // NOLINTNEXTLINE(bugprone-use-after-move)
-            n.destroy(*this);
-        }
-        return r;
+        return doInsert(value_type(tl::forward<Args>(args)...));
     }
 
     DoInsertResult insert(tl::Pair<key_type, mapped_type>&& p) {
-        return doInsert(tl::move(p.second));
+        return doInsert(tl::move(p));
     }
 
     DoInsertResult insert(const tl::Pair<key_type, mapped_type>& p) {
@@ -1512,9 +1546,10 @@ private:
         mMask = max_elements - 1;
         mMaxNumElementsAllowed = calcMaxNumElementsAllowed(max_elements);
 
-        // calloc also zeroes everything
-        mKeyVals = reinterpret_cast<Node*>(calloc(1, calcNumBytesTotal(max_elements)));
+        const size_t numBytes = calcNumBytesTotal(max_elements);
+        mKeyVals = reinterpret_cast<Node*>(DataPool::alloc(numBytes, alignof(Node)));
         assert(mKeyVals);
+        memset((void*)mKeyVals, 0, numBytes);
         mInfo = reinterpret_cast<uint8_t*>(mKeyVals + max_elements);
 
         // set sentinel
@@ -1699,7 +1734,7 @@ private:
 
         Destroyer<Self, IsFlatMap && std::is_trivially_destructible<Node>::value>{}
             .nodesDoNotDeallocate(*this);
-        free(mKeyVals);
+        DataPool::free(mKeyVals);
     }
 
     void init() noexcept {
@@ -1726,20 +1761,25 @@ private:
 } // namespace detail
 
 template <typename Key, typename T, typename Hash = tl::hash<Key>,
-          typename KeyEqual = equal_to<Key>, size_t MaxLoadFactor100 = 80>
-using unordered_flat_map = detail::unordered_map<true, MaxLoadFactor100, Key, T, Hash, KeyEqual>;
+          typename KeyEqual = equal_to<Key>, size_t MaxLoadFactor100 = 80,
+          typename Alloc = tl::HeapAllocator>
+using unordered_flat_map =
+    detail::unordered_map<true, MaxLoadFactor100, Key, T, Hash, KeyEqual, Alloc>;
 
 template <typename Key, typename T, typename Hash = tl::hash<Key>,
-          typename KeyEqual = equal_to<Key>, size_t MaxLoadFactor100 = 80>
-using unordered_node_map = detail::unordered_map<false, MaxLoadFactor100, Key, T, Hash, KeyEqual>;
+          typename KeyEqual = equal_to<Key>, size_t MaxLoadFactor100 = 80,
+          typename Alloc = tl::HeapAllocator>
+using unordered_node_map =
+    detail::unordered_map<false, MaxLoadFactor100, Key, T, Hash, KeyEqual, Alloc>;
 
 template <typename Key, typename T, typename Hash = tl::hash<Key>,
-          typename KeyEqual = equal_to<Key>, size_t MaxLoadFactor100 = 80>
+          typename KeyEqual = equal_to<Key>, size_t MaxLoadFactor100 = 80,
+          typename Alloc = tl::HeapAllocator>
 using unordered_map =
     detail::unordered_map<sizeof(tl::Pair<Key, T>) <= sizeof(size_t) * 6 &&
                               std::is_nothrow_move_constructible<tl::Pair<Key, T>>::value &&
                               std::is_nothrow_move_assignable<tl::Pair<Key, T>>::value,
-                          MaxLoadFactor100, Key, T, Hash, KeyEqual>;
+                          MaxLoadFactor100, Key, T, Hash, KeyEqual, Alloc>;
 
 } // namespace rhood
 
@@ -1747,7 +1787,13 @@ namespace tl
 {
 
 template <typename Key, typename T, typename Hash = tl::hash<Key>,
-          typename KeyEqual = rhood::equal_to<Key>, size_t MaxLoadFactor100 = 80>
-using hash_map = rhood::unordered_map<Key, T, Hash, KeyEqual, MaxLoadFactor100>;
+          typename KeyEqual = rhood::equal_to<Key>, size_t MaxLoadFactor100 = 80,
+          typename Alloc = HeapAllocator>
+using hash_map = rhood::unordered_map<Key, T, Hash, KeyEqual, MaxLoadFactor100, Alloc>;
+
+// hash_map whose table and nodes live in an Arena
+template <typename Key, typename T, typename Hash = tl::hash<Key>,
+          typename KeyEqual = rhood::equal_to<Key>>
+using arena_hash_map = rhood::unordered_map<Key, T, Hash, KeyEqual, 80, ArenaAllocator>;
 
 }
@@ -0,0 +1,283 @@
+#pragma once
+
+#include <string.h>
+#include <tl/move.hpp>
+#include <tl/allocator.hpp>
+#include <tl/span.hpp>
+#include <tl/type_traits/is_trivially_relocatable.hpp>
+#include <assert.h>
+#include <new>
+#include <initializer_list>
+
+namespace tl
+{
+
+// Vector with room for N elements inside the object: it only allocates (with A, see allocator.hpp) when it grows
+// past N, for the lists that are short in the common case
+// Unlike Vector, moving it moves the elements one by one when they are inline
+template <typename T, size_t N, typename A = HeapAllocator>
+class SmallVector : private A
+{
+public:
+    static_assert(N > 0, "use Vector");
+    typedef T* iterator;
+    typedef const T* const_iterator;
+
+    SmallVector()noexcept : _data(inlineData()), _size(0), _capacity(N) {}
+    explicit SmallVector(const A& allocator)noexcept : A(allocator), _data(inlineData()), _size(0), _capacity(N) {}
+    SmallVector(const SmallVector& o)noexcept;
+    SmallVector(SmallVector&& o)noexcept;
+    SmallVector(std::initializer_list<T> il);
+    SmallVector(std::initializer_list<T> il, const A& allocator);
+    SmallVector& operator=(const SmallVector& o)noexcept;
+    SmallVector& operator=(SmallVector&& o)noexcept;
+    ~SmallVector();
+
+    operator Span<T>() { return Span<T>(_data, _size); }
+    operator Span<const T>()const { return Span<const T>(_data, _size); }
+
+    const T& operator[](size_t i)const noexcept {
+        assert(i < _size);
+        return _data[i];
+    }
+    T& operator[](size_t i)noexcept {
+        assert(i < _size);
+        return _data[i];
+    }
+
+    T* data() { return _data; }
+    const T* data()const { return _data; }
+
+    size_t size()const noexcept { return _size; }
+    size_t capacity()const noexcept { return _capacity; }
+    bool empty()const noexcept { return _size == 0; }
+    // false once it has spilled to the heap
+    bool isInline()const noexcept { return _data == inlineData(); }
+
+    iterator begin()noexcept { return _data; }
+    const_iterator begin()const noexcept { return _data; }
+    iterator end()noexcept { return _data + _size; }
+    const_iterator end()const noexcept { return _data + _size; }
+
+    T& back()noexcept {
+        assert(_size != 0);
+        return _data[_size-1];
+    }
+    const T& back()const noexcept {
+        assert(_size != 0);
+        return _data[_size-1];
+    }
+
+    void push_back(const T& e)noexcept { emplace_back(e); }
+    void push_back(T&& e)noexcept { emplace_back(tl::move(e)); }
+    template<typename... Args>
+    void emplace_back(Args&&... args)noexcept;
+    // span can be a part of this vector
+    void append(Span<const T> span)noexcept;
+
+    void pop_back()noexcept;
+    void clear()noexcept { resize(0); }
+
+    void reserve(size_t capacity)noexcept;
+    template <typename... ConstructorArgs>
+    void resize(size_t size, ConstructorArgs&&... args)noexcept;
+
+    const A& allocator()const { return *this; }
+
+private:
+    T* inlineData() { return reinterpret_cast<T*>(_inline); }
+    const T* inlineData()const { return reinterpret_cast<const T*>(_inline); }
+    void grow(size_t capacity)noexcept;
+    template<typename... Args>
+    void growAndEmplaceBack(Args&&... args)noexcept;
+    void destroyAll()noexcept;
+
+    T* _data; // _inline or a heap allocation
+    size_t _size;
+    size_t _capacity;
+    alignas(T) char _inline[sizeof(T) * N];
+};
+
+template <typename T, size_t N, typename A>
+SmallVector<T, N, A>::SmallVector(const SmallVector& o)noexcept
+    : A(o.allocator()), _data(inlineData()), _size(0), _capacity(N)
+{
+    append(o);
+}
+
+template <typename T, size_t N, typename A>
+SmallVector<T, N, A>::SmallVector(SmallVector&& o)noexcept
+    : A(o.allocator()), _data(inlineData()), _size(0), _capacity(N)
+{
+    *this = tl::move(o);
+}
+
+template <typename T, size_t N, typename A>
+SmallVector<T, N, A>::SmallVector(std::initializer_list<T> il)
+    : SmallVector(il, A())
+{}
+
+template <typename T, size_t N, typename A>
+SmallVector<T, N, A>::SmallVector(std::initializer_list<T> il, const A& allocator)
+    : SmallVector(allocator)
+{
+    append({il.begin(), il.size()});
+}
+
+template <typename T, size_t N, typename A>
+SmallVector<T, N, A>& SmallVector<T, N, A>::operator=(const SmallVector& o)noexcept
+{
+    if(this == &o)
+        return *this;
+    resize(0);
+    append(o);
+    return *this;
+}
+
+template <typename T, size_t N, typename A>
+SmallVector<T, N, A>& SmallVector<T, N, A>::operator=(SmallVector&& o)noexcept
+{
+    if(this == &o)
+        return *this;
+    destroyAll();
+    A::operator=(o.allocator());
+    if(o.isInline()) {
+        _data = inlineData();
+        _capacity = N;
+        for(size_t i = 0; i < o._size; i++)
+            new ((void*)&_data[i]) T(tl::move(o._data[i]));
+        _size = o._size;
+        o.resize(0);
+    }
+    else {
+        _data = o._data;
+        _size = o._size;
+        _capacity = o._capacity;
+        o._data = o.inlineData();
+        o._size = 0;
+        o._capacity = N;
+    }
+    return *this;
+}
+
+template <typename T, size_t N, typename A>
+SmallVector<T, N, A>::~SmallVector()
+{
+    destroyAll();
+}
+
+template <typename T, size_t N, typename A>
+template <typename... Args>
+void SmallVector<T, N, A>::emplace_back(Args&&... args)noexcept
+{
+    if(_size == _capacity) {
+        growAndEmplaceBack(tl::forward<Args>(args)...);
+        return;
+    }
+    new ((void*)&_data[_size]) T(tl::forward<Args>(args)...);
+    _size++;
+}
+
+template <typename T, size_t N, typename A>
+template <typename... Args>
+void SmallVector<T, N, A>::growAndEmplaceBack(Args&&... args)noexcept
+{
+    // the arguments can reference elements of this vector, so the element is constructed before growing
+    T x(tl::forward<Args>(args)...);
+    grow(_size + 1);
+    new ((void*)&_data[_size]) T(tl::move(x));
+    _size++;
+}
+
+template <typename T, size_t N, typename A>
+void SmallVector<T, N, A>::append(Span<const T> span)noexcept
+{
+    const size_t n = span.size();
+    if(n == 0)
+        return;
+    // an index, not a pointer, into this vector: grow() can free the old storage
+    const bool isInside = span.begin() >= _data && span.begin() < _data + _size;
+    const size_t offset = isInside ? size_t(span.begin() - _data) : 0;
+    if(_size + n > _capacity)
+        grow(_size + n);
+    const T* src = isInside ? _data + offset : span.begin();
+    if constexpr(std::is_trivially_copyable<T>::value) {
+        memcpy((void*)(_data + _size), src, n * sizeof(T));
+    }
+    else {
+        for(size_t i = 0; i < n; i++)
+            new ((void*)&_data[_size + i]) T(src[i]);
+    }
+    _size += n;
+}
+
+template <typename T, size_t N, typename A>
+void SmallVector<T, N, A>::pop_back()noexcept
+{
+    assert(_size != 0);
+    _size--;
+    _data[_size].~T();
+}
+
+template <typename T, size_t N, typename A>
+void SmallVector<T, N, A>::reserve(size_t capacity)noexcept
+{
+    if(capacity <= _capacity)
+        return;
+    if constexpr(is_trivially_relocatable<T>::value) {
+        if(!isInline()) {
+            _data = reinterpret_cast<T*>(A::realloc(_data, sizeof(T) * _size, sizeof(T) * capacity, alignof(T)));
+            _capacity = capacity;
+            return;
+        }
+    }
+    else {
+        // an arena can extend the last allocation in place
+        if(!isInline() && A::grow(_data, sizeof(T) * capacity)) {
+            _capacity = capacity;
+            return;
+        }
+    }
+    T* data = reinterpret_cast<T*>(A::alloc(sizeof(T) * capacity, alignof(T)));
+    for(size_t i = 0; i < _size; i++) {
+        new ((void*)&data[i]) T(tl::move(_data[i]));
+        _data[i].~T();
+    }
+    if(!isInline())
+        A::free(_data);
+    _data = data;
+    _capacity = capacity;
+}
+
+template <typename T, size_t N, typename A>
+template <typename... ConstructorArgs>
+void SmallVector<T, N, A>::resize(size_t size, ConstructorArgs&&... args)noexcept
+{
+    if(size > _capacity)
+        grow(size);
+    for(size_t i = size; i < _size; i++)
+        _data[i].~T();
+    for(size_t i = _size; i < size; i++)
+        new ((void*)&_data[i]) T(tl::forward<ConstructorArgs>(args)...);
+    _size = size;
+}
+
+template <typename T, size_t N, typename A>
+void SmallVector<T, N, A>::grow(size_t capacity)noexcept
+{
+    reserve(capacity > 2 * _capacity ? capacity : 2 * _capacity);
+}
+
+template <typename T, size_t N, typename A>
+void SmallVector<T, N, A>::destroyAll()noexcept
+{
+    for(size_t i = 0; i < _size; i++)
+        _data[i].~T();
+    if(!isInline())
+        A::free(_data);
+    _data = inlineData();
+    _size = 0;
+    _capacity = N;
+}
+
+}
@@ -0,0 +1,469 @@
+#pragma once
+
+#include <string.h>
+#include <tl/int_types.hpp>
+#include <tl/basic.hpp>
+#include <tl/move.hpp>
+#include <tl/span.hpp>
+#include <tl/allocator.hpp>
+#include <tl/containers/hash_map.hpp>
+#include <assert.h>
+#include <new>
+
+#if defined(__SSE2__) || defined(_M_X64)
+    #include <emmintrin.h>
+    #define TL_SSE2 1
+#else
+    #define TL_SSE2 0
+#endif
+
+// Alternative layout of hash_map for the big tables, in the style of Abseil's Swiss tables
+// The slots are in groups of 16, each with 16 control bytes: the 7 low bits of the hash when the slot is used, or
+// empty/deleted. A lookup compares the 16 control bytes of a group at once with SSE2, and only looks at the slots
+// whose bits matched
+// The control bytes of a group are stored right before its slots, so the two dependent loads of a lookup are in
+// the same page: with a big table a lookup costs one TLB miss, not two
+// The groups are probed from hash >> 7 in triangular order, and the probe stops at the first group with an empty
+// slot. Max load factor 7/8
+
+namespace tl
+{
+
+namespace swiss
+{
+
+constexpr i8 k_empty = -128;
+constexpr i8 k_deleted = -2;
+constexpr u32 k_groupSize = 16;
+
+// all empty, the control bytes of a map without allocation
+alignas(16) inline const i8 k_emptyGroup[k_groupSize] = {
+    k_empty, k_empty, k_empty, k_empty, k_empty, k_empty, k_empty, k_empty,
+    k_empty, k_empty, k_empty, k_empty, k_empty, k_empty, k_empty, k_empty,
+};
+
+// the masks have a bit per slot of the group
+struct Group {
+#if TL_SSE2
+    __m128i ctrl;
+    explicit Group(const i8* p) : ctrl(_mm_load_si128((const __m128i*)p)) {}
+    u32 match(i8 h2)const { return (u32)_mm_movemask_epi8(_mm_cmpeq_epi8(ctrl, _mm_set1_epi8(h2))); }
+    u32 matchEmpty()const { return match(k_empty); }
+    u32 matchFree()const { return (u32)_mm_movemask_epi8(ctrl); } // empty or deleted: the sign bit is set
+#else
+    const i8* ctrl;
+    explicit Group(const i8* p) : ctrl(p) {}
+    u32 match(i8 h2)const
+    {
+        u32 mask = 0;
+        for(u32 i = 0; i < k_groupSize; i++)
+            mask |= u32(ctrl[i] == h2) << i;
+        return mask;
+    }
+    u32 matchEmpty()const { return match(k_empty); }
+    u32 matchFree()const
+    {
+        u32 mask = 0;
+        for(u32 i = 0; i < k_groupSize; i++)
+            mask |= u32(ctrl[i] < 0) << i;
+        return mask;
+    }
+#endif
+    u32 matchUsed()const { return ~matchFree() & 0xFFFF; }
+};
+
+inline u32 lowestBit(u32 mask)
+{
+    assert(mask);
+#ifdef _MSC_VER
+    unsigned long i;
+    _BitScanForward(&i, mask);
+    return (u32)i;
+#else
+    return (u32)__builtin_ctz(mask);
+#endif
+}
+
+inline void prefetch(const void* p)
+{
+#if TL_SSE2
+    _mm_prefetch((const char*)p, _MM_HINT_T0);
+#else
+    __builtin_prefetch(p);
+#endif
+}
+
+}
+
+template <typename Key, typename T, typename Hash = tl::hash<Key>, typename KeyEqual = rhood::equal_to<Key>,
+          typename A = HeapAllocator>
+class SwissMap : private A
+{
+public:
+    struct Slot {
+        Key key;
+        T value;
+    };
+
+    SwissMap() = default;
+    explicit SwissMap(const A& allocator) : A(allocator) {}
+    SwissMap(const SwissMap& o);
+    SwissMap(SwissMap&& o)noexcept;
+    SwissMap& operator=(const SwissMap& o);
+    SwissMap& operator=(SwissMap&& o)noexcept;
+    ~SwissMap();
+
+    size_t size()const { return _size; }
+    bool empty()const { return _size == 0; }
+    size_t capacity()const { return _numGroups * swiss::k_groupSize; }
+
+    T* find(const Key& key)
+    {
+        Slot* slot = findSlot(key, Hash{}(key));
+        return slot ? &slot->value : nullptr;
+    }
+    const T* find(const Key& key)const { return const_cast<SwissMap*>(this)->find(key); }
+    bool contains(const Key& key)const { return find(key) != nullptr; }
+    // results[i] = find(keys[i]). The lookups are interleaved in batches, prefetching the control bytes of all the
+    // keys of a batch and then the slots, so the cache misses of a batch overlap
+    void findBatch(Span<const Key> keys, Span<T*> results);
+
+    // the value is default constructed if the key wasn't there
+    T& operator[](const Key& key);
+    // returns false, without modifying the value, when the key was already there
+    template <typename... Args>
+    bool emplace(const Key& key, Args&&... args);
+    bool insert(const Key& key, const T& value) { return emplace(key, value); }
+    bool insert(const Key& key, T&& value) { return emplace(key, tl::move(value)); }
+    bool erase(const Key& key);
+
+    void clear();
+    // makes room for n elements without rehashing
+    void reserve(size_t n);
+
+    // fn(const Key&, T&)
+    template <typename Fn>
+    void forEach(const Fn& fn);
+    template <typename Fn>
+    void forEach(const Fn& fn)const { const_cast<SwissMap*>(this)->forEach(fn); }
+
+    const A& allocator()const { return *this; }
+
+private:
+    // a group: 16 control bytes, then the 16 slots
+    static constexpr size_t k_slotsOffset = alignof(Slot) > 16 ? alignof(Slot) : 16;
+    static constexpr size_t k_groupBytes =
+        (k_slotsOffset + swiss::k_groupSize * sizeof(Slot) + k_slotsOffset - 1) & ~(k_slotsOffset - 1);
+
+    static constexpr size_t maxLoad(size_t capacity) { return capacity - capacity / 8; }
+    static size_t groupIndex(size_t hash, size_t mask) { return (hash >> 7) & mask; }
+    static i8 h2(size_t hash) { return i8(hash & 0x7F); }
+
+    // with no allocation the mask is 0 and group 0 is k_emptyGroup
+    size_t groupMask()const { return _numGroups ? _numGroups - 1 : 0; }
+    i8* groupCtrl(size_t g)const { return (i8*)(_groups + g * k_groupBytes); }
+    Slot* groupSlots(size_t g)const { return (Slot*)(_groups + g * k_groupBytes + k_slotsOffset); }
+
+    // the first group is probed here, small enough to be inlined: it has the key or ends the probe almost always
+    Slot* findSlot(const Key& key, size_t hash)
+    {
+        const size_t g = groupIndex(hash, groupMask());
+        const swiss::Group group(groupCtrl(g));
+        for(u32 m = group.match(h2(hash)); m; m &= m - 1) {
+            Slot& slot = groupSlots(g)[swiss::lowestBit(m)];
+            if(KeyEqual{}(slot.key, key))
+                return &slot;
+        }
+        if(group.matchEmpty())
+            return nullptr;
+        return findSlotInNextGroups(key, hash);
+    }
+    Slot* findSlotInNextGroups(const Key& key, size_t hash);
+    // claims a free slot for a key that isn't in the map, growing if needed. The caller constructs the key and the
+    // value
+    Slot* prepareInsert(size_t hash);
+    void findFreeSlot(size_t hash, size_t& g, u32& i)const;
+    void rehash(size_t numGroups);
+    void destroyAll();
+
+    u8* _groups = (u8*)swiss::k_emptyGroup;
+    size_t _numGroups = 0;
+    size_t _size = 0;
+    size_t _growthLeft = 0; // insertions in empty slots before the next rehash
+};
+
+template <typename Key, typename T, typename Hash, typename KeyEqual, typename A>
+SwissMap<Key, T, Hash, KeyEqual, A>::SwissMap(const SwissMap& o)
+    : A(o.allocator())
+{
+    *this = o;
+}
+
+template <typename Key, typename T, typename Hash, typename KeyEqual, typename A>
+SwissMap<Key, T, Hash, KeyEqual, A>::SwissMap(SwissMap&& o)noexcept
+    : A(o.allocator())
+{
+    *this = tl::move(o);
+}
+
+template <typename Key, typename T, typename Hash, typename KeyEqual, typename A>
+SwissMap<Key, T, Hash, KeyEqual, A>& SwissMap<Key, T, Hash, KeyEqual, A>::operator=(const SwissMap& o)
+{
+    if(this == &o)
+        return *this;
+    clear();
+    reserve(o._size);
+    o.forEach([this](const Key& key, const T& value) {
+        emplace(key, value);
+    });
+    return *this;
+}
+
+template <typename Key, typename T, typename Hash, typename KeyEqual, typename A>
+SwissMap<Key, T, Hash, KeyEqual, A>& SwissMap<Key, T, Hash, KeyEqual, A>::operator=(SwissMap&& o)noexcept
+{
+    if(this == &o)
+        return *this;
+    destroyAll();
+    A::operator=(o.allocator());
+    _groups = o._groups;
+    _numGroups = o._numGroups;
+    _size = o._size;
+    _growthLeft = o._growthLeft;
+    o._groups = (u8*)swiss::k_emptyGroup;
+    o._numGroups = o._size = o._growthLeft = 0;
+    return *this;
+}
+
+template <typename Key, typename T, typename Hash, typename KeyEqual, typename A>
+SwissMap<Key, T, Hash, KeyEqual, A>::~SwissMap()
+{
+    destroyAll();
+}
+
+template <typename Key, typename T, typename Hash, typename KeyEqual, typename A>
+typename SwissMap<Key, T, Hash, KeyEqual, A>::Slot* SwissMap<Key, T, Hash, KeyEqual, A>::findSlotInNextGroups(
+    const Key& key, size_t hash)
+{
+    const size_t mask = groupMask();
+    const i8 tag = h2(hash);
+    size_t g = (groupIndex(hash, mask) + 1) & mask;
+    for(size_t step = 2; ; step++) {
+        const swiss::Group group(groupCtrl(g));
+        for(u32 m = group.match(tag); m; m &= m - 1) {
+            Slot& slot = groupSlots(g)[swiss::lowestBit(m)];
+            if(KeyEqual{}(slot.key, key))
+                return &slot;
+        }
+        if(group.matchEmpty())
+            return nullptr;
+        g = (g + step) & mask;
+    }
+}
+
+template <typename Key, typename T, typename Hash, typename KeyEqual, typename A>
+void SwissMap<Key, T, Hash, KeyEqual, A>::findBatch(Span<const Key> keys, Span<T*> results)
+{
+    assert(keys.size() == results.size());
+    constexpr size_t batchSize = 16;
+    const size_t mask = groupMask();
+    for(size_t begin = 0; begin < keys.size(); begin += batchSize) {
+        const size_t n = tl::min(batchSize, keys.size() - begin);
+        size_t hashes[batchSize];
+        u32 matches[batchSize];
+        for(size_t i = 0; i < n; i++) {
+            hashes[i] = Hash{}(keys[begin + i]);
+            swiss::prefetch(groupCtrl(groupIndex(hashes[i], mask)));
+        }
+        // the slot of the first match in the first group, the one found almost always
+        for(size_t i = 0; i < n; i++) {
+            const size_t g = groupIndex(hashes[i], mask);
+            matches[i] = swiss::Group(groupCtrl(g)).match(h2(hashes[i]));
+            if(matches[i])
+                swiss::prefetch(&groupSlots(g)[swiss::lowestBit(matches[i])]);
+        }
+        for(size_t i = 0; i < n; i++) {
+            const Key& key = keys[begin + i];
+            const size_t g = groupIndex(hashes[i], mask);
+            Slot* found = nullptr;
+            for(u32 m = matches[i]; m && !found; m &= m - 1) {
+                Slot& slot = groupSlots(g)[swiss::lowestBit(m)];
+                if(KeyEqual{}(slot.key, key))
+                    found = &slot;
+            }
+            if(!found && !swiss::Group(groupCtrl(g)).matchEmpty())
+                found = findSlotInNextGroups(key, hashes[i]);
+            results[begin + i] = found ? &found->value : nullptr;
+        }
+    }
+}
+
+template <typename Key, typename T, typename Hash, typename KeyEqual, typename A>
+T& SwissMap<Key, T, Hash, KeyEqual, A>::operator[](const Key& key)
+{
+    const size_t hash = Hash{}(key);
+    if(Slot* slot = findSlot(key, hash))
+        return slot->value;
+    Slot* slot = prepareInsert(hash);
+    new (&slot->key) Key(key);
+    new (&slot->value) T();
+    return slot->value;
+}
+
+template <typename Key, typename T, typename Hash, typename KeyEqual, typename A>
+template <typename... Args>
+bool SwissMap<Key, T, Hash, KeyEqual, A>::emplace(const Key& key, Args&&... args)
+{
+    const size_t hash = Hash{}(key);
+    if(findSlot(key, hash))
+        return false;
+    Slot* slot = prepareInsert(hash);
+    new (&slot->key) Key(key);
+    new (&slot->value) T(tl::forward<Args>(args)...);
+    return true;
+}
+
+template <typename Key, typename T, typename Hash, typename KeyEqual, typename A>
+bool SwissMap<Key, T, Hash, KeyEqual, A>::erase(const Key& key)
+{
+    Slot* slot = findSlot(key, Hash{}(key));
+    if(!slot)
+        return false;
+    const size_t g = ((u8*)slot - _groups) / k_groupBytes;
+    const size_t i = slot - groupSlots(g);
+    slot->key.~Key();
+    slot->value.~T();
+    // the probes stop at a group with an empty slot, so none of them can go past this group if it already had one.
+    // Otherwise the slot is marked as deleted to keep the probes going
+    i8* ctrl = groupCtrl(g);
+    if(swiss::Group(ctrl).matchEmpty()) {
+        ctrl[i] = swiss::k_empty;
+        _growthLeft++;
+    }
+    else {
+        ctrl[i] = swiss::k_deleted;
+    }
+    _size--;
+    return true;
+}
+
+template <typename Key, typename T, typename Hash, typename KeyEqual, typename A>
+void SwissMap<Key, T, Hash, KeyEqual, A>::clear()
+{
+    for(size_t g = 0; g < _numGroups; g++) {
+        i8* ctrl = groupCtrl(g);
+        for(u32 m = swiss::Group(ctrl).matchUsed(); m; m &= m - 1) {
+            Slot& slot = groupSlots(g)[swiss::lowestBit(m)];
+            slot.key.~Key();
+            slot.value.~T();
+        }
+        memset(ctrl, swiss::k_empty, swiss::k_groupSize);
+    }
+    _size = 0;
+    _growthLeft = maxLoad(capacity());
+}
+
+template <typename Key, typename T, typename Hash, typename KeyEqual, typename A>
+void SwissMap<Key, T, Hash, KeyEqual, A>::reserve(size_t n)
+{
+    size_t numGroups = tl::max<size_t>(1, _numGroups);
+    while(maxLoad(numGroups * swiss::k_groupSize) < n)
+        numGroups *= 2;
+    if(numGroups > _numGroups)
+        rehash(numGroups);
+}
+
+template <typename Key, typename T, typename Hash, typename KeyEqual, typename A>
+template <typename Fn>
+void SwissMap<Key, T, Hash, KeyEqual, A>::forEach(const Fn& fn)
+{
+    for(size_t g = 0; g < _numGroups; g++) {
+        for(u32 m = swiss::Group(groupCtrl(g)).matchUsed(); m; m &= m - 1) {
+            Slot& slot = groupSlots(g)[swiss::lowestBit(m)];
+            fn((const Key&)slot.key, slot.value);
+        }
+    }
+}
+
+template <typename Key, typename T, typename Hash, typename KeyEqual, typename A>
+typename SwissMap<Key, T, Hash, KeyEqual, A>::Slot* SwissMap<Key, T, Hash, KeyEqual, A>::prepareInsert(size_t hash)
+{
+    size_t g;
+    u32 i;
+    findFreeSlot(hash, g, i);
+    // a map without allocation gets here too: its group is empty, and it has no growth left
+    if(_growthLeft == 0 && groupCtrl(g)[i] == swiss::k_empty) {
+        // a table with many deleted slots is rehashed to the same size, to clean them up
+        const bool isFull = _size + 1 > maxLoad(capacity()) / 2;
+        rehash(isFull ? tl::max<size_t>(1, 2 * _numGroups) : _numGroups);
+        findFreeSlot(hash, g, i);
+    }
+    i8* ctrl = groupCtrl(g);
+    if(ctrl[i] == swiss::k_empty)
+        _growthLeft--;
+    ctrl[i] = h2(hash);
+    _size++;
+    return &groupSlots(g)[i];
+}
+
+template <typename Key, typename T, typename Hash, typename KeyEqual, typename A>
+void SwissMap<Key, T, Hash, KeyEqual, A>::findFreeSlot(size_t hash, size_t& g, u32& i)const
+{
+    const size_t mask = groupMask();
+    g = groupIndex(hash, mask);
+    for(size_t step = 1; ; step++) {
+        if(const u32 m = swiss::Group(groupCtrl(g)).matchFree()) {
+            i = swiss::lowestBit(m);
+            return;
+        }
+        g = (g + step) & mask;
+    }
+}
+
+template <typename Key, typename T, typename Hash, typename KeyEqual, typename A>
+void SwissMap<Key, T, Hash, KeyEqual, A>::rehash(size_t numGroups)
+{
+    assert(numGroups && (numGroups & (numGroups - 1)) == 0);
+    u8* oldGroups = _groups;
+    const size_t oldNumGroups = _numGroups;
+
+    _groups = (u8*)A::alloc(numGroups * k_groupBytes, k_slotsOffset);
+    _numGroups = numGroups;
+    for(size_t g = 0; g < numGroups; g++)
+        memset(groupCtrl(g), swiss::k_empty, swiss::k_groupSize);
+
+    for(size_t oldG = 0; oldG < oldNumGroups; oldG++) {
+        const i8* oldCtrl = (const i8*)(oldGroups + oldG * k_groupBytes);
+        Slot* oldSlots = (Slot*)(oldGroups + oldG * k_groupBytes + k_slotsOffset);
+        for(u32 m = swiss::Group(oldCtrl).matchUsed(); m; m &= m - 1) {
+            Slot& oldSlot = oldSlots[swiss::lowestBit(m)];
+            const size_t hash = Hash{}(oldSlot.key);
+            size_t g;
+            u32 i;
+            findFreeSlot(hash, g, i);
+            groupCtrl(g)[i] = h2(hash);
+            Slot& slot = groupSlots(g)[i];
+            new (&slot.key) Key(tl::move(oldSlot.key));
+            new (&slot.value) T(tl::move(oldSlot.value));
+            oldSlot.key.~Key();
+            oldSlot.value.~T();
+        }
+    }
+    _growthLeft = maxLoad(capacity()) - _size;
+    if(oldNumGroups)
+        A::free(oldGroups);
+}
+
+template <typename Key, typename T, typename Hash, typename KeyEqual, typename A>
+void SwissMap<Key, T, Hash, KeyEqual, A>::destroyAll()
+{
+    if(_numGroups == 0)
+        return;
+    clear();
+    A::free(_groups);
+    _groups = (u8*)swiss::k_emptyGroup;
+    _numGroups = 0;
+    _growthLeft = 0;
+}
+
+}
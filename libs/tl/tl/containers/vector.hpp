@@ -3,32 +3,47 @@
 #include <string.h>
 #include <tl/basic_math.hpp>
 #include <tl/move.hpp>
+#include <tl/allocator.hpp>
+#include <tl/span.hpp>
+#include <tl/type_traits/is_trivially_relocatable.hpp>
 #include <assert.h>
 #include <new>
 #include <initializer_list>
+#include <type_traits>
 
 namespace tl
 {
 
-template<typename T>
-class Vector
+// A: allocator handle, see allocator.hpp. It's copied by the copy constructor and taken by the move operations,
+// but the copy assignment keeps the one of the destination
+// The trivially relocatable elements (see is_trivially_relocatable.hpp) are moved to the new storage with
+// A::realloc() when the vector grows, the others one by one
+template<typename T, typename A = HeapAllocator>
+class Vector : private A
 {
 public:
     typedef T* iterator;
     typedef const T* const_iterator;
 
     Vector()noexcept : _data(nullptr), _size(0), _capacity(0) {}
+    explicit Vector(const A& allocator)noexcept : A(allocator), _data(nullptr), _size(0), _capacity(0) {}
     Vector(const Vector& o)noexcept;
     Vector(Vector&& o)noexcept;
     Vector(size_t size)noexcept;
+    Vector(size_t size, const A& allocator)noexcept;
     Vector(size_t size, const T& val)noexcept;
+    Vector(size_t size, const T& val, const A& allocator)noexcept;
     Vector(std::initializer_list<T> il);
+    Vector(std::initializer_list<T> il, const A& allocator);
     Vector& operator=(const Vector& o)noexcept;
     Vector& operator=(Vector&& o)noexcept;
     Vector& operator=(std::initializer_list<T> il);
 
-    template<typename Iterator>
+    // not for integers, so that Vector(size, val) and Vector(size, allocator) aren't taken for iterators
+    template<typename Iterator, typename = std::enable_if_t<!std::is_integral<Iterator>::value>>
     Vector(Iterator begin, Iterator end);
+    template<typename Iterator, typename = std::enable_if_t<!std::is_integral<Iterator>::value>>
+    Vector(Iterator begin, Iterator end, const A& allocator);
 
     ~Vector();
 
@@ -67,6 +82,8 @@ public:
 
     template<typename... Args>
     void emplace_back(Args&&... args)noexcept;
+    // copies the elements at the end, with memcpy when they are trivially copyable. span can be a part of this vector
+    void append(Span<const T> span)noexcept;
 
     void pop_back()noexcept;
 
@@ -78,37 +95,56 @@ public:
     template<typename Fn>
     int findIndexCond(const Fn& fn);
 
+    const A& allocator()const { return *this; }
+
 private:
+    // at least capacity, and double the current one, so pushing n elements moves O(n) of them in total
     void grow(size_t capacity)noexcept;
+    template<typename... Args>
+    void growAndEmplaceBack(Args&&... args)noexcept;
 
     T* _data;
     size_t _size;
     size_t _capacity;
 };
 
-template <typename T>
-Vector<T>::Vector(const Vector& o)noexcept
-    : Vector()
+template <typename T, typename A>
+Vector<T, A>::Vector(const Vector& o)noexcept
+    : A(o.allocator()), _data(nullptr), _size(0), _capacity(0)
 {
     *this = o;
 }
 
-template <typename T>
-Vector<T>::Vector(Vector&& o)noexcept
+template <typename T, typename A>
+Vector<T, A>::Vector(Vector&& o)noexcept
+    : A(o.allocator()), _data(o._data), _size(o._size), _capacity(o._capacity)
 {
-    *this = static_cast<Vector&&>(o);
+    o._size = o._capacity = 0;
+    o._data = nullptr;
 }
 
-template <typename T>
-Vector<T>::Vector(size_t size)noexcept
-    : Vector()
+// the constructors without allocator need A to be default constructible
+
+template <typename T, typename A>
+Vector<T, A>::Vector(size_t size)noexcept
+    : Vector(size, A())
+{}
+
+template <typename T, typename A>
+Vector<T, A>::Vector(size_t size, const A& allocator)noexcept
+    : Vector(allocator)
 {
     resize(size);
 }
 
-template <typename T>
-Vector<T>::Vector(size_t size, const T& val)noexcept
-    : Vector()
+template <typename T, typename A>
+Vector<T, A>::Vector(size_t size, const T& val)noexcept
+    : Vector(size, val, A())
+{}
+
+template <typename T, typename A>
+Vector<T, A>::Vector(size_t size, const T& val, const A& allocator)noexcept
+    : Vector(allocator)
 {
     grow(size);
     for(size_t i = 0; i < size; i++) {
@@ -117,29 +153,37 @@ Vector<T>::Vector(size_t size, const T& val)noexcept
     _size = size;
 }
 
-template <typename T>
-Vector<T>::Vector(std::initializer_list<T> il)
-    : Vector()
+template <typename T, typename A>
+Vector<T, A>::Vector(std::initializer_list<T> il)
+    : Vector(il, A())
+{}
+
+template <typename T, typename A>
+Vector<T, A>::Vector(std::initializer_list<T> il, const A& allocator)
+    : Vector(allocator)
 {
     *this = il;
 }
 
-template <typename T>
-Vector<T>& Vector<T>::operator=(const Vector& o)noexcept
+template <typename T, typename A>
+Vector<T, A>& Vector<T, A>::operator=(const Vector& o)noexcept
 {
+    if(this == &o)
+        return *this;
     resize(0);
-    _size = o._size;
-    _capacity = o._capacity;
-    grow(_capacity);
-    for(size_t i=0; i<_size; i++) {
-        new (&_data[i]) T(o[i]);
-    }
+    reserve(o._size);
+    append({o._data, o._size});
     return *this;
 }
 
-template <typename T>
-Vector<T>& Vector<T>::operator=(Vector&& o)noexcept
+template <typename T, typename A>
+Vector<T, A>& Vector<T, A>::operator=(Vector&& o)noexcept
 {
+    if(this == &o)
+        return *this;
+    resize(0);
+    A::free(_data);
+    A::operator=(o.allocator());
     _size = o._size;
     _capacity = o._capacity;
     _data = o._data;
@@ -148,8 +192,8 @@ Vector<T>& Vector<T>::operator=(Vector&& o)noexcept
     return *this;
 }
 
-template <typename T>
-Vector<T>& Vector<T>::operator=(std::initializer_list<T> il)
+template <typename T, typename A>
+Vector<T, A>& Vector<T, A>::operator=(std::initializer_list<T> il)
 {
     resize(0);
     grow(il.size());
@@ -159,80 +203,122 @@ Vector<T>& Vector<T>::operator=(std::initializer_list<T> il)
         new (&_data[i]) T(*it);
         it++;
     }
+    return *this;
 }
 
-template <typename T>
-template<typename Iterator>
-Vector<T>::Vector(Iterator begin, Iterator end)
-    : Vector()
+template <typename T, typename A>
+template<typename Iterator, typename>
+Vector<T, A>::Vector(Iterator begin, Iterator end)
+    : Vector(begin, end, A())
+{}
+
+template <typename T, typename A>
+template<typename Iterator, typename>
+Vector<T, A>::Vector(Iterator begin, Iterator end, const A& allocator)
+    : Vector(allocator)
 {
     for(auto it = begin; it != end; ++it) {
         push_back(*it);
     }
 }
 
-template <typename T>
-Vector<T>::~Vector()
+template <typename T, typename A>
+Vector<T, A>::~Vector()
 {
     for(size_t i = 0; i < _size; i++)
         _data[i].~T();
-    if(_data)
-        delete[] (char*)_data;
+    A::free(_data);
 }
 
-template <typename T>
-void Vector<T>::push_back(const T& e)noexcept
+template <typename T, typename A>
+void Vector<T, A>::push_back(const T& e)noexcept
 {
-    if(_size == _capacity)
-        grow(_capacity+1);
-    new ((void*)&_data[_size]) T(e);
-    _size++;
+    emplace_back(e);
 }
 
-template <typename T>
-void Vector<T>::push_back(T&& e)noexcept
+template <typename T, typename A>
+void Vector<T, A>::push_back(T&& e)noexcept
 {
-    if(_size == _capacity)
-        grow(_capacity+1);
-    new ((void*)&_data[_size]) T(tl::move(e));
-    _size++;
+    emplace_back(tl::move(e));
 }
 
-template <typename T>
+template <typename T, typename A>
 template <typename... Args>
-void Vector<T>::emplace_back(Args&&... args)noexcept
+void Vector<T, A>::emplace_back(Args&&... args)noexcept
 {
-    if(_size == _capacity)
-        grow(_capacity+1);
+    if(_size == _capacity) {
+        growAndEmplaceBack(tl::forward<Args>(args)...);
+        return;
+    }
     new ((void*)&_data[_size]) T(tl::forward<Args>(args)...);
     _size++;
 }
 
-template <typename T>
-void Vector<T>::pop_back()noexcept
+template <typename T, typename A>
+template <typename... Args>
+void Vector<T, A>::growAndEmplaceBack(Args&&... args)noexcept
+{
+    // the arguments can reference elements of this vector, so the element is constructed before growing
+    T x(tl::forward<Args>(args)...);
+    grow(_size + 1);
+    new ((void*)&_data[_size]) T(tl::move(x));
+    _size++;
+}
+
+template <typename T, typename A>
+void Vector<T, A>::append(Span<const T> span)noexcept
+{
+    const size_t n = span.size();
+    if(n == 0)
+        return;
+    // an index, not a pointer, into this vector: grow() can free the old storage
+    const bool isInside = span.begin() >= _data && span.begin() < _data + _size;
+    const size_t offset = isInside ? size_t(span.begin() - _data) : 0;
+    if(_size + n > _capacity)
+        grow(_size + n);
+    const T* src = isInside ? _data + offset : span.begin();
+    if constexpr(std::is_trivially_copyable<T>::value) {
+        memcpy((void*)(_data + _size), src, n * sizeof(T));
+    }
+    else {
+        for(size_t i = 0; i < n; i++)
+            new ((void*)&_data[_size + i]) T(src[i]);
+    }
+    _size += n;
+}
+
+template <typename T, typename A>
+void Vector<T, A>::pop_back()noexcept
 {
     assert(_size != 0);
     _size--;
     _data[_size].~T();
 }
 
-template <typename T>
-void Vector<T>::reserve(size_t capacity)noexcept
+template <typename T, typename A>
+void Vector<T, A>::reserve(size_t capacity)noexcept
 {
-    if(capacity > _capacity) {
-        T* data = reinterpret_cast<T*>(new char[sizeof(T) * capacity]);
-        if(_data) {
-            memcpy(data, _data, _size * sizeof(T));
-            delete[] (char*)_data;
+    if(capacity <= _capacity)
+        return;
+    if constexpr(is_trivially_relocatable<T>::value) {
+        _data = reinterpret_cast<T*>(A::realloc(_data, sizeof(T) * _size, sizeof(T) * capacity, alignof(T)));
+    }
+    // an arena can extend the last allocation in place
+    else if(!_data || !A::grow(_data, sizeof(T) * capacity)) {
+        T* data = reinterpret_cast<T*>(A::alloc(sizeof(T) * capacity, alignof(T)));
+        for(size_t i = 0; i < _size; i++) {
+            new (&data[i]) T(tl::move(_data[i]));
+            _data[i].~T();
         }
+        A::free(_data);
         _data = data;
-        _capacity = capacity;
     }
+    _capacity = capacity;
 }
 
-template <typename T>
+template <typename T, typename A>
 template <typename... ConstructorArgs>
-void Vector<T>::resize(size_t size, ConstructorArgs&&... args)noexcept
+void Vector<T, A>::resize(size_t size, ConstructorArgs&&... args)noexcept
 {
     if(size > _capacity)
         grow(size);
@@ -249,8 +335,8 @@ void Vector<T>::resize(size_t size, ConstructorArgs&&... args)noexcept
     _size = size;
 }
 
-template <typename T>
-int Vector<T>::findIndex(const T& x)
+template <typename T, typename A>
+int Vector<T, A>::findIndex(const T& x)
 {
     for(int i = 0; i < _size; i++) {
         if(_data[i] == x)
@@ -259,9 +345,9 @@ int Vector<T>::findIndex(const T& x)
     return -1;
 }
 
-template <typename T>
+template <typename T, typename A>
 template <typename Fn>
-int Vector<T>::findIndexCond(const Fn& fn)
+int Vector<T, A>::findIndexCond(const Fn& fn)
 {
     for(int i = 0; i < _size; i++) {
         if(fn(_data[i]))
@@ -270,19 +356,22 @@ int Vector<T>::findIndexCond(const Fn& fn)
     return -1;
 }
 
-template <typename T>
-void Vector<T>::grow(size_t capacity)noexcept
+template <typename T, typename A>
+void Vector<T, A>::grow(size_t capacity)noexcept
 {
-    if(capacity <= 64) {
-        reserve(64);
-    }
-    else if(capacity <= 256) {
-        reserve(256);
-    }
-    else {
-       const size_t n = nextPowerOf2(capacity);
-       reserve(n);
-    }
+    constexpr size_t minCapacity = sizeof(T) >= 64 ? 4 : 256 / sizeof(T);
+    size_t n = 2 * _capacity;
+    if(n < capacity)
+        n = capacity;
+    if(n < minCapacity)
+        n = minCapacity;
+    reserve(n);
 }
 
+// a vector only points to its storage, so it can be relocated when its allocator can
+template <typename T, typename A>
+struct is_trivially_relocatable<Vector<T, A>> {
+    static constexpr bool value = is_trivially_relocatable<A>::value;
+};
+
 }
@@ -0,0 +1,44 @@
+#pragma once
+
+#include "hash.hpp"
+#include <glm/vec2.hpp>
+#include <glm/vec3.hpp>
+
+namespace tl
+{
+
+// integer coordinates, for the spatial hashes of grid cells
+
+template <>
+struct hash<glm::ivec2>
+{
+    size_t operator()(glm::ivec2 v)const noexcept {
+        return hashInt(u64(u32(v.x)) | u64(u32(v.y)) << 32);
+    }
+};
+
+template <>
+struct hash<glm::uvec2>
+{
+    size_t operator()(glm::uvec2 v)const noexcept {
+        return hashInt(u64(v.x) | u64(v.y) << 32);
+    }
+};
+
+template <>
+struct hash<glm::ivec3>
+{
+    size_t operator()(glm::ivec3 v)const noexcept {
+        return hashInt(u64(u32(v.x)) | u64(u32(v.y)) << 32, u32(v.z));
+    }
+};
+
+template <>
+struct hash<glm::uvec3>
+{
+    size_t operator()(glm::uvec3 v)const noexcept {
+        return hashInt(u64(v.x) | u64(v.y) << 32, v.z);
+    }
+};
+
+}
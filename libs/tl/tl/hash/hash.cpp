@@ -1,19 +1,37 @@
 #include "hash.hpp"
+#include <string.h>
 
-namespace tl
-{
+#if defined(__SSE2__) || defined(_M_X64)
+#    include <emmintrin.h>
+#    define HASH_SSE2 1
+#else
+#    define HASH_SSE2 0
+#endif
 
-#ifndef __has_cpp_attribute // For backwards compatibility
-#    define __has_cpp_attribute(x) 0
+// AVX2 is detected at run time, the default build targets plain x86-64
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#    include <immintrin.h>
+#    define HASH_AVX2 1
+#    define HASH_AVX2_TARGET __attribute__((target("avx2")))
+#    define HASH_CPU_HAS_AVX2() __builtin_cpu_supports("avx2")
+#elif defined(_MSC_VER) && defined(__AVX2__)
+#    include <immintrin.h>
+#    define HASH_AVX2 1
+#    define HASH_AVX2_TARGET
+#    define HASH_CPU_HAS_AVX2() true
+#else
+#    define HASH_AVX2 0
 #endif
-#if __has_cpp_attribute(clang::fallthrough)
-#    define SWITCH_FALLTHROUGH [[clang::fallthrough]]
-#elif __has_cpp_attribute(gnu::fallthrough)
-#    define SWITCH_FALLTHROUGH [[gnu::fallthrough]]
+
+#ifdef _MSC_VER
+#    define HASH_FORCE_INLINE __forceinline
 #else
-#    define SWITCH_FALLTHROUGH
+#    define HASH_FORCE_INLINE inline __attribute__((always_inline))
 #endif
 
+namespace tl
+{
+
 // umul
 #if defined(__SIZEOF_INT128__)
 #    define HAS_UMUL128 1
@@ -47,60 +65,265 @@ inline uint64_t umul128(uint64_t a, uint64_t b, uint64_t* high) noexcept {
 #    define HAS_UMUL128 0
 #endif
 
-// copied this function from robinhood hash map
-size_t hashBytes(void const* ptr, size_t const len) noexcept
+#if HASH_AVX2
+static bool hasAvx2() noexcept
 {
-    static constexpr uint64_t m = UINT64_C(0xc6a4a7935bd1e995);
-    static constexpr uint64_t seed = UINT64_C(0xe17a1465);
-    static constexpr unsigned int r = 47;
+    static const bool has = HASH_CPU_HAS_AVX2();
+    return has;
+}
+#endif
 
-    auto data64 = reinterpret_cast<const uint64_t*>(ptr);
-    uint64_t h = seed ^ (len * m);
+// 128 bit product of a and b: low half in a, high half in b
+static inline void mum(uint64_t* a, uint64_t* b) noexcept
+{
+#if HAS_UMUL128
+    uint64_t high;
+    *a = umul128(*a, *b, &high);
+    *b = high;
+#else
+    const uint64_t ha = *a >> 32, hb = *b >> 32, la = (uint32_t)*a, lb = (uint32_t)*b;
+    const uint64_t rh = ha * hb, rm0 = ha * lb, rm1 = hb * la, rl = la * lb;
+    const uint64_t t = rl + (rm0 << 32);
+    uint64_t carry = t < rl;
+    const uint64_t low = t + (rm1 << 32);
+    carry += low < t;
+    *a = low;
+    *b = rh + (rm0 >> 32) + (rm1 >> 32) + carry;
+#endif
+}
 
-    size_t const n_blocks = len / 8;
-    for (size_t i = 0; i < n_blocks; ++i) {
-        auto k = data64[i];
+static inline uint64_t mix(uint64_t a, uint64_t b) noexcept
+{
+    mum(&a, &b);
+    return a ^ b;
+}
 
-        k *= m;
-        k ^= k >> r;
-        k *= m;
+// memcpy: the keys can be at any address
+static inline uint64_t read64(const uint8_t* p) noexcept
+{
+    uint64_t x;
+    memcpy(&x, p, 8);
+    return x;
+}
+static inline uint64_t read32(const uint8_t* p) noexcept
+{
+    uint32_t x;
+    memcpy(&x, p, 4);
+    return x;
+}
+
+static constexpr uint64_t k_wyp[4] = {
+    0x2d358dccaa6c78a5ull, 0x8bb84b93962eacc9ull, 0x4b33a62ed433d4a3ull, 0x4d5a2da51de1aa47ull,
+};
+static constexpr uint64_t k_wySeed = 0xca813bf4c7abf0a9ull; // mix(k_wyp[0], k_wyp[1]), wyhash's seed 0
+
+// the long inputs are hashed in stripes of 64 bytes, accumulated in 8 independent lanes, like XXH3. Lane i of the
+// stripe j of a block uses the key k_stripeKeys[j + i], and the lanes are scrambled after each block with
+// k_stripeKeys[16 + i]
+static constexpr size_t k_longInput = 512;
+static constexpr size_t k_stripeSize = 64;
+static constexpr size_t k_stripesPerBlock = 16;
+static constexpr uint64_t k_scramblePrime = 0x9E3779B1;
+alignas(32) static constexpr uint64_t k_stripeKeys[24] = {
+    0xeaec7a65f9589bb4ull, 0x741a151d91472128ull, 0x82494df36244ca8eull,
+    0xcfaeaace2fd814fdull, 0xd9d60c68d1268ecbull, 0x1fe479b4e37444a5ull,
+    0xd6395ca905df048full, 0x5ffda2f63c740949ull, 0xf6534cca7185561cull,
+    0xce68f048bb9bc5b2ull, 0xa5d9e9cc3e883151ull, 0x483a983b4dad76f5ull,
+    0xde251bc2c2a77fdaull, 0xcaf94660a0abc1a7ull, 0x57252838eef6dac4ull,
+    0x14fca6b292f59b01ull, 0x454b757852995933ull, 0x716a6c7c5c2d8967ull,
+    0x5abc6a163eb93ee5ull, 0x232ce56f1a22a76eull, 0xc0109b6534af76e3ull,
+    0x845375e8324201c9ull, 0xfc6674e9b0875261ull, 0xb7c408f21625de6dull,
+};
 
-        h ^= k;
-        h *= m;
+#if !HASH_SSE2
+static inline void accumulateStripe(uint64_t* acc, const uint8_t* p, const uint64_t* keys) noexcept
+{
+    for(int i = 0; i < 8; i += 2) {
+        const uint64_t d0 = read64(p + 8 * i), d1 = read64(p + 8 * i + 8);
+        const uint64_t dk0 = d0 ^ keys[i], dk1 = d1 ^ keys[i + 1];
+        // each lane also gets the data of the other lane of its pair
+        acc[i] += (dk0 & 0xFFFFFFFF) * (dk0 >> 32) + d1;
+        acc[i + 1] += (dk1 & 0xFFFFFFFF) * (dk1 >> 32) + d0;
     }
+}
 
-    auto const data8 = reinterpret_cast<uint8_t const*>(data64 + n_blocks);
-    switch (len & 7U) {
-    case 7:
-        h ^= static_cast<uint64_t>(data8[6]) << 48U;
-        SWITCH_FALLTHROUGH;
-    case 6:
-        h ^= static_cast<uint64_t>(data8[5]) << 40U;
-        SWITCH_FALLTHROUGH;
-    case 5:
-        h ^= static_cast<uint64_t>(data8[4]) << 32U;
-        SWITCH_FALLTHROUGH;
-    case 4:
-        h ^= static_cast<uint64_t>(data8[3]) << 24U;
-        SWITCH_FALLTHROUGH;
-    case 3:
-        h ^= static_cast<uint64_t>(data8[2]) << 16U;
-        SWITCH_FALLTHROUGH;
-    case 2:
-        h ^= static_cast<uint64_t>(data8[1]) << 8U;
-        SWITCH_FALLTHROUGH;
-    case 1:
-        h ^= static_cast<uint64_t>(data8[0]);
-        h *= m;
-        SWITCH_FALLTHROUGH;
-    default:
-        break;
+static inline void scramble(uint64_t* acc) noexcept
+{
+    for(int i = 0; i < 8; i++)
+        acc[i] = (acc[i] ^ (acc[i] >> 47) ^ k_stripeKeys[16 + i]) * k_scramblePrime;
+}
+#else
+// the SIMD versions compute the same as the scalar ones, 2 or 4 lanes at a time
+static inline void accumulateStripeSse2(uint64_t* acc, const uint8_t* p, const uint64_t* keys) noexcept
+{
+    for(int i = 0; i < 8; i += 2) {
+        const __m128i d = _mm_loadu_si128((const __m128i*)(p + 8 * i));
+        const __m128i dk = _mm_xor_si128(d, _mm_loadu_si128((const __m128i*)(keys + i)));
+        const __m128i product = _mm_mul_epu32(dk, _mm_srli_epi64(dk, 32));
+        // the other lane of the pair: swap the 2 lanes
+        const __m128i swapped = _mm_shuffle_epi32(d, _MM_SHUFFLE(1, 0, 3, 2));
+        const __m128i a = _mm_loadu_si128((const __m128i*)(acc + i));
+        _mm_storeu_si128((__m128i*)(acc + i), _mm_add_epi64(a, _mm_add_epi64(product, swapped)));
     }
+}
 
-    h ^= h >> r;
-    h *= m;
-    h ^= h >> r;
-    return static_cast<size_t>(h);
+static inline void scrambleSse2(uint64_t* acc) noexcept
+{
+    const __m128i prime = _mm_set1_epi32(k_scramblePrime);
+    for(int i = 0; i < 8; i += 2) {
+        __m128i x = _mm_loadu_si128((const __m128i*)(acc + i));
+        x = _mm_xor_si128(x, _mm_srli_epi64(x, 47));
+        x = _mm_xor_si128(x, _mm_loadu_si128((const __m128i*)(k_stripeKeys + 16 + i)));
+        // 64 bit * 32 bit: low * prime + (high * prime) << 32
+        const __m128i low = _mm_mul_epu32(x, prime);
+        const __m128i high = _mm_mul_epu32(_mm_srli_epi64(x, 32), prime);
+        _mm_storeu_si128((__m128i*)(acc + i), _mm_add_epi64(low, _mm_slli_epi64(high, 32)));
+    }
+}
+#endif
+
+#if HASH_AVX2
+HASH_AVX2_TARGET static HASH_FORCE_INLINE void accumulateStripeAvx2(uint64_t* acc, const uint8_t* p, const uint64_t* keys) noexcept
+{
+    for(int i = 0; i < 8; i += 4) {
+        const __m256i d = _mm256_loadu_si256((const __m256i*)(p + 8 * i));
+        const __m256i dk = _mm256_xor_si256(d, _mm256_loadu_si256((const __m256i*)(keys + i)));
+        const __m256i product = _mm256_mul_epu32(dk, _mm256_srli_epi64(dk, 32));
+        const __m256i swapped = _mm256_shuffle_epi32(d, _MM_SHUFFLE(1, 0, 3, 2));
+        const __m256i a = _mm256_loadu_si256((const __m256i*)(acc + i));
+        _mm256_storeu_si256((__m256i*)(acc + i), _mm256_add_epi64(a, _mm256_add_epi64(product, swapped)));
+    }
+}
+
+HASH_AVX2_TARGET static HASH_FORCE_INLINE void scrambleAvx2(uint64_t* acc) noexcept
+{
+    const __m256i prime = _mm256_set1_epi32(k_scramblePrime);
+    for(int i = 0; i < 8; i += 4) {
+        __m256i x = _mm256_loadu_si256((const __m256i*)(acc + i));
+        x = _mm256_xor_si256(x, _mm256_srli_epi64(x, 47));
+        x = _mm256_xor_si256(x, _mm256_load_si256((const __m256i*)(k_stripeKeys + 16 + i)));
+        const __m256i low = _mm256_mul_epu32(x, prime);
+        const __m256i high = _mm256_mul_epu32(_mm256_srli_epi64(x, 32), prime);
+        _mm256_storeu_si256((__m256i*)(acc + i), _mm256_add_epi64(low, _mm256_slli_epi64(high, 32)));
+    }
+}
+#endif
+
+// len > k_stripeSize. The last stripe is the last 64 bytes, overlapping the previous one
+// Always inlined, so each caller gets its own loop with accumulateStripeFn and scrambleFn inlined
+typedef void (*AccumulateStripeFn)(uint64_t* acc, const uint8_t* p, const uint64_t* keys);
+typedef void (*ScrambleFn)(uint64_t* acc);
+static HASH_FORCE_INLINE void accumulate(uint64_t* accOut, const uint8_t* p, size_t len,
+    AccumulateStripeFn accumulateStripeFn, ScrambleFn scrambleFn) noexcept
+{
+    // a local copy that p can't alias, so the lanes can stay in registers
+    uint64_t acc[8];
+    memcpy(acc, accOut, sizeof(acc));
+    const size_t blockSize = k_stripeSize * k_stripesPerBlock;
+    const size_t numBlocks = (len - 1) / blockSize;
+    for(size_t b = 0; b < numBlocks; b++) {
+        for(size_t j = 0; j < k_stripesPerBlock; j++)
+            accumulateStripeFn(acc, p + b * blockSize + j * k_stripeSize, k_stripeKeys + j);
+        scrambleFn(acc);
+    }
+    const uint8_t* tail = p + numBlocks * blockSize;
+    const size_t numStripes = (len - numBlocks * blockSize - 1) / k_stripeSize;
+    for(size_t j = 0; j < numStripes; j++)
+        accumulateStripeFn(acc, tail + j * k_stripeSize, k_stripeKeys + j);
+    accumulateStripeFn(acc, p + len - k_stripeSize, k_stripeKeys + 7);
+    memcpy(accOut, acc, sizeof(acc));
+}
+
+#if HASH_AVX2
+HASH_AVX2_TARGET static void accumulateAvx2(uint64_t* acc, const uint8_t* p, size_t len) noexcept
+{
+    accumulate(acc, p, len, accumulateStripeAvx2, scrambleAvx2);
+}
+#endif
+
+static void accumulateBaseline(uint64_t* acc, const uint8_t* p, size_t len) noexcept
+{
+#if HASH_SSE2
+    accumulate(acc, p, len, accumulateStripeSse2, scrambleSse2);
+#else
+    accumulate(acc, p, len, accumulateStripe, scramble);
+#endif
+}
+
+static uint64_t hashLong(const uint8_t* p, size_t len, bool allowAvx2) noexcept
+{
+    uint64_t acc[8];
+    for(int i = 0; i < 8; i++)
+        acc[i] = k_stripeKeys[i];
+#if HASH_AVX2
+    if(allowAvx2 && hasAvx2())
+        accumulateAvx2(acc, p, len);
+    else
+#else
+    (void)allowAvx2;
+#endif
+        accumulateBaseline(acc, p, len);
+    uint64_t h = len * k_wyp[0];
+    for(int i = 0; i < 8; i += 2)
+        h += mix(acc[i] ^ k_stripeKeys[9 + i], acc[i + 1] ^ k_stripeKeys[10 + i]);
+    return mix(h ^ k_wyp[2], len ^ k_wyp[3]);
+}
+
+// wyhash (final version 4), for the inputs below k_longInput bytes
+static uint64_t hashShort(const uint8_t* p, size_t len) noexcept
+{
+    uint64_t seed = k_wySeed;
+    uint64_t a, b;
+    if(len <= 16) {
+        if(len >= 4) {
+            a = (read32(p) << 32) | read32(p + ((len >> 3) << 2));
+            b = (read32(p + len - 4) << 32) | read32(p + len - 4 - ((len >> 3) << 2));
+        }
+        else if(len > 0) {
+            a = (uint64_t(p[0]) << 16) | (uint64_t(p[len >> 1]) << 8) | p[len - 1];
+            b = 0;
+        }
+        else {
+            a = b = 0;
+        }
+    }
+    else {
+        size_t i = len;
+        if(i >= 48) {
+            uint64_t seed1 = seed, seed2 = seed;
+            do {
+                seed = mix(read64(p) ^ k_wyp[1], read64(p + 8) ^ seed);
+                seed1 = mix(read64(p + 16) ^ k_wyp[2], read64(p + 24) ^ seed1);
+                seed2 = mix(read64(p + 32) ^ k_wyp[3], read64(p + 40) ^ seed2);
+                p += 48;
+                i -= 48;
+            } while(i >= 48);
+            seed ^= seed1 ^ seed2;
+        }
+        while(i > 16) {
+            seed = mix(read64(p) ^ k_wyp[1], read64(p + 8) ^ seed);
+            i -= 16;
+            p += 16;
+        }
+        a = read64(p + i - 16);
+        b = read64(p + i - 8);
+    }
+    a ^= k_wyp[1];
+    b ^= seed;
+    mum(&a, &b);
+    return mix(a ^ k_wyp[0] ^ len, b ^ k_wyp[1]);
+}
+
+size_t hashBytes(void const* ptr, size_t const len) noexcept
+{
+    const uint8_t* p = reinterpret_cast<const uint8_t*>(ptr);
+    return static_cast<size_t>(len >= k_longInput ? hashLong(p, len, true) : hashShort(p, len));
+}
+
+size_t hashBytesBaseline(void const* ptr, size_t const len) noexcept
+{
+    const uint8_t* p = reinterpret_cast<const uint8_t*>(ptr);
+    return static_cast<size_t>(len >= k_longInput ? hashLong(p, len, false) : hashShort(p, len));
 }
 
 size_t hashInt(uint64_t obj) noexcept
@@ -128,5 +351,13 @@ size_t hashInt(uint64_t obj) noexcept
 #endif
 }
 
+size_t hashInt(uint64_t a, uint64_t b) noexcept
+{
+    // wyhash of 16 bytes
+    a ^= k_wyp[1];
+    b ^= k_wySeed;
+    mum(&a, &b);
+    return static_cast<size_t>(mix(a ^ k_wyp[0] ^ 16, b ^ k_wyp[1]));
+}
 
 }
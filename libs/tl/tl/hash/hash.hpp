@@ -1,13 +1,18 @@
 #pragma once
 
 #include <tl/int_types.hpp>
+#include <type_traits>
 
 namespace tl
 {
 
 size_t hashBytes(const void* s, size_t size) noexcept;
+// hashBytes() without the AVX2 path, the same result. For benchmarks and tests
+size_t hashBytesBaseline(const void* s, size_t size) noexcept;
 
 size_t hashInt(uint64_t obj) noexcept;
+// 128 bit integer, for small keys made of several ints
+size_t hashInt(uint64_t a, uint64_t b) noexcept;
 
 template <typename T>
 struct hash{};
@@ -51,4 +56,14 @@ ROBIN_HOOD_HASH_INT(unsigned long long);
 #    pragma GCC diagnostic pop
 #endif
 
+// Hashes the bytes of the object, for the keys that are blocks of plain data, like the SphereObjs of a scene
+// The padding bytes must be zeroed, and 0.f and -0.f are different keys
+template <typename T>
+struct hash_bytes {
+    static_assert(std::is_trivially_copyable<T>::value, "hash_bytes is for plain data");
+    size_t operator()(const T& x) const noexcept {
+        return hashBytes(&x, sizeof(T));
+    }
+};
+
 }
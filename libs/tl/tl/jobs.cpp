@@ -0,0 +1,250 @@
+#include "jobs.hpp"
+
+#include <string.h>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include "basic.hpp"
+#include "profiler.hpp"
+#include "containers/concurrent_queue.hpp"
+
+namespace tl
+{
+
+// A thief can read a slot while the owner overwrites it. Its CAS of top fails in that case, and the copy is discarded,
+// but the read must still be defined behavior, so the slots are stored as relaxed atomic words
+static constexpr int k_jobWords = (sizeof(Job) + 7) / 8;
+struct JobSlot {
+    std::atomic<u64> words[k_jobWords];
+};
+
+static void storeJob(JobSlot& slot, const Job& job)
+{
+    u64 words[k_jobWords] = {};
+    memcpy(words, (const void*)&job, sizeof(Job));
+    for(int i = 0; i < k_jobWords; i++)
+        slot.words[i].store(words[i], std::memory_order_relaxed);
+}
+
+static void loadJob(Job& job, const JobSlot& slot)
+{
+    u64 words[k_jobWords];
+    for(int i = 0; i < k_jobWords; i++)
+        words[i] = slot.words[i].load(std::memory_order_relaxed);
+    memcpy((void*)&job, words, sizeof(Job));
+}
+
+// Chase-Lev deque with a fixed capacity, with the memory orders of Lê et al. 2013, "Correct and Efficient
+// Work-Stealing for Weak Memory Models". Only the owner calls push() and pop(), anyone can call steal()
+struct alignas(64) JobDeque {
+    static constexpr i64 k_capacity = 1 << 12;
+    std::atomic<i64> top {0};
+    alignas(64) std::atomic<i64> bottom {0};
+    JobSlot slots[k_capacity];
+
+    bool push(const Job& job)
+    {
+        const i64 b = bottom.load(std::memory_order_relaxed);
+        const i64 t = top.load(std::memory_order_acquire);
+        if(b - t >= k_capacity)
+            return false;
+        storeJob(slots[b & (k_capacity - 1)], job);
+        std::atomic_thread_fence(std::memory_order_release);
+        bottom.store(b + 1, std::memory_order_relaxed);
+        return true;
+    }
+
+    bool pop(Job& job)
+    {
+        const i64 b = bottom.load(std::memory_order_relaxed) - 1;
+        bottom.store(b, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        i64 t = top.load(std::memory_order_relaxed);
+        if(t > b) { // empty
+            bottom.store(b + 1, std::memory_order_relaxed);
+            return false;
+        }
+        loadJob(job, slots[b & (k_capacity - 1)]);
+        bool ok = true;
+        if(t == b) { // last job: race against the thieves for it
+            ok = top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+            bottom.store(b + 1, std::memory_order_relaxed);
+        }
+        return ok;
+    }
+
+    bool steal(Job& job)
+    {
+        i64 t = top.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        const i64 b = bottom.load(std::memory_order_acquire);
+        if(t >= b)
+            return false;
+        loadJob(job, slots[t & (k_capacity - 1)]);
+        return top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+    }
+};
+
+struct JobPool {
+    int numWorkers = 0;
+    JobDeque* deques = nullptr; // one per worker
+    std::thread* threads = nullptr;
+    // the threads that aren't workers push here, the workers take from it before stealing
+    MpmcQueue<Job, 1 << 12> sharedQueue;
+
+    std::atomic<int> numQueued {0}; // jobs pushed and not taken yet
+    std::atomic<int> numSleeping {0};
+    std::atomic<bool> quit {false};
+    std::mutex sleepMutex;
+    std::condition_variable wakeUp;
+
+    JobPool(int numWorkers);
+    ~JobPool();
+};
+
+static thread_local int t_workerIndex = -1;
+static thread_local u32 t_rngState = 0;
+static int s_numWorkersRequested = -1;
+
+static JobPool& pool()
+{
+    static JobPool p(s_numWorkersRequested);
+    return p;
+}
+
+static bool findJob(JobPool& p, Job& job)
+{
+    const int self = t_workerIndex;
+    bool found = false;
+    if(self >= 0)
+        found = p.deques[self].pop(job);
+    if(!found)
+        found = p.sharedQueue.tryPop(job);
+    if(!found && p.numWorkers > 0) {
+        // xorshift, to spread the thieves over the victims
+        u32& x = t_rngState;
+        if(x == 0)
+            x = u32(self + 2) * 0x9E3779B9u;
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+        const int first = int(x % u32(p.numWorkers));
+        for(int i = 0; i < p.numWorkers && !found; i++) {
+            const int victim = (first + i) % p.numWorkers;
+            if(victim != self)
+                found = p.deques[victim].steal(job);
+        }
+    }
+    if(found)
+        p.numQueued.fetch_sub(1, std::memory_order_relaxed);
+    return found;
+}
+
+static void workerMain(JobPool& p, int index)
+{
+    TL_PROFILE_THREAD_NAME("job worker");
+    t_workerIndex = index;
+    constexpr int numSpins = 64; // tries before sleeping, more jobs usually come right after the last one
+    while(true) {
+        Job job;
+        bool found = false;
+        for(int i = 0; i < numSpins && !found; i++) {
+            found = findJob(p, job);
+            if(!found)
+                std::this_thread::yield();
+        }
+        if(found) {
+            runJob(job);
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(p.sleepMutex);
+        p.numSleeping++;
+        p.wakeUp.wait(lock, [&p]() { return p.quit || p.numQueued > 0; });
+        p.numSleeping--;
+        if(p.quit)
+            return;
+    }
+}
+
+JobPool::JobPool(int numWorkers)
+{
+    if(numWorkers < 0)
+        numWorkers = tl::max(0, (int)std::thread::hardware_concurrency() - 1);
+    this->numWorkers = numWorkers;
+    if(numWorkers == 0)
+        return;
+    deques = new JobDeque[numWorkers];
+    threads = new std::thread[numWorkers];
+    for(int i = 0; i < numWorkers; i++)
+        threads[i] = std::thread([this, i]() { workerMain(*this, i); });
+}
+
+JobPool::~JobPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        quit = true;
+    }
+    wakeUp.notify_all();
+    for(int i = 0; i < numWorkers; i++)
+        threads[i].join();
+    delete[] threads;
+    delete[] deques;
+}
+
+void initJobs(int numWorkers)
+{
+    s_numWorkersRequested = numWorkers;
+    pool();
+}
+
+int numJobThreads()
+{
+    return pool().numWorkers + 1;
+}
+
+void pushJob(const Job& job)
+{
+    JobPool& p = pool();
+    job.counter->fetch_add(1, std::memory_order_relaxed);
+    const bool pushed = t_workerIndex >= 0 ?
+        p.deques[t_workerIndex].push(job) :
+        p.sharedQueue.tryPush(job);
+    if(!pushed) { // full, there is plenty of work queued already
+        runJob(job);
+        return;
+    }
+    p.numQueued.fetch_add(1);
+    if(p.numSleeping.load() > 0) {
+        std::lock_guard<std::mutex> lock(p.sleepMutex);
+        p.wakeUp.notify_one();
+    }
+}
+
+void runJob(Job job)
+{
+    if(pool().numWorkers > 0) {
+        while(job.end - job.begin > job.grain) {
+            Job half = job;
+            half.begin = job.begin + (job.end - job.begin) / 2;
+            job.end = half.begin;
+            pushJob(half);
+        }
+    }
+    job.fn(job.begin, job.end);
+    job.counter->fetch_sub(1, std::memory_order_release);
+}
+
+void waitJobs(const JobCounter& counter)
+{
+    JobPool& p = pool();
+    while(counter.load(std::memory_order_acquire) > 0) {
+        Job job;
+        if(findJob(p, job))
+            runJob(job);
+        else
+            std::this_thread::yield();
+    }
+}
+
+}
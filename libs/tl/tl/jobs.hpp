@@ -0,0 +1,98 @@
+#pragma once
+
+#include <atomic>
+#include <glm/vec2.hpp>
+#include <glm/common.hpp>
+#include "int_types.hpp"
+#include "delegate.hpp"
+#include "span.hpp"
+#include "rect.hpp"
+
+// Work-stealing thread pool shared by all the CPU-side parallel work
+// Each worker thread owns a Chase-Lev deque: it pushes and pops its jobs at the bottom, and when it runs out of them it
+// steals from the top of the deques of the others. The threads that aren't workers push to a shared queue
+// A thread waiting for jobs runs the pending ones meanwhile, so the parallelFor calls can be nested
+//
+//   tl::parallelFor(0, h, [&](int yBegin, int yEnd) {
+//       for(int y = yBegin; y < yEnd; y++)
+//           processRow(y);
+//   });
+
+namespace tl
+{
+
+// number of jobs that haven't finished yet, see waitJobs()
+typedef std::atomic<int> JobCounter;
+
+// Runs fn(begin, end) on the range [begin, end). While the range has more than grain elements, the job pushes its
+// second half as a new job, so the ranges are split on demand by the threads that are free to steal them
+// fn must stay alive until the counter reaches 0
+struct Job {
+    delegate<void(int, int)> fn;
+    int begin, end;
+    int grain;
+    JobCounter* counter; // decremented when the job finishes
+};
+
+// Optional: the first job starts the pool with one worker per hardware thread, minus the calling thread
+// Must be called before any other job function
+void initJobs(int numWorkers);
+// the workers plus the thread that waits
+int numJobThreads();
+
+void pushJob(const Job& job); // increments job.counter
+void runJob(Job job); // runs it in the calling thread (splitting it as described above)
+// runs pending jobs until the counter reaches 0
+void waitJobs(const JobCounter& counter);
+
+// calls fn(begin, end) over subranges of [begin, end) in parallel. The calling thread takes part and returns when all
+// of them are done. grain: minimum size of a subrange, 0 splits the range in a few pieces per thread
+template <typename Fn>
+void parallelFor(int begin, int end, const Fn& fn, int grain = 0)
+{
+    if(begin >= end)
+        return;
+    const int n = end - begin;
+    if(grain <= 0) {
+        grain = n / (8 * numJobThreads());
+        if(grain < 1)
+            grain = 1;
+    }
+    if(n <= grain) {
+        fn(begin, end);
+        return;
+    }
+    JobCounter counter {1};
+    runJob({delegate<void(int, int)>::create<Fn, &Fn::operator()>(&fn), begin, end, grain, &counter});
+    waitJobs(counter);
+}
+
+// calls fn(subSpan) over pieces of span in parallel
+template <typename T, typename Fn>
+void parallelFor(Span<T> span, const Fn& fn, int grain = 0)
+{
+    auto rangeFn = [&](int begin, int end) {
+        fn(span.subArray(begin, end));
+    };
+    parallelFor(0, int(span.size()), rangeFn, grain);
+}
+
+// calls fn(tile) for each tile of r in parallel. The tiles at the right and bottom borders are clamped to r
+template <typename Fn>
+void parallelFor(const irect& r, glm::ivec2 tileSize, const Fn& fn)
+{
+    const glm::ivec2 size = r.pMax - r.pMin;
+    if(size.x <= 0 || size.y <= 0)
+        return;
+    const glm::ivec2 numTiles = (size + tileSize - 1) / tileSize;
+    auto rangeFn = [&](int begin, int end) {
+        for(int i = begin; i < end; i++) {
+            const glm::ivec2 pMin = r.pMin + tileSize * glm::ivec2(i % numTiles.x, i / numTiles.x);
+            const glm::ivec2 pMax = glm::min(pMin + tileSize, r.pMax);
+            fn(irect(pMin, pMax));
+        }
+    };
+    parallelFor(0, numTiles.x * numTiles.y, rangeFn, 1);
+}
+
+}
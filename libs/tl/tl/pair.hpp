@@ -29,12 +29,14 @@ struct Pair
     {
         first = o.first;
         second = o.second;
+        return *this;
     }
 
     Pair& operator=(Pair&& o) noexcept
     {
         first = tl::move(o.first);
         second = tl::move(o.second);
+        return *this;
     }
 
     template <typename TT1, typename TT2>
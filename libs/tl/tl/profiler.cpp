@@ -0,0 +1,90 @@
+#include "profiler.hpp"
+
+#include <stdio.h>
+#include <chrono>
+#include <mutex>
+#include <tl/basic.hpp>
+#include <tl/containers/vector.hpp>
+
+namespace tl
+{
+namespace profiler
+{
+
+static std::mutex s_threadBuffersMutex;
+static Vector<ThreadBuffer*> s_threadBuffers;
+// used to convert ticks to microseconds when dumping
+static u64 s_calibTicks;
+static u64 s_calibNs;
+
+u64 nowSteadyClock()
+{
+    using namespace std::chrono;
+    return duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+ThreadBuffer* createThreadBuffer()
+{
+    // the buffers are never freed, so the events of threads that already finished can still be dumped
+    ThreadBuffer* buffer = new ThreadBuffer;
+    buffer->events = new Event[ThreadBuffer::k_numEvents];
+    buffer->head = 0;
+    buffer->name = nullptr;
+
+    std::lock_guard<std::mutex> lock(s_threadBuffersMutex);
+    if(s_threadBuffers.size() == 0) {
+        s_calibTicks = now();
+        s_calibNs = nowSteadyClock();
+    }
+    buffer->tid = s_threadBuffers.size();
+    s_threadBuffers.push_back(buffer);
+    t_threadBuffer = buffer;
+    return buffer;
+}
+
+void setThreadName(const char* name)
+{
+    ThreadBuffer* buffer = t_threadBuffer;
+    if(!buffer)
+        buffer = createThreadBuffer();
+    buffer->name = name;
+}
+
+bool dumpChromeTrace(const char* fileName)
+{
+    std::lock_guard<std::mutex> lock(s_threadBuffersMutex);
+    if(s_threadBuffers.size() == 0)
+        return false;
+    FILE* f = fopen(fileName, "w");
+    if(!f)
+        return false;
+
+    const u64 ticks = now() - s_calibTicks;
+    const u64 ns = nowSteadyClock() - s_calibNs;
+    const double usPerTick = ticks ? 1e-3 * double(ns) / double(ticks) : 0;
+
+    fprintf(f, "{\"traceEvents\":[\n");
+    bool first = true;
+    for(const ThreadBuffer* buffer : s_threadBuffers) {
+        if(buffer->name) {
+            fprintf(f, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":%u,\"args\":{\"name\":\"%s\"}}",
+                first ? "" : ",\n", buffer->tid, buffer->name);
+            first = false;
+        }
+        const u32 numEvents = min(buffer->head, ThreadBuffer::k_numEvents);
+        for(u32 i = buffer->head - numEvents; i != buffer->head; i++) {
+            const Event& e = buffer->events[i & (ThreadBuffer::k_numEvents - 1)];
+            const double ts = usPerTick * double(i64(e.start - s_calibTicks));
+            const double dur = usPerTick * double(e.end - e.start);
+            fprintf(f, "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":0,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}",
+                first ? "" : ",\n", e.name, buffer->tid, ts, dur);
+            first = false;
+        }
+    }
+    fprintf(f, "\n]}\n");
+    fclose(f);
+    return true;
+}
+
+}
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <tl/int_types.hpp>
+#if defined(__x86_64__) || defined(__i386__)
+    #include <x86intrin.h>
+    #define TL_PROFILER_RDTSC 1
+#elif defined(_M_X64) || defined(_M_IX86)
+    #include <intrin.h>
+    #define TL_PROFILER_RDTSC 1
+#else
+    #define TL_PROFILER_RDTSC 0
+#endif
+
+// Scoped CPU zones dumped as Chrome trace JSON (chrome://tracing, ui.perfetto.dev)
+// The zones only exist when TL_PROFILER is defined, otherwise the macros expand to nothing
+//
+//   void draw() {
+//       TL_PROFILE_ZONE("draw");
+//       ...
+//   }
+
+namespace tl
+{
+namespace profiler
+{
+
+struct Event {
+    const char* name; // must have static storage duration
+    u64 start, end; // in ticks
+};
+
+// each thread writes to its own ring buffer, when it's full the oldest events are overwritten
+struct ThreadBuffer {
+    static constexpr u32 k_numEvents = 1 << 16;
+    Event* events;
+    u32 head; // number of events pushed so far
+    u32 tid;
+    const char* name;
+};
+
+// constant initialized, so accessing it doesn't go through a TLS wrapper function
+inline thread_local ThreadBuffer* t_threadBuffer = nullptr;
+ThreadBuffer* createThreadBuffer();
+
+void setThreadName(const char* name); // name must have static storage duration
+// the other threads should not be recording zones while dumping
+bool dumpChromeTrace(const char* fileName);
+
+u64 nowSteadyClock();
+
+// current timestamp in ticks (rdtsc on x86, steady_clock nanoseconds otherwise)
+inline u64 now()
+{
+#if TL_PROFILER_RDTSC
+    return __rdtsc();
+#else
+    return nowSteadyClock();
+#endif
+}
+
+inline void pushEvent(const char* name, u64 start, u64 end)
+{
+    ThreadBuffer* buffer = t_threadBuffer;
+    if(!buffer)
+        buffer = createThreadBuffer();
+    buffer->events[buffer->head & (ThreadBuffer::k_numEvents - 1)] = {name, start, end};
+    buffer->head++;
+}
+
+struct ScopedZone {
+    ScopedZone(const char* name)
+        : _name(name), _start(now()) {}
+    ~ScopedZone() { pushEvent(_name, _start, now()); }
+    const char* _name;
+    u64 _start;
+};
+
+}
+}
+
+#ifdef TL_PROFILER
+    #define TL_PROFILE_ZONE_1(x, y) x##y
+    #define TL_PROFILE_ZONE_2(x, y) TL_PROFILE_ZONE_1(x, y)
+    #define TL_PROFILE_ZONE(name) tl::profiler::ScopedZone TL_PROFILE_ZONE_2(_profileZone_, __COUNTER__)(name)
+    #define TL_PROFILE_THREAD_NAME(name) tl::profiler::setThreadName(name)
+    #define TL_PROFILE_DUMP(fileName) tl::profiler::dumpChromeTrace(fileName)
+#else
+    #define TL_PROFILE_ZONE(name)
+    #define TL_PROFILE_THREAD_NAME(name)
+    #define TL_PROFILE_DUMP(fileName) false
+#endif
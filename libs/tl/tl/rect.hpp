@@ -16,7 +16,9 @@ struct RectCommonStuff
     TB& yMax = pMax.y;
     
     RectCommonStuff() {}
-    RectCommonStuff(const RectCommonStuff& o) = default;
+    // the references must keep pointing to this object, so the copy can't be the default one
+    RectCommonStuff(const RectCommonStuff& o)
+        : pMin(o.pMin), pMax(o.pMax) {}
     RectCommonStuff(TB xMin, TB yMin, TB xMax, TB yMax)
         : pMin(xMin, yMin), pMax(xMax, yMax) {}
     RectCommonStuff(TB w, TB h)
@@ -59,7 +61,7 @@ struct irect : RectCommonStuff<irect, glm::ivec2, int>
 {
     irect() {}
     irect(const irect& o) : RectCommonStuff(o) {}
-    irect(int xMin, int yMin, int xMax, int yMax) : RectCommonStuff(xMin, yMin, xMin, xMax) {}
+    irect(int xMin, int yMin, int xMax, int yMax) : RectCommonStuff(xMin, yMin, xMax, yMax) {}
     irect(const glm::ivec2& pMin, const glm::ivec2& pMax) : RectCommonStuff(pMin, pMax) {}
     irect(int w, int h) : RectCommonStuff(w, h) {}
     irect(const glm::ivec2& size) : RectCommonStuff(size) {}
@@ -70,7 +72,7 @@ struct urect : RectCommonStuff<urect, glm::uvec2, unsigned>
 {
     urect() {}
     urect(const urect& o) : RectCommonStuff(o) {}
-    urect(unsigned xMin, unsigned yMin, unsigned xMax, unsigned yMax) : RectCommonStuff(xMin, yMin, xMin, xMax) {}
+    urect(unsigned xMin, unsigned yMin, unsigned xMax, unsigned yMax) : RectCommonStuff(xMin, yMin, xMax, yMax) {}
     urect(const glm::uvec2& pMin, const glm::uvec2& pMax) : RectCommonStuff(pMin, pMax) {}
     urect(unsigned w, unsigned h) : RectCommonStuff(w, h) {}
     urect(const glm::uvec2& size) : RectCommonStuff(size) {}
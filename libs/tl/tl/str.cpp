@@ -81,7 +81,8 @@ template class CStrT<char32_t>;
 template<typename CharT>
 StrT<CharT>::StrT()
 {
-    _str = s_emptyStr<CharT>;
+    _str = _buf;
+    _str[0] = 0;
     _size = 0;
 }
 
@@ -150,7 +151,9 @@ const StrT<CharT>& StrT<CharT>::operator=(const StrT& o)
 template<typename CharT>
 const StrT<CharT>& StrT<CharT>::operator=(StrT&& o)
 {
-    if(_str != s_emptyStr<CharT>)
+    if(this == &o)
+        return *this;
+    if(!isInline())
         delete[] _str;
     stealMove(tl::move(o));
     return *this;
@@ -166,7 +169,7 @@ const StrT<CharT>& StrT<CharT>::operator=(const CharT* o)
 template<typename CharT>
 StrT<CharT>::~StrT()
 {
-    if(_str != s_emptyStr<CharT>)
+    if(!isInline())
         delete[] _str;
 }
 
@@ -215,7 +218,7 @@ void StrT<CharT>::append(CStrT<CharT> o)
         for(u32 i=0; i<_size; i++) {
             newStr[i] = _str[i];
         }
-        if(_str != s_emptyStr<CharT>) {
+        if(!isInline()) {
             delete[] _str;
         }
         _str = newStr;
@@ -251,8 +254,8 @@ void StrT<CharT>::insert(u32 pos, CStrT<CharT> o)
 template<typename CharT>
 u32 StrT<CharT>::capacity()const
 {
-    if(_str == s_emptyStr<CharT>)
-        return 1;
+    if(isInline())
+        return k_numInlineChars;
     return calcCapacity(_size);
 }
 
@@ -268,7 +271,7 @@ void StrT<CharT>::resize(u32 size)
         for(u32 i = 0; i < _size; i++) {
             str[i] = _str[i];
         }
-        if(_str != s_emptyStr<CharT>) {
+        if(!isInline()) {
             delete[] _str;
         }
         _str = str;
@@ -283,7 +286,7 @@ void StrT<CharT>::resizeNoCopy(u32 size)
     if(size == 0)
         return;
     if(auto str = growIfNeeded(size)) {
-        if(_str != s_emptyStr<CharT>) {
+        if(!isInline()) {
             delete[] _str;
         }
         _str = str;
@@ -309,8 +312,7 @@ template<typename CharT>
 void StrT<CharT>::construct(CStrT<CharT> o)
 {
     _size = o.size();
-    const u32 capacity = calcCapacity(_size);
-    _str = new CharT[capacity];
+    _str = _size < k_numInlineChars ? _buf : new CharT[calcCapacity(_size)];
     for(u32 i=0; i<_size; i++) {
         _str[i] = o[i];
     }
@@ -320,11 +322,12 @@ void StrT<CharT>::construct(CStrT<CharT> o)
 template<typename CharT>
 void StrT<CharT>::copy(CStrT<CharT> o)
 {
-    if(_str != s_emptyStr<CharT>)
+    if(o.c_str() == _str)
+        return;
+    if(!isInline())
         delete[] _str;
     _size = o.size();
-    const u32 capacity = calcCapacity(_size);
-    _str = new CharT[capacity];
+    _str = _size < k_numInlineChars ? _buf : new CharT[calcCapacity(_size)];
     for(u32 i=0; i<_size; i++) {
         _str[i] = o[i];
     }
@@ -334,18 +337,25 @@ void StrT<CharT>::copy(CStrT<CharT> o)
 template<typename CharT>
 void StrT<CharT>::stealMove(StrT<CharT>&& o)
 {
-    _str = o._str;
     _size = o._size;
-    o._str = s_emptyStr<CharT>;
+    if(o.isInline()) {
+        _str = _buf;
+        for(u32 i = 0; i <= _size; i++)
+            _buf[i] = o._buf[i];
+    }
+    else {
+        _str = o._str;
+    }
+    o._str = o._buf;
+    o._str[0] = 0;
     o._size = 0;
 }
 
 template<typename CharT>
 CharT* StrT<CharT>::growIfNeeded(u32 newSize)
 {
-    const u32 neededCapacity = calcCapacity(newSize);
-    if(capacity() < neededCapacity) {
-        return new CharT[neededCapacity];
+    if(capacity() <= newSize) { // the terminator doesn't fit
+        return new CharT[calcCapacity(newSize)];
     }
     return nullptr;
 }
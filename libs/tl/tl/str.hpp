@@ -51,10 +51,14 @@ typedef CStrT<char32_t> CStr32;
 
 // --- Str ------------------------------------------------------------------------------
 
+// Owning string, null terminated. The short ones (up to k_numInlineChars - 1 characters) are stored inside the object
+// without allocating. _str always points to the characters, so it can't be relocated with memcpy
 template <typename CharT>
 class StrT
 {
 public:
+    static constexpr u32 k_numInlineChars = 20 / sizeof(CharT); // including the terminator
+
     StrT();
     StrT(CStrT<CharT> o);
     StrT(const StrT& o);
@@ -100,6 +104,7 @@ public:
     void insert(u32 pos, CStrT<CharT> o);
 
     u32 capacity()const;
+    bool isInline()const { return _str == _buf; }
 
     void resize(u32 size);
     void resizeNoCopy(u32 size);
@@ -112,8 +117,9 @@ private:
     void stealMove(StrT&& o);
     CharT* growIfNeeded(u32 newSize);
 
-    CharT* _str;
+    CharT* _str; // _buf or a heap allocation
     u32 _size; // max 4GB
+    CharT _buf[k_numInlineChars];
 
     static CharT _emptyStr[1];
     static u32 calcCapacity(u32 size);
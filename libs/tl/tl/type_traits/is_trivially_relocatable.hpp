@@ -0,0 +1,16 @@
+#pragma once
+
+#include <type_traits>
+
+namespace tl
+{
+
+// Moving the object to another address and destroying the original is equivalent to copying its bytes, so the
+// containers can move it with memcpy or realloc. True for the trivially copyable types; specialize it for the
+// types that own memory but don't point into themselves
+template <typename T>
+struct is_trivially_relocatable {
+    static constexpr bool value = std::is_trivially_copyable<T>::value;
+};
+
+}
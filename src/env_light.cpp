@@ -0,0 +1,95 @@
+#include "env_light.hpp"
+
+#include <string.h>
+#include <math.h>
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <tl/fmt.hpp>
+#include <tl/profiler.hpp>
+#include <tg/img.hpp>
+#include <tg/mapped_img.hpp>
+#include <tg/cubemap.hpp>
+#include <tg/env_sampling.hpp>
+#include <tg/sh.hpp>
+
+using glm::vec3;
+
+static const int k_proceduralW = 1024;
+static const int k_proceduralH = 512;
+static const vec3 k_skyColor = 0.6f * vec3(1.0f, 1.0f, 1.2f); // same as the emissive sphere that used to surround the scene
+static const vec3 k_sunDir = glm::normalize(vec3(0.5f, 0.6f, -0.6f));
+static const float k_sunAngularRadius = 0.02f; // a few pixels of the procedural map, so the alias table can find it
+static const vec3 k_sunColor = vec3(2000.f, 1900.f, 1700.f);
+static const int k_shCubeSide = 128; // the projection only keeps the low frequencies, a small cube is enough
+
+static tg::Img3f makeSunSky(int w, int h)
+{
+    tg::Img3f img(w, h);
+    const float cosSun = cosf(k_sunAngularRadius);
+    for(int y = 0; y < h; y++)
+    for(int x = 0; x < w; x++) {
+        const vec3 dir = tg::equirectDir({(x + 0.5f) / w, (y + 0.5f) / h});
+        img(x, y) = glm::dot(dir, k_sunDir) > cosSun ? k_sunColor : k_skyColor;
+    }
+    return img;
+}
+
+void EnvLight::init(const char* fileName)
+{
+    TL_PROFILE_ZONE("EnvLight::init");
+    tg::Img3f img;
+    tg::MappedImg3f mapped;
+    tg::ImgView3f env;
+    const char* ext = strrchr(fileName, '.');
+    if(ext && strcmp(ext, ".pfm") == 0) {
+        mapped = tg::MappedImg3f::map(fileName);
+        env = mapped;
+    }
+    else {
+        img = tg::Img3f::load(fileName);
+        env = img;
+    }
+    if(!env.data()) {
+        tl::println("Couldn't load the environment map ", fileName, ", using a procedural sky");
+        img = makeSunSky(k_proceduralW, k_proceduralH);
+        env = img;
+    }
+    _w = env.width();
+    _h = env.height();
+
+    {
+        tg::CubeImg3f cube(k_shCubeSide);
+        tg::equirectToCube(cube, env);
+        _shIrradiance = tg::shIrradiance(tg::projectSh(cube));
+    }
+
+    tl::Vector<tg::EnvAliasEntry> aliasTable;
+    tg::buildEnvAliasTable(aliasTable, env);
+    glGenBuffers(1, &_aliasSsbo);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, _aliasSsbo);
+    glBufferData(GL_SHADER_STORAGE_BUFFER,
+        aliasTable.size() * sizeof(tg::EnvAliasEntry), aliasTable.data(), GL_STATIC_DRAW);
+
+    // the shader reads single texels with texelFetch, so the radiance is constant over each pixel like the pdf
+    glGenTextures(1, &_tex);
+    glBindTexture(GL_TEXTURE_2D, _tex);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    if(env.stride() == _w) {
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB32F, _w, _h, 0, GL_RGB, GL_FLOAT, env.data());
+    }
+    else {
+        // the rows of the mapped PFM go backwards in memory
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB32F, _w, _h, 0, GL_RGB, GL_FLOAT, nullptr);
+        for(int y = 0; y < _h; y++)
+            glTexSubImage2D(GL_TEXTURE_2D, 0, 0, y, _w, 1, GL_RGB, GL_FLOAT, &env(0, y));
+    }
+}
+
+void EnvLight::bind(int texUnit)const
+{
+    glActiveTexture(GL_TEXTURE0 + texUnit);
+    glBindTexture(GL_TEXTURE_2D, _tex);
+    glActiveTexture(GL_TEXTURE0);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, k_aliasSsboBinding, _aliasSsbo);
+}
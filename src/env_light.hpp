@@ -0,0 +1,28 @@
+#pragma once
+
+#include <tl/int_types.hpp>
+#include <tg/sh.hpp>
+
+// HDR environment map that lights the scene. main_frag.glsl importance samples it with an alias table
+// (tg::buildEnvAliasTable), and combines those samples with the BSDF ones with multiple importance sampling
+// The objects are created in the shared context, before the render thread starts
+struct EnvLight {
+    static constexpr u32 k_aliasSsboBinding = 2; // must match the binding in main_frag.glsl
+
+    // fileName: equirectangular map (see tg/cubemap.hpp), .hdr or .pfm (memory mapped)
+    // If it can't be loaded, a procedural sky with a sun is used instead
+    void init(const char* fileName);
+    // binds the map to texUnit and the alias table to k_aliasSsboBinding
+    void bind(int texUnit)const;
+
+    int width()const { return _w; }
+    int height()const { return _h; }
+    // irradiance of each normal, for the preview before the first path traced frame (sh_preview.glsl)
+    const tg::ShL2& shIrradiance()const { return _shIrradiance; }
+
+private:
+    u32 _tex = 0;
+    u32 _aliasSsbo = 0;
+    int _w = 0, _h = 0;
+    tg::ShL2 _shIrradiance = {};
+};
@@ -0,0 +1,20 @@
+#include "frame_scheduler.hpp"
+
+#include <chrono>
+#include <thread>
+#include <GLFW/glfw3.h>
+#include <tl/profiler.hpp>
+
+void FrameScheduler::beginFrame()
+{
+    _frameStart = glfwGetTime();
+}
+
+void FrameScheduler::endFrame()
+{
+    TL_PROFILE_ZONE("idle");
+    // the GPU work is asynchronous, so most of the frame is left for the GPU to chew on the samples we submitted
+    const double remaining = 1e-3 * targetFrameMs - (glfwGetTime() - _frameStart);
+    if(remaining > 0)
+        std::this_thread::sleep_for(std::chrono::duration<double>(remaining));
+}
\ No newline at end of file
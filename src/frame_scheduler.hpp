@@ -0,0 +1,17 @@
+#pragma once
+
+// Paces the render thread: a fraction of each frame is spent tracing samples and the rest of the frame is idle
+struct FrameScheduler {
+    float targetFrameMs = 16.7f;
+    float renderFraction = 0.75f; // fraction of targetFrameMs that the GPU should spend on samples
+    int maxSamplesPerFrame = 64;
+
+    void beginFrame();
+    // GPU time that the samples of a frame should take
+    float gpuBudgetMs()const { return renderFraction * targetFrameMs; }
+    // sleeps for the rest of the frame
+    void endFrame();
+
+private:
+    double _frameStart = 0;
+};
@@ -0,0 +1,157 @@
+#include "gpu_timers.hpp"
+
+#include <assert.h>
+#include <glad/glad.h>
+#include <tl/basic.hpp>
+
+const char* toStr(EGpuPass pass)
+{
+    switch(pass) {
+        case EGpuPass::TRACE: return "trace";
+        case EGpuPass::PREVIEW: return "preview";
+        case EGpuPass::REPROJECT: return "reproject";
+        case EGpuPass::DENOISE: return "denoise";
+        case EGpuPass::POSTPRO: return "postpro";
+        case EGpuPass::PRESENT: return "present";
+        default: break;
+    }
+    return "[UNKNOWN]";
+}
+
+void GpuTimers::init()
+{
+    for(Slot& slot : _slots) {
+        glGenQueries(2 * k_numPasses, &slot.queries[0][0]);
+        slot.issuedMask = 0;
+        slot.frame = 0;
+    }
+    for(int i = 0; i < k_numPasses; i++) {
+        _historyHead[i] = 0;
+        _stats[i] = {};
+    }
+}
+
+void GpuTimers::beginPass(EGpuPass pass)
+{
+    Slot& slot = _slots[_frame % k_numFramesInFlight];
+    glQueryCounter(slot.queries[(int)pass][0], GL_TIMESTAMP);
+}
+
+void GpuTimers::endPass(EGpuPass pass, float numItems)
+{
+    Slot& slot = _slots[_frame % k_numFramesInFlight];
+    glQueryCounter(slot.queries[(int)pass][1], GL_TIMESTAMP);
+    slot.numItems[(int)pass] = numItems;
+    slot.issuedMask |= 1u << (int)pass;
+}
+
+void GpuTimers::endFrame()
+{
+    _slots[_frame % k_numFramesInFlight].frame = _frame;
+    _frame++;
+    // the slot we are about to reuse is the oldest one
+    Slot& slot = _slots[_frame % k_numFramesInFlight];
+    if(slot.issuedMask)
+        collect(slot);
+    slot.issuedMask = 0;
+}
+
+void GpuTimers::collect(Slot& slot)
+{
+    // the end queries are submitted after the begin ones, so checking those is enough
+    for(int i = 0; i < k_numPasses; i++) {
+        if(!(slot.issuedMask & (1u << i)))
+            continue;
+        i32 available = 0;
+        glGetQueryObjectiv(slot.queries[i][1], GL_QUERY_RESULT_AVAILABLE, &available);
+        if(!available) {
+            _numDropped++;
+            return;
+        }
+    }
+
+    if(_csvFile)
+        fprintf(_csvFile, "%llu", (unsigned long long)slot.frame);
+    for(int i = 0; i < k_numPasses; i++) {
+        if(!(slot.issuedMask & (1u << i))) {
+            if(_csvFile)
+                fprintf(_csvFile, ",");
+            continue;
+        }
+        u64 t0, t1;
+        glGetQueryObjectui64v(slot.queries[i][0], GL_QUERY_RESULT, &t0);
+        glGetQueryObjectui64v(slot.queries[i][1], GL_QUERY_RESULT, &t1);
+        const float ms = 1e-6f * float(t1 - t0);
+        _history[i][_historyHead[i] % k_historySize] = ms;
+        _historyHead[i]++;
+        _stats[i].lastMs = ms;
+        if(slot.numItems[i]) {
+            const float msPerItem = ms / slot.numItems[i];
+            float& avg = _stats[i].msPerItem;
+            avg = avg == 0 ? msPerItem : 0.9f * avg + 0.1f * msPerItem;
+        }
+        updateStats(i);
+        if(_csvFile)
+            fprintf(_csvFile, ",%.4f", ms);
+    }
+    if(_csvFile)
+        fprintf(_csvFile, "\n");
+}
+
+void GpuTimers::updateStats(int pass)
+{
+    const int n = tl::min(_historyHead[pass], k_historySize);
+    float sorted[k_historySize];
+    float sum = 0;
+    for(int i = 0; i < n; i++) {
+        const float x = _history[pass][i];
+        sum += x;
+        // insertion sort, the history is small
+        int j = i;
+        for(; j > 0 && sorted[j-1] > x; j--)
+            sorted[j] = sorted[j-1];
+        sorted[j] = x;
+    }
+    PassStats& stats = _stats[pass];
+    stats.numSamples = n;
+    stats.avgMs = sum / n;
+    stats.p50Ms = sorted[(n-1) * 50 / 100];
+    stats.p95Ms = sorted[(n-1) * 95 / 100];
+    stats.p99Ms = sorted[(n-1) * 99 / 100];
+}
+
+bool GpuTimers::startLog(const char* csvFileName)
+{
+    assert(_csvFile == nullptr);
+    _csvFile = fopen(csvFileName, "w");
+    if(!_csvFile)
+        return false;
+    fprintf(_csvFile, "frame");
+    for(int i = 0; i < k_numPasses; i++)
+        fprintf(_csvFile, ",%s_ms", toStr(EGpuPass(i)));
+    fprintf(_csvFile, "\n");
+    return true;
+}
+
+void GpuTimers::stopLog(const char* jsonFileName)
+{
+    if(_csvFile) {
+        fclose(_csvFile);
+        _csvFile = nullptr;
+    }
+
+    FILE* f = fopen(jsonFileName, "w");
+    if(!f)
+        return;
+    fprintf(f, "{\n  \"frames\": %llu,\n  \"dropped\": %u,\n  \"passes\": [\n",
+        (unsigned long long)_frame, _numDropped);
+    for(int i = 0; i < k_numPasses; i++) {
+        const PassStats& s = _stats[i];
+        fprintf(f, "    {\"name\": \"%s\", \"samples\": %d, \"last_ms\": %.4f, \"avg_ms\": %.4f, "
+            "\"p50_ms\": %.4f, \"p95_ms\": %.4f, \"p99_ms\": %.4f}%s\n",
+            toStr(EGpuPass(i)), s.numSamples, s.lastMs, s.avgMs, s.p50Ms, s.p95Ms, s.p99Ms,
+            i + 1 < k_numPasses ? "," : "");
+    }
+    fprintf(f, "  ]\n}\n");
+    fclose(f);
+}
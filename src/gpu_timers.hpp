@@ -0,0 +1,64 @@
+#pragma once
+
+#include <stdio.h>
+#include <tl/int_types.hpp>
+
+enum class EGpuPass {
+    TRACE, // main_frag.glsl, including the accumulation blend (render thread)
+    PREVIEW, // SH preview and low resolution trace of the first frames after a reset (render thread)
+    REPROJECT, // reproject.glsl: history of the previous view, only after the camera moved (render thread)
+    DENOISE, // denoise_atrous.glsl, all the iterations (render thread)
+    POSTPRO, // render thread
+    PRESENT, // main thread: splat of the latest rendered frame and overlays
+    COUNT
+};
+const char* toStr(EGpuPass pass);
+
+// Ring of GL_TIMESTAMP queries around each pass. The results are read back several frames later, without blocking
+// Query objects are not shared between GL contexts, so each thread that submits passes has its own GpuTimers
+struct GpuTimers {
+    static constexpr int k_numFramesInFlight = 4;
+    static constexpr int k_numPasses = (int)EGpuPass::COUNT;
+    static constexpr int k_historySize = 128; // number of samples used for the rolling stats
+
+    struct PassStats {
+        float lastMs;
+        float avgMs;
+        float p50Ms, p95Ms, p99Ms;
+        float msPerItem; // exponential moving average of the time divided by the numItems passed to endPass
+        int numSamples;
+    };
+
+    void init();
+    void beginPass(EGpuPass pass);
+    void endPass(EGpuPass pass, float numItems = 1); // numItems: units of work in the pass, e.g. number of pixels traced
+    void endFrame();
+
+    const PassStats& stats(EGpuPass pass)const { return _stats[(int)pass]; }
+
+    // every frame that gets read back is appended as a row of the CSV file
+    // when the log is stopped, the rolling stats are written to the JSON file
+    bool startLog(const char* csvFileName);
+    void stopLog(const char* jsonFileName);
+    bool isLogging()const { return _csvFile != nullptr; }
+
+private:
+    struct Slot {
+        u32 queries[k_numPasses][2]; // begin, end
+        float numItems[k_numPasses];
+        u32 issuedMask; // bit i is set if the pass i was timed in this frame
+        u64 frame;
+    };
+    void collect(Slot& slot);
+    void updateStats(int pass);
+
+    Slot _slots[k_numFramesInFlight];
+    u64 _frame = 0;
+    u32 _numDropped = 0; // frames that were not available yet when their slot got reused
+
+    float _history[k_numPasses][k_historySize];
+    int _historyHead[k_numPasses];
+    PassStats _stats[k_numPasses];
+
+    FILE* _csvFile = nullptr;
+};
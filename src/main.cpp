@@ -1,12 +1,26 @@
 #include <stdio.h>
 #include <assert.h>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
 #include <tl/fmt.hpp>
 #include <tl/basic.hpp>
+#include <tl/profiler.hpp>
 #include <tg/shader_utils.hpp>
+#include <tg/img.hpp>
+#include <tg/denoise.hpp>
 #include <glm/glm.hpp>
 #include "utils.hpp"
+#include "gpu_timers.hpp"
+#include "ray_stats.hpp"
+#include "frame_scheduler.hpp"
+#include "triple_buffer.hpp"
+#include "orbit_camera.hpp"
+#include "trace_tiles.hpp"
+#include "env_light.hpp"
 
 using glm::vec3;
 using glm::vec4;
@@ -16,6 +30,28 @@ GLFWwindow* window;
 
 const int k_numSamples = 1000;
 constexpr int k_numBounces = 2;
+const float k_fovY = 1.2f;
+const int k_traceTileSize = 256;
+// estimated GPU time of the trace draws between two flushes. Keeps each submit well below the driver watchdog timeout
+const float k_maxSubmitMs = 10;
+const float k_orbitRadsPerPixel = 0.005f;
+const float k_maxReprojectedSamples = 32; // cap of the history reused after the camera moves
+// after a reset, the first frames are traced at a lower resolution and upsampled by postpro
+// level i divides the resolution by 2^i on each axis. The coarsest level is traced first
+constexpr int k_numPreviewLevels = 2;
+const int k_previewSamples[k_numPreviewLevels] = {2, 1}; // samples per pixel of levels 1, 2
+const tg::ATrousParams k_denoiseParams = {}; // used by both the compute shader and the CPU version
+const float k_targetFrameMs = 16.7f;
+const float k_renderFrameFraction = 0.75f; // fraction of each frame that the GPU spends tracing samples, the rest is idle
+
+const char* k_cpuTraceFile = "cpu_trace.json"; // only written when built with TL_PROFILER
+const char* k_gpuTimingsCsvFile = "gpu_timings.csv";
+const char* k_gpuTimingsJsonFile = "gpu_timings.json";
+const char* k_screenshotFile = "screenshot.png"; // denoised on the CPU
+const char* k_envMapFile = "envmap.hdr"; // equirectangular, .hdr or .pfm. A procedural sky is used if it's missing
+const int k_envTexUnit = 3; // texture unit of the environment map in the trace draws
+const float k_timingsOverlayScaleMs = 33.3f;
+constexpr int k_timingsOverlayMaxPasses = 8; // must match k_maxPasses in timings_overlay.glsl
 
 static const char* getGlErrorStr(GLenum e)
 {
@@ -78,16 +114,10 @@ SphereObj sceneSpheres[] = {
         {1.f, 1.f, 1.f},
         0, 0
     ),
-    SphereObj(
-        {0, 0, 0},
-        1000,
-        0.6f*vec3{1.0f, 1.0f, 1.2f},
-        {0.0f, 0.0f, 0.0f},
-        0, 0
-    ),
+    // the sky is the environment map, see EnvLight
 };
 
-struct {
+struct RayShad {
     u32 prog;
     struct {
         i32 fovFactor;
@@ -95,43 +125,175 @@ struct {
         i32 resolution;
         i32 sampleInd;
         i32 numSamples;
+        i32 envTex;
+        i32 envSize;
     } unifLocs;
-} rayShad;
+};
+
+// variants of main_frag.glsl, selected with defines prepended to the source
+enum ERayShadVariant {
+    RAY_SHAD_VARIANT_RAY_STATS = 1 << 0, // count rays and intersection tests (see RayStats)
+    RAY_SHAD_VARIANT_COST_HEATMAP = 1 << 1, // write the per-pixel cost to textures.cost
+    RAY_SHAD_NUM_VARIANTS = 1 << 2
+};
+
+enum class EDebugView {
+    NONE,
+    TESTS_HEATMAP, // sphere tests per pixel
+    BOUNCES_HEATMAP,
+    COUNT
+};
+RayShad rayShadVariants[RAY_SHAD_NUM_VARIANTS];
+static bool subgroupArithmeticSupported = false;
+
+// render thread copies of the settings in `shared`, updated at the start of each frame
+static EDebugView debugView = EDebugView::NONE;
+static u32 rayShadVariant = 0;
 
 u32 postproProg;
+u32 reprojectProg;
+u32 denoiseProg;
+u32 timingsOverlayProg;
+u32 shPreviewProg;
 
 u32 splatTexProg;
-u32 quadVbo, quadVao;
-u32 fbo;
+u32 quadVbo;
+u32 quadVao; // render thread. VAOs and FBOs are not shared between contexts
+u32 presentQuadVao; // main thread
+u32 fbo; // render thread
 u32 spheresSsbo;
+EnvLight envLight;
+
+GpuTimers gpuTimers; // render thread
+GpuTimers presentGpuTimers; // main thread
+RayStats rayStats; // render thread
+FrameScheduler frameScheduler; // render thread
+TraceTiles traceTiles; // render thread
+static bool showTimings = false; // main thread
+
+// state that the main thread uses to drive the render thread
+static struct {
+    std::mutex mutex;
+    std::condition_variable wakeUp; // the render thread sleeps on this when there is nothing to render
+    std::atomic<bool> quit {false};
+    std::atomic<u32> resetCounter {0}; // incremented when the accumulation has to restart
+    std::atomic<u32> rayShadVariant {0};
+    std::atomic<int> debugView {0};
+    std::atomic<bool> logGpuTimings {false};
+    std::atomic<u64> fbSize {0}; // w | h << 32
+    OrbitCamera camera; // guarded by mutex
+    std::atomic<u32> cameraCounter {0}; // incremented when the camera moves
+    std::atomic<bool> denoise {true};
+    std::atomic<bool> screenshotRequested {false};
+} shared;
+
+static void notifyRenderThread()
+{
+    { std::lock_guard<std::mutex> lock(shared.mutex); }
+    shared.wakeUp.notify_one();
+}
+
+static void requestReset()
+{
+    shared.resetCounter++;
+    notifyRenderThread();
+}
+
+static void moveCamera(float dYaw, float dPitch, float zoomSteps)
+{
+    {
+        std::lock_guard<std::mutex> lock(shared.mutex);
+        shared.camera.orbit(dYaw, dPitch);
+        shared.camera.zoom(zoomSteps);
+        shared.cameraCounter++;
+    }
+    shared.wakeUp.notify_one();
+}
+
+// image produced by the render thread and presented by the main thread
+struct RenderedFrame {
+    u32 tex; // RGBA8, the output of postpro.glsl
+    int w = 0, h = 0;
+    GLsync readyFence = nullptr; // the render thread finished writing tex
+    GLsync presentedFence = nullptr; // the main thread finished reading tex
+    int sampleInd;
+    GpuTimers::PassStats passStats[GpuTimers::k_numPasses];
+    double mraysPerSec, testsPerRay, pathsTerminatedRatio;
+};
+TripleBuffer<RenderedFrame> renderedFrames;
+
+// camera to world, of the current view and of the view that the prev textures were rendered with (render thread)
+static glm::mat4 viewMtx;
+static glm::mat4 prevViewMtx;
 
 struct Textures {
-    u32 accum;
-    u32 tonemapped;
+    static constexpr int k_num = 9 + k_numPreviewLevels;
+    u32 accum; // RGBA32F: sum of the samples, number of samples (additive blending)
+    u32 prevAccum; // accumulation of the previous view, swapped with accum when the camera moves
+    u32 hit; // RGBA32F: world normal and distance of the primary hit of the last sample
+    u32 prevHit;
+    u32 denoised[2]; // RGBA32F: ping-pong targets of the denoiser iterations
+    u32 preview[k_numPreviewLevels]; // RGBA32F like accum, at the resolution of each preview level
+    u32 albedo; // RGBA8: albedo of the primary hit of the last sample
+    u32 cost; // RG32UI: sphere tests and bounces of the last sample (written by the COST_HEATMAP variant)
+    u32 shPreview; // RGBA32F like accum with A = 1: the spherical harmonics preview (sh_preview.glsl)
+    int w = 0, h = 0;
     void init();
-    void resize(int w, int h);
-} textures;
+    bool resize(int w, int h); // returns true if the textures were reallocated
+    void swapHistory();
+} textures; // render thread
+
+static void initTexParams(u32 tex)
+{
+    glBindTexture(GL_TEXTURE_2D, tex);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+}
 
 void Textures::init()
 {
     u32* tex = &accum;
-    glGenTextures(2, tex);
-    for(int i = 0; i < 2; i++) {
-        glBindTexture(GL_TEXTURE_2D, tex[i]);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glGenTextures(k_num, tex);
+    for(int i = 0; i < k_num; i++)
+        initTexParams(tex[i]);
+    for(u32 t : preview) {
+        glBindTexture(GL_TEXTURE_2D, t); // upsampled with bilinear filtering
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
     }
 }
 
-void Textures::resize(int w, int h)
+bool Textures::resize(int w, int h)
 {
+    if(w == this->w && h == this->h)
+        return false;
+    this->w = w;
+    this->h = h;
     u32* tex = &accum;
-    for(int i = 0; i < 2; i++) {
+    for(int i = 0; i < 6; i++) {
         glBindTexture(GL_TEXTURE_2D, tex[i]);
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB32F, w, h, 0, GL_RGB, GL_FLOAT, nullptr);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, w, h, 0, GL_RGBA, GL_FLOAT, nullptr);
     }
+    for(int i = 0; i < k_numPreviewLevels; i++) {
+        glBindTexture(GL_TEXTURE_2D, preview[i]);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, tl::max(1, w >> (i+1)), tl::max(1, h >> (i+1)),
+            0, GL_RGBA, GL_FLOAT, nullptr);
+    }
+    glBindTexture(GL_TEXTURE_2D, albedo);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, w, h, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    glBindTexture(GL_TEXTURE_2D, cost);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RG32UI, w, h, 0, GL_RG_INTEGER, GL_UNSIGNED_INT, nullptr);
+    glBindTexture(GL_TEXTURE_2D, shPreview);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, w, h, 0, GL_RGBA, GL_FLOAT, nullptr);
+    return true;
+}
+
+void Textures::swapHistory()
+{
+    tl::swap(accum, prevAccum);
+    tl::swap(hit, prevHit);
 }
 
 template <i32 N>
@@ -201,8 +363,117 @@ u32 makeShaderProg(u32 vertShad, const char* fragFileName)
     return prog;
 }
 
+u32 makeComputeProg(const char* fileName)
+{
+    const u32 shad = makeShader(GL_COMPUTE_SHADER, fileName);
+    defer(glDeleteShader(shad));
+
+    const u32 prog = glCreateProgram();
+    glAttachShader(prog, shad);
+    glLinkProgram(prog);
+    if(const char* errMsg = tg::checkLinkErrors(prog, g_scratch)) {
+        tl::eprintln("Error linking: ", fileName);
+        tl::eprintln(errMsg);
+        assert(false);
+    }
+    return prog;
+}
+
+// GL_KHR_shader_subgroup is not in our glad
+static bool checkSubgroupArithmeticSupport()
+{
+    constexpr GLenum GL_SUBGROUP_SUPPORTED_STAGES_KHR = 0x9533;
+    constexpr GLenum GL_SUBGROUP_SUPPORTED_FEATURES_KHR = 0x9534;
+    constexpr i32 GL_SUBGROUP_FEATURE_BASIC_BIT_KHR = 0x1;
+    constexpr i32 GL_SUBGROUP_FEATURE_ARITHMETIC_BIT_KHR = 0x4;
+
+    i32 numExtensions = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &numExtensions);
+    bool found = false;
+    for(i32 i = 0; i < numExtensions && !found; i++)
+        found = strcmp((const char*)glGetStringi(GL_EXTENSIONS, i), "GL_KHR_shader_subgroup") == 0;
+    if(!found)
+        return false;
+
+    i32 stages = 0, features = 0;
+    glGetIntegerv(GL_SUBGROUP_SUPPORTED_STAGES_KHR, &stages);
+    glGetIntegerv(GL_SUBGROUP_SUPPORTED_FEATURES_KHR, &features);
+    const i32 neededFeatures = GL_SUBGROUP_FEATURE_BASIC_BIT_KHR | GL_SUBGROUP_FEATURE_ARITHMETIC_BIT_KHR;
+    return (stages & GL_FRAGMENT_SHADER_BIT) && (features & neededFeatures) == neededFeatures;
+}
+
+static void compileRayShader(RayShad& shad, u32 vertShad, u32 variant)
+{
+    const char* fragFileName = "src/shaders/main_frag.glsl";
+    const u32 fragShad = glCreateShader(GL_FRAGMENT_SHADER);
+    defer(glDeleteShader(fragShad));
+    const char* src = loadStr(fragFileName);
+    defer(delete[] src);
+
+    // extensions have to go before any other token, so the variant defines are uploaded before util.glsl
+    char variantDefines[512];
+    tl::FmtBuffer definesBuf(variantDefines, sizeof(variantDefines));
+    if(variant & RAY_SHAD_VARIANT_RAY_STATS) {
+        tl::fmtBufferAppend(definesBuf, "#define RAY_STATS\n");
+        if(subgroupArithmeticSupported) {
+            tl::fmtBufferAppend(definesBuf,
+                "#extension GL_KHR_shader_subgroup_basic : require\n"
+                "#extension GL_KHR_shader_subgroup_arithmetic : require\n"
+                "#define SUBGROUP_ATOMICS\n");
+        }
+    }
+    if(variant & RAY_SHAD_VARIANT_COST_HEATMAP)
+        tl::fmtBufferAppend(definesBuf, "#define COST_HEATMAP\n");
+    definesBuf.addNullTerminator();
+
+    char constants[128];
+    tl::toStringBuffer(constants,
+        "const int k_numBounces = ", k_numBounces, ";\n");
+    const char* srcs[] = {s_glslVersion, variantDefines, s_glslUtilSrc, constants, src};
+    uploadSrcs(fragShad, srcs);
+    glCompileShader(fragShad);
+    if(const char* errMsg = tg::checkCompileErrors(fragShad, g_scratch)) {
+        tl::eprintln("Error compiling: ", fragFileName, " (variant ", variant, ")");
+        tl::eprintln(errMsg);
+        assert(false);
+    }
+
+    shad.prog = glCreateProgram();
+    glAttachShader(shad.prog, vertShad);
+    glAttachShader(shad.prog, fragShad);
+    glLinkProgram(shad.prog);
+    if(const char* errMsg = tg::checkLinkErrors(shad.prog, g_scratch)) {
+        tl::eprintln("Error linking: main_vert.glsl + ", fragFileName, " (variant ", variant, ")");
+        tl::eprintln(errMsg);
+        assert(false);
+    }
+
+    shad.unifLocs.fovFactor =
+        glGetUniformLocation(shad.prog, "u_fovFactor");
+    assert(shad.unifLocs.fovFactor != -1);
+    shad.unifLocs.viewMtx =
+        glGetUniformLocation(shad.prog, "u_viewMtx");
+    assert(shad.unifLocs.viewMtx != -1);
+    shad.unifLocs.resolution =
+        glGetUniformLocation(shad.prog, "u_resolution");
+    assert(shad.unifLocs.resolution != -1);
+    shad.unifLocs.sampleInd =
+        glGetUniformLocation(shad.prog, "u_sampleInd");
+    assert(shad.unifLocs.sampleInd != -1);
+    shad.unifLocs.numSamples =
+        glGetUniformLocation(shad.prog, "u_numSamples");
+    assert(shad.unifLocs.numSamples != -1);
+    shad.unifLocs.envTex =
+        glGetUniformLocation(shad.prog, "u_envTex");
+    assert(shad.unifLocs.envTex != -1);
+    shad.unifLocs.envSize =
+        glGetUniformLocation(shad.prog, "u_envSize");
+    assert(shad.unifLocs.envSize != -1);
+}
+
 static void compileShaders()
 {
+    TL_PROFILE_ZONE("compileShaders");
     s_glslUtilSrc = loadStr("src/shaders/util.glsl");
     defer(delete[] s_glslUtilSrc);
 
@@ -214,51 +485,24 @@ static void compileShaders()
     // --- postpro ---
     postproProg = makeShaderProg(vertShad, "src/shaders/postpro.glsl");
 
-    // --- main ---
-    {
-        const char* vertFileName = "src/shaders/main_vert.glsl";
-        const u32 vertShad = makeShader(GL_VERTEX_SHADER, vertFileName);
-
-        const char* fragFileName = "src/shaders/main_frag.glsl";
-        const u32 fragShad = glCreateShader(GL_FRAGMENT_SHADER);
-        const char* src = loadStr(fragFileName);
-        defer(delete[] src);
-        tl::toStringBuffer(g_scratch,
-            "const int k_numBounces = ", k_numBounces, ";\n");
-        const char* srcs[] = {s_glslVersion, s_glslUtilSrc, g_scratch, src};
-        uploadSrcs(fragShad, srcs);
-        glCompileShader(fragShad);
-        if(const char* errMsg = tg::checkCompileErrors(fragShad, g_scratch)) {
-            tl::eprintln("Error compiling: ", fragFileName);
-            tl::eprintln(errMsg);
-            assert(false);
-        }
+    // --- reproject ---
+    reprojectProg = makeShaderProg(vertShad, "src/shaders/reproject.glsl");
 
-        rayShad.prog = glCreateProgram();
-        glAttachShader(rayShad.prog, vertShad);
-        glAttachShader(rayShad.prog, fragShad);
-        glLinkProgram(rayShad.prog);
-        if(const char* errMsg = tg::checkLinkErrors(rayShad.prog, g_scratch)) {
-            tl::eprintln("Error linking: ", vertFileName, " + ", fragFileName);
-            tl::eprintln(errMsg);
-            assert(false);
-        }
+    // --- denoise ---
+    denoiseProg = makeComputeProg("src/shaders/denoise_atrous.glsl");
+
+    // --- timings overlay ---
+    timingsOverlayProg = makeShaderProg(vertShad, "src/shaders/timings_overlay.glsl");
+
+    // --- spherical harmonics preview ---
+    shPreviewProg = makeShaderProg(vertShad, "src/shaders/sh_preview.glsl");
 
-        rayShad.unifLocs.fovFactor =
-            glGetUniformLocation(rayShad.prog, "u_fovFactor");
-        assert(rayShad.unifLocs.fovFactor != -1);
-        rayShad.unifLocs.viewMtx =
-            glGetUniformLocation(rayShad.prog, "u_viewMtx");
-        assert(rayShad.unifLocs.viewMtx != -1);
-        rayShad.unifLocs.resolution =
-            glGetUniformLocation(rayShad.prog, "u_resolution");
-        assert(rayShad.unifLocs.resolution != -1);
-        rayShad.unifLocs.sampleInd =
-            glGetUniformLocation(rayShad.prog, "u_sampleInd");
-        assert(rayShad.unifLocs.sampleInd != -1);
-        rayShad.unifLocs.numSamples =
-            glGetUniformLocation(rayShad.prog, "u_numSamples");
-        assert(rayShad.unifLocs.numSamples != -1);
+    // --- main ---
+    {
+        const u32 vertShad = makeShader(GL_VERTEX_SHADER, "src/shaders/main_vert.glsl");
+        defer(glDeleteShader(vertShad));
+        for(u32 variant = 0; variant < RAY_SHAD_NUM_VARIANTS; variant++)
+            compileRayShader(rayShadVariants[variant], vertShad, variant);
     }
 }
 
@@ -271,69 +515,661 @@ static void glErrorCallback(const char *name, void *funcptr, int len_args, ...)
     }
 }
 
+int sampleInd = 0; // render thread. Samples that covered the whole screen, traceTiles.cursor tracks the current one
+// render thread. The camera moved: the history in the prev textures is added once the first sample of the new view is complete
+static bool reprojectPending = false;
+static bool swapHistoryPending = false;
+// render thread. The first frame after a reset is the spherical harmonics preview, then the preview levels are traced
+static bool shPreviewPending = true;
+int previewLevel = k_numPreviewLevels; // render thread. Next preview level to trace, 0 once we are accumulating at full resolution
+static bool needsPresent = true; // main thread
+
 static void keyCallback(GLFWwindow* window, int key, int scancode, int action, int mods)
 {
-    if(key == GLFW_KEY_ESCAPE && action == GLFW_PRESS)
+    if(action != GLFW_PRESS)
+        return;
+    needsPresent = true;
+    if(key == GLFW_KEY_ESCAPE)
         glfwSetWindowShouldClose(window, 1);
+    else if(key == GLFW_KEY_F1) {
+        showTimings = !showTimings;
+        if(!showTimings)
+            glfwSetWindowTitle(window, "raygl");
+    }
+    else if(key == GLFW_KEY_F3) {
+        const u32 variant = shared.rayShadVariant.fetch_xor(RAY_SHAD_VARIANT_RAY_STATS);
+        if((variant & RAY_SHAD_VARIANT_RAY_STATS) && !showTimings)
+            glfwSetWindowTitle(window, "raygl");
+        notifyRenderThread();
+    }
+    else if(key == GLFW_KEY_F4) {
+        const int view = (shared.debugView + 1) % (int)EDebugView::COUNT;
+        shared.debugView = view;
+        if(EDebugView(view) == EDebugView::NONE)
+            shared.rayShadVariant &= ~RAY_SHAD_VARIANT_COST_HEATMAP;
+        else
+            shared.rayShadVariant |= RAY_SHAD_VARIANT_COST_HEATMAP;
+        requestReset(); // otherwise the heatmap would never be written once the image has converged
+    }
+    else if(key == GLFW_KEY_F5) {
+        shared.denoise = !shared.denoise;
+        notifyRenderThread();
+    }
+    else if(key == GLFW_KEY_F12) {
+        shared.screenshotRequested = true;
+        notifyRenderThread();
+    }
+    else if(key == GLFW_KEY_F2) {
+        shared.logGpuTimings = !shared.logGpuTimings;
+        notifyRenderThread();
+    }
 }
 
-static bool needToRedraw = true;
-int sampleInd = 0;
 static void windowResizeCallback(GLFWwindow* window, int w, int h)
 {
-    sampleInd = 0;
+    // the accumulation is restarted when the main loop sees the new framebuffer size
+    needsPresent = true;
 }
 
-static void draw(int w, int h)
+// dragging with the left button orbits the camera, the scroll wheel zooms
+static bool draggingCamera = false;
+static double lastCursorX, lastCursorY;
+
+static void mouseButtonCallback(GLFWwindow* window, int button, int action, int mods)
 {
-    if(sampleInd == k_numSamples)
+    if(button != GLFW_MOUSE_BUTTON_LEFT)
         return;
-    //printf("%d\n", sampleInd);
-    textures.resize(w, h);
-    float aspectRatio = float(w) / h;
-    const float fovY = 1.2;
-    const float fovFactorY = tan(0.5f * fovY);
-    const float fovFactorX = aspectRatio * fovFactorY;
-    const glm::mat4 viewMtx(
-        1, 0, 0, 0,
-        0, 1, 0, 0,
-        0, 0, 1, 0,
-        0, 0, 10, 0);
+    draggingCamera = action == GLFW_PRESS;
+    glfwGetCursorPos(window, &lastCursorX, &lastCursorY);
+}
 
-    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
-        GL_TEXTURE_2D, textures.accum, 0);
-    assert(glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE);
-    const GLenum mainPassDrawBuffers[] = {GL_COLOR_ATTACHMENT0};
-    glDrawBuffers(tl::size(mainPassDrawBuffers), mainPassDrawBuffers);
-    //glClearColor(0, 0, 0, 0);
-    //glClear(GL_COLOR_BUFFER_BIT);
+static void cursorPosCallback(GLFWwindow* window, double x, double y)
+{
+    if(!draggingCamera)
+        return;
+    const float dx = float(x - lastCursorX);
+    const float dy = float(y - lastCursorY);
+    lastCursorX = x;
+    lastCursorY = y;
+    moveCamera(-k_orbitRadsPerPixel * dx, k_orbitRadsPerPixel * dy, 0);
+}
 
-    glEnable(GL_BLEND);
-    //glBlendFunc(GL_ONE, GL_ONE); // add
-    glBlendFunc(GL_ONE_MINUS_CONSTANT_ALPHA, GL_CONSTANT_ALPHA);
+static void scrollCallback(GLFWwindow* window, double dx, double dy)
+{
+    moveCamera(0, 0, float(dy));
+}
+
+static glm::vec2 calcFovFactors(int w, int h)
+{
+    const float fovFactorY = tan(0.5f * k_fovY);
+    return {float(w) / h * fovFactorY, fovFactorY};
+}
+
+// Adds the history of the previous view, reprojected with the primary hits that were just traced
+// The history is only reused where the previous view saw the same surface (similar distance and normal)
+static void reprojectHistory(int w, int h)
+{
+    TL_PROFILE_ZONE("reprojectHistory");
+    gpuTimers.beginPass(EGpuPass::REPROJECT);
+    glDrawBuffer(GL_COLOR_ATTACHMENT0); // additive blending is still enabled
+    const glm::mat4 prevViewMtxInv = glm::inverse(prevViewMtx);
+    const glm::vec2 fovFactors = calcFovFactors(w, h);
+    glUseProgram(reprojectProg);
+    glUniform1i(0, 0);
+    glUniform1i(1, 1);
+    glUniform1i(2, 2);
+    glUniformMatrix4fv(3, 1, GL_FALSE, &viewMtx[0][0]);
+    glUniformMatrix4fv(7, 1, GL_FALSE, &prevViewMtxInv[0][0]);
+    glUniform2f(11, fovFactors.x, fovFactors.y);
+    glUniform1f(12, k_maxReprojectedSamples);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, textures.hit);
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D, textures.prevAccum);
+    glActiveTexture(GL_TEXTURE2);
+    glBindTexture(GL_TEXTURE_2D, textures.prevHit);
+    glActiveTexture(GL_TEXTURE0);
+    glBindVertexArray(quadVao);
+    glDrawArrays(GL_TRIANGLES, 0, 6);
+    gpuTimers.endPass(EGpuPass::REPROJECT);
+}
 
+// w, h: resolution of the render target. The rays always cover the whole view
+static void useRayShad(const RayShad& rayShad, int w, int h, glm::vec2 fovFactors)
+{
     glUseProgram(rayShad.prog);
-    glUniform2f(rayShad.unifLocs.fovFactor, fovFactorX, fovFactorY);
+    glUniform2f(rayShad.unifLocs.fovFactor, fovFactors.x, fovFactors.y);
     glUniformMatrix4fv(rayShad.unifLocs.viewMtx, 1, GL_FALSE, &viewMtx[0][0]);
     glUniform1i(rayShad.unifLocs.numSamples, k_numSamples);
     glUniform2i(rayShad.unifLocs.resolution, w, h);
+    glUniform1i(rayShad.unifLocs.envTex, k_envTexUnit);
+    glUniform2i(rayShad.unifLocs.envSize, envLight.width(), envLight.height());
 
     glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, spheresSsbo);
+    envLight.bind(k_envTexUnit);
 
     glBindVertexArray(quadVao);
+}
 
-    //for(int sampleInd = 0; sampleInd < k_numSamples; sampleInd++)
+// Traces the current preview level: a few samples at a fraction of the resolution
+// The preview shader variant doesn't count ray stats nor write the cost, and doesn't touch the full resolution accumulation
+static void drawPreview(int w, int h)
+{
+    TL_PROFILE_ZONE("drawPreview");
+    assert(previewLevel > 0 && previewLevel <= k_numPreviewLevels);
+    textures.resize(w, h);
+    const int pw = tl::max(1, w >> previewLevel);
+    const int ph = tl::max(1, h >> previewLevel);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+        GL_TEXTURE_2D, textures.preview[previewLevel - 1], 0);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1,
+        GL_TEXTURE_2D, 0, 0);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT2,
+        GL_TEXTURE_2D, 0, 0);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT3,
+        GL_TEXTURE_2D, 0, 0);
+    assert(glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE);
+    glDrawBuffer(GL_COLOR_ATTACHMENT0);
+    const float zeros[4] = {0, 0, 0, 0};
+    glClearBufferfv(GL_COLOR, 0, zeros);
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_ONE, GL_ONE);
+
+    glViewport(0, 0, pw, ph);
+    useRayShad(rayShadVariants[0], pw, ph, calcFovFactors(w, h));
+    const int numSamples = k_previewSamples[previewLevel - 1];
+    gpuTimers.beginPass(EGpuPass::PREVIEW);
+    for(int i = 0; i < numSamples; i++) {
+        glUniform1i(rayShadVariants[0].unifLocs.sampleInd, i);
+        glDrawArrays(GL_TRIANGLES, 0, 6);
+    }
+    gpuTimers.endPass(EGpuPass::PREVIEW, numSamples);
+    glViewport(0, 0, w, h);
+}
+
+// Shades the primary hits with the SH irradiance of the environment (EnvLight::shIrradiance) and its mirror reflection
+// It's a single cheap full resolution draw, so it gives a plausible image before the first traced samples
+static void drawShPreview(int w, int h)
+{
+    TL_PROFILE_ZONE("drawShPreview");
+    textures.resize(w, h);
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+        GL_TEXTURE_2D, textures.shPreview, 0);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1,
+        GL_TEXTURE_2D, 0, 0);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT2,
+        GL_TEXTURE_2D, 0, 0);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT3,
+        GL_TEXTURE_2D, 0, 0);
+    assert(glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE);
+    glDrawBuffer(GL_COLOR_ATTACHMENT0);
+    glDisable(GL_BLEND);
+
+    const glm::vec2 fovFactors = calcFovFactors(w, h);
+    glUseProgram(shPreviewProg);
+    glUniform1i(0, k_envTexUnit);
+    glUniformMatrix4fv(1, 1, GL_FALSE, &viewMtx[0][0]);
+    glUniform2f(5, fovFactors.x, fovFactors.y);
+    glUniform3fv(6, 9, &envLight.shIrradiance().coefs[0][0]);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, spheresSsbo);
+    envLight.bind(k_envTexUnit);
+    gpuTimers.beginPass(EGpuPass::PREVIEW);
+    glBindVertexArray(quadVao);
+    glDrawArrays(GL_TRIANGLES, 0, 6);
+    gpuTimers.endPass(EGpuPass::PREVIEW);
+}
+
+// Traces tiles, in the order of traceTiles, until the GPU budget of the frame is spent
+static void draw(int w, int h, float gpuBudgetMs, int maxSamples)
+{
+    if(sampleInd == k_numSamples)
+        return;
+    TL_PROFILE_ZONE("draw");
+    //printf("%d\n", sampleInd);
+    if(textures.resize(w, h))
+        reprojectPending = swapHistoryPending = false;
+    if(swapHistoryPending) {
+        textures.swapHistory();
+        swapHistoryPending = false;
+    }
+    traceTiles.resize(w, h);
+    const glm::vec2 fovFactors = calcFovFactors(w, h);
+    const RayShad& rayShad = rayShadVariants[rayShadVariant];
+    const bool countRayStats = rayShadVariant & RAY_SHAD_VARIANT_RAY_STATS;
+    const bool writeCost = rayShadVariant & RAY_SHAD_VARIANT_COST_HEATMAP;
+
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+        GL_TEXTURE_2D, textures.accum, 0);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1,
+        GL_TEXTURE_2D, writeCost ? textures.cost : 0, 0);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT2,
+        GL_TEXTURE_2D, textures.hit, 0);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT3,
+        GL_TEXTURE_2D, textures.albedo, 0);
+    assert(glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE);
+    const GLenum mainPassDrawBuffers[] = {
+        GL_COLOR_ATTACHMENT0, writeCost ? GLenum(GL_COLOR_ATTACHMENT1) : GLenum(GL_NONE),
+        GL_COLOR_ATTACHMENT2, GL_COLOR_ATTACHMENT3};
+    glDrawBuffers(4, mainPassDrawBuffers);
+    if(sampleInd == 0 && traceTiles.cursor == 0) {
+        const float zeros[4] = {0, 0, 0, 0};
+        glClearBufferfv(GL_COLOR, 0, zeros);
+    }
+
+    // the samples are added up, postpro divides by the count in A
+    // blending is ignored for the integer cost attachment, and the hit and albedo attachments are just overwritten
+    glEnable(GL_BLEND);
+    glDisablei(GL_BLEND, 2);
+    glDisablei(GL_BLEND, 3);
+    glBlendFunc(GL_ONE, GL_ONE);
+
+    useRayShad(rayShad, w, h, fovFactors);
+    glEnable(GL_SCISSOR_TEST);
+
+    // the cost of a tile is estimated from the measured time per pixel of the previous frames
+    // until there is a measurement, we trace one sample of the whole screen
+    const float msPerPixel = gpuTimers.stats(EGpuPass::TRACE).msPerItem;
+    float frameMs = 0, submitMs = 0;
+    int numPixels = 0, submitNumPixels = 0;
+    int numSamples = 0;
+    bool reproject = false;
+    if(countRayStats)
+        rayStats.beginFrame();
+    gpuTimers.beginPass(EGpuPass::TRACE);
+    for(;;)
     {
-        glBlendColor(0, 0, 0, float(sampleInd) / (sampleInd + 1));
+        const TraceTiles::Tile& tile = traceTiles.current();
+        const float tileMs = msPerPixel * tile.w * tile.h;
+        if(numPixels && msPerPixel > 0 && frameMs + tileMs > gpuBudgetMs)
+            break;
+        // without a measurement, each tile is submitted on its own
+        if(submitNumPixels && (msPerPixel == 0 || submitMs + tileMs > k_maxSubmitMs)) {
+            glFlush();
+            submitMs = 0;
+            submitNumPixels = 0;
+        }
+        glScissor(tile.x, tile.y, tile.w, tile.h);
         glUniform1i(rayShad.unifLocs.sampleInd, sampleInd);
         glDrawArrays(GL_TRIANGLES, 0, 6);
-        sampleInd++;
+        frameMs += tileMs;
+        submitMs += tileMs;
+        numPixels += tile.w * tile.h;
+        submitNumPixels += tile.w * tile.h;
+
+        if(traceTiles.advance()) {
+            sampleInd++;
+            numSamples++;
+            if(reprojectPending) {
+                // the hits of the new view are complete, so the history can be reprojected
+                reprojectPending = false;
+                reproject = true;
+                break;
+            }
+            if(sampleInd == k_numSamples || numSamples == maxSamples || msPerPixel == 0)
+                break;
+        }
+    }
+    gpuTimers.endPass(EGpuPass::TRACE, numPixels);
+    if(countRayStats)
+        rayStats.endFrame();
+    glDisable(GL_SCISSOR_TEST);
+
+    if(reproject)
+        reprojectHistory(w, h);
+}
+
+// srcTex: RGB divided by A is the color to tonemap
+static void postpro(RenderedFrame& frame, int w, int h, u32 srcTex)
+{
+    TL_PROFILE_ZONE("postpro");
+    if(frame.w != w || frame.h != h) {
+        frame.w = w;
+        frame.h = h;
+        glBindTexture(GL_TEXTURE_2D, frame.tex);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, w, h, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+        GL_TEXTURE_2D, frame.tex, 0);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1,
+        GL_TEXTURE_2D, 0, 0);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT2,
+        GL_TEXTURE_2D, 0, 0);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT3,
+        GL_TEXTURE_2D, 0, 0);
+    assert(glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE);
+    glDrawBuffer(GL_COLOR_ATTACHMENT0);
+    glDisable(GL_BLEND);
+    glDisable(GL_DEPTH_TEST);
+
+    gpuTimers.beginPass(EGpuPass::POSTPRO);
+    glUseProgram(postproProg);
+    glUniform1i(0, 0);
+    glUniform1i(1, 1);
+    glUniform1i(2, (int)debugView);
+    glUniform1f(3, debugView == EDebugView::TESTS_HEATMAP ?
+        // 3 color channels are traced independently, and each bounce also traces a shadow ray towards the environment
+        2 * 3 * k_numBounces * tl::size(sceneSpheres) :
+        3 * (k_numBounces - 1));
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, srcTex);
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D, textures.cost);
+    glActiveTexture(GL_TEXTURE0);
+    glBindVertexArray(quadVao);
+    glDrawArrays(GL_TRIANGLES, 0, 6);
+    gpuTimers.endPass(EGpuPass::POSTPRO);
+}
+
+// Edge-avoiding à-trous filter of the accumulation, one compute dispatch per iteration
+// Returns the texture with the result
+static u32 denoise(int w, int h)
+{
+    TL_PROFILE_ZONE("denoise");
+    const tg::ATrousParams& params = k_denoiseParams;
+    gpuTimers.beginPass(EGpuPass::DENOISE);
+    glUseProgram(denoiseProg);
+    glUniform1i(0, 0);
+    glUniform1i(1, 1);
+    glUniform1i(2, 2);
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D, textures.hit);
+    glActiveTexture(GL_TEXTURE2);
+    glBindTexture(GL_TEXTURE_2D, textures.albedo);
+    glActiveTexture(GL_TEXTURE0);
+    u32 src = textures.accum;
+    for(int i = 0; i < params.numIterations; i++) {
+        const u32 dst = textures.denoised[i % 2];
+        const float sigmaColor = params.sigmaColor / float(1 << i);
+        glUniform1i(3, 1 << i);
+        glUniform4f(4, 1 / (sigmaColor * sigmaColor), 1 / (params.sigmaNormal * params.sigmaNormal),
+            1 / (params.sigmaDepth * params.sigmaDepth), 1 / (params.sigmaAlbedo * params.sigmaAlbedo));
+        glBindTexture(GL_TEXTURE_2D, src);
+        glBindImageTexture(0, dst, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA32F);
+        glDispatchCompute((w + 7) / 8, (h + 7) / 8, 1);
+        glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+        src = dst;
+    }
+    gpuTimers.endPass(EGpuPass::DENOISE);
+    return src;
+}
+
+// reads back the accumulation and the guide buffers, and saves them denoised on the CPU
+static void saveScreenshot()
+{
+    TL_PROFILE_ZONE("saveScreenshot");
+    const int w = textures.w, h = textures.h;
+    if(w == 0 || h == 0)
+        return;
+    tg::Img4f accum(w, h), hit(w, h);
+    tg::Img3f albedo(w, h), color(w, h), tonemapped(w, h);
+    glBindTexture(GL_TEXTURE_2D, textures.accum);
+    glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_FLOAT, accum.data());
+    glBindTexture(GL_TEXTURE_2D, textures.hit);
+    glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_FLOAT, hit.data());
+    glBindTexture(GL_TEXTURE_2D, textures.albedo);
+    glGetTexImage(GL_TEXTURE_2D, 0, GL_RGB, GL_FLOAT, albedo.data());
+
+    for(int y = 0; y < h; y++)
+    for(int x = 0; x < w; x++) {
+        const glm::vec4& a = accum(x, y);
+        color(x, y) = a.a > 0 ? glm::vec3(a) / a.a : glm::vec3(0);
+    }
+    tg::denoiseATrous(color, color, hit, albedo, k_denoiseParams);
+
+    // GL images are bottom-up. The tonemapping is the same as postpro.glsl, done while converting to 8 bits
+    for(int y = 0; y < h; y++)
+    for(int x = 0; x < w; x++)
+        tonemapped(x, h - 1 - y) = color(x, y);
+    if(tonemapped.save(k_screenshotFile, 90, tg::ETonemap::REINHARD))
+        tl::println("screenshot saved: ", k_screenshotFile);
+    else
+        tl::eprintln("error saving: ", k_screenshotFile);
+}
+
+// the trace and postpro timings come from the render thread, along with the frame
+static const GpuTimers::PassStats& passStats(const RenderedFrame& frame, EGpuPass pass)
+{
+    if(pass == EGpuPass::PRESENT)
+        return presentGpuTimers.stats(pass);
+    return frame.passStats[(int)pass];
+}
+
+static void drawTimingsOverlay(const RenderedFrame& frame, int w, int h)
+{
+    TL_PROFILE_ZONE("drawTimingsOverlay");
+    constexpr int numPasses = GpuTimers::k_numPasses;
+    static_assert(numPasses <= k_timingsOverlayMaxPasses);
+    float avgMs[numPasses], p95Ms[numPasses];
+    for(int i = 0; i < numPasses; i++) {
+        const GpuTimers::PassStats& stats = passStats(frame, EGpuPass(i));
+        avgMs[i] = stats.avgMs;
+        p95Ms[i] = stats.p95Ms;
+    }
+
+    const int barH = 14;
+    glViewport(10, h - 10 - numPasses * barH, 300, numPasses * barH);
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    glUseProgram(timingsOverlayProg);
+    glUniform1i(0, numPasses);
+    glUniform1f(1, k_timingsOverlayScaleMs);
+    glUniform1fv(2, numPasses, avgMs);
+    glUniform1fv(2 + k_timingsOverlayMaxPasses, numPasses, p95Ms);
+    glBindVertexArray(presentQuadVao);
+    glDrawArrays(GL_TRIANGLES, 0, 6);
+    glDisable(GL_BLEND);
+    glViewport(0, 0, w, h);
+}
+
+// the numbers go to the window title, we don't have text rendering
+static void updateStatsTitle(const RenderedFrame& frame)
+{
+    const bool showRayStats = shared.rayShadVariant & RAY_SHAD_VARIANT_RAY_STATS;
+    if(!showTimings && !showRayStats)
+        return;
+    static double lastTitleTime = 0;
+    const double t = glfwGetTime();
+    if(t - lastTitleTime < 0.5)
+        return;
+    lastTitleTime = t;
+
+    char* title = g_scratch;
+    int n = snprintf(title, sizeof(g_scratch), "raygl | %d/%d samples", frame.sampleInd, k_numSamples);
+    if(showRayStats) {
+        n += snprintf(title + n, sizeof(g_scratch) - n, " | %.1f Mrays/s, %.2f tests/ray, %.1f%% escaped",
+            frame.mraysPerSec, frame.testsPerRay, 100 * frame.pathsTerminatedRatio);
+    }
+    if(showTimings) {
+        for(int i = 0; i < GpuTimers::k_numPasses; i++) {
+            const GpuTimers::PassStats& stats = passStats(frame, EGpuPass(i));
+            n += snprintf(title + n, sizeof(g_scratch) - n, " | %s %.2fms (p95 %.2f, p99 %.2f)",
+                toStr(EGpuPass(i)), stats.avgMs, stats.p95Ms, stats.p99Ms);
+        }
+    }
+    glfwSetWindowTitle(window, title);
+}
+
+static void createQuadVao(u32& vao)
+{
+    glGenVertexArrays(1, &vao);
+    glBindVertexArray(vao);
+    glBindBuffer(GL_ARRAY_BUFFER, quadVbo);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 0, nullptr);
+}
+
+// The render thread accumulates samples and tonemaps them into the back RenderedFrame
+// It has its own GL context, shared with the window's, so a slow batch of samples never blocks the event handling
+static void renderThreadMain(GLFWwindow* renderContext)
+{
+    TL_PROFILE_THREAD_NAME("render");
+    glfwMakeContextCurrent(renderContext);
+
+    createQuadVao(quadVao);
+    glGenFramebuffers(1, &fbo);
+    textures.init();
+    gpuTimers.init();
+    rayStats.init();
+    frameScheduler.targetFrameMs = k_targetFrameMs;
+    frameScheduler.renderFraction = k_renderFrameFraction;
+    traceTiles.tileSize = k_traceTileSize;
+
+    u32 seenResetCounter = shared.resetCounter;
+    u32 seenCameraCounter = shared.cameraCounter;
+    {
+        std::lock_guard<std::mutex> lock(shared.mutex);
+        viewMtx = prevViewMtx = shared.camera.viewMtx();
+    }
+    bool denoiseEnabled = shared.denoise;
+    bool needsPostpro = false; // a setting that only affects the postprocessing changed
+    auto somethingChanged = [&]() {
+        return shared.quit || shared.resetCounter != seenResetCounter ||
+            shared.cameraCounter != seenCameraCounter ||
+            shared.logGpuTimings != gpuTimers.isLogging() ||
+            shared.denoise != denoiseEnabled || shared.rayShadVariant != rayShadVariant ||
+            shared.screenshotRequested;
+    };
+    while(!shared.quit)
+    {
+        if(shared.cameraCounter != seenCameraCounter) {
+            std::lock_guard<std::mutex> lock(shared.mutex);
+            seenCameraCounter = shared.cameraCounter;
+            // if the camera moves several times before the history is used, the oldest view is kept
+            if(!reprojectPending && (sampleInd > 0 || traceTiles.cursor > 0)) {
+                prevViewMtx = viewMtx;
+                reprojectPending = swapHistoryPending = true;
+            }
+            viewMtx = shared.camera.viewMtx();
+            sampleInd = 0;
+            traceTiles.cursor = 0;
+        }
+        if(shared.resetCounter != seenResetCounter) {
+            seenResetCounter = shared.resetCounter;
+            sampleInd = 0;
+            traceTiles.cursor = 0;
+            shPreviewPending = true;
+            previewLevel = k_numPreviewLevels;
+            reprojectPending = swapHistoryPending = false;
+        }
+        if(shared.logGpuTimings != gpuTimers.isLogging()) {
+            if(gpuTimers.isLogging()) {
+                gpuTimers.stopLog(k_gpuTimingsJsonFile);
+                tl::println("GPU timings written to ", k_gpuTimingsCsvFile, " and ", k_gpuTimingsJsonFile);
+            }
+            else if(!gpuTimers.startLog(k_gpuTimingsCsvFile)) {
+                tl::eprintln("error opening: ", k_gpuTimingsCsvFile);
+                shared.logGpuTimings = false;
+            }
+        }
+        if(shared.denoise != denoiseEnabled) {
+            denoiseEnabled = shared.denoise;
+            needsPostpro = true;
+        }
+        if(shared.screenshotRequested.exchange(false))
+            saveScreenshot();
+        rayShadVariant = shared.rayShadVariant;
+        debugView = EDebugView(shared.debugView.load());
+
+        const u64 fbSize = shared.fbSize;
+        const int w = int(fbSize & 0xFFFF'FFFF);
+        const int h = int(fbSize >> 32);
+        if((sampleInd == k_numSamples && !needsPostpro) || w == 0 || h == 0) {
+            // converged (or minimized): sleep until the main thread needs something from us
+            TL_PROFILE_ZONE("waitForChanges");
+            std::unique_lock<std::mutex> lock(shared.mutex);
+            shared.wakeUp.wait(lock, somethingChanged);
+            continue;
+        }
+
+        TL_PROFILE_ZONE("renderFrame");
+        frameScheduler.beginFrame();
+        RenderedFrame& frame = renderedFrames.back();
+        if(frame.presentedFence) {
+            // don't overwrite the texture while the main thread might still be reading it on the GPU
+            glWaitSync(frame.presentedFence, 0, GL_TIMEOUT_IGNORED);
+            glDeleteSync(frame.presentedFence);
+            frame.presentedFence = nullptr;
+        }
+
+        glViewport(0, 0, w, h);
+        glScissor(0, 0, w, h);
+        u32 postproSrcTex;
+        if(shPreviewPending) {
+            drawShPreview(w, h);
+            postproSrcTex = textures.shPreview;
+            shPreviewPending = false;
+        }
+        else if(previewLevel) {
+            drawPreview(w, h);
+            postproSrcTex = textures.preview[previewLevel - 1];
+            previewLevel--;
+        }
+        else {
+            draw(w, h, frameScheduler.gpuBudgetMs(), frameScheduler.maxSamplesPerFrame);
+            postproSrcTex = denoiseEnabled && debugView == EDebugView::NONE ? denoise(w, h) : textures.accum;
+        }
+        postpro(frame, w, h, postproSrcTex);
+        needsPostpro = false;
+
+        if(frame.readyFence)
+            glDeleteSync(frame.readyFence);
+        frame.readyFence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        glFlush(); // the fence must reach the GPU, otherwise the main thread could wait on it forever
+
+        gpuTimers.endFrame();
+        rayStats.poll();
+        frame.sampleInd = sampleInd;
+        for(int i = 0; i < GpuTimers::k_numPasses; i++)
+            frame.passStats[i] = gpuTimers.stats(EGpuPass(i));
+        frame.mraysPerSec = rayStats.mraysPerSec();
+        frame.testsPerRay = rayStats.testsPerRay();
+        frame.pathsTerminatedRatio = rayStats.pathsTerminatedRatio();
+        renderedFrames.publish();
+        glfwPostEmptyEvent(); // wake up the main thread
+
+        frameScheduler.endFrame();
     }
+
+    if(gpuTimers.isLogging())
+        gpuTimers.stopLog(k_gpuTimingsJsonFile);
+    glFinish();
+}
+
+static void present(RenderedFrame& frame, int w, int h)
+{
+    TL_PROFILE_ZONE("present");
+    glWaitSync(frame.readyFence, 0, GL_TIMEOUT_IGNORED);
+
+    presentGpuTimers.beginPass(EGpuPass::PRESENT);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glViewport(0, 0, w, h);
+    glDisable(GL_BLEND);
+    glDisable(GL_DEPTH_TEST);
+    glUseProgram(splatTexProg);
+    glUniform1i(0, 0);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, frame.tex);
+    glBindVertexArray(presentQuadVao);
+    glDrawArrays(GL_TRIANGLES, 0, 6);
+
+    if(showTimings)
+        drawTimingsOverlay(frame, w, h);
+    presentGpuTimers.endPass(EGpuPass::PRESENT);
+    presentGpuTimers.endFrame();
+
+    if(frame.presentedFence)
+        glDeleteSync(frame.presentedFence);
+    frame.presentedFence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
 }
 
 int main()
 {
+    TL_PROFILE_THREAD_NAME("main");
     glfwSetErrorCallback(+[](int error, const char* description) {
         fprintf(stderr, "Glfw Error %d: %s\n", error, description);
     });
@@ -349,11 +1185,22 @@ int main()
     if (window == nullptr)
         return 1;
 
+    // hidden window that only provides the render thread's context, sharing objects with the main one
+    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+    glfwWindowHint(GLFW_MAXIMIZED, GLFW_FALSE);
+    GLFWwindow* renderContext = glfwCreateWindow(1, 1, "raygl render", nullptr, window);
+    if (renderContext == nullptr)
+        return 1;
+
     glfwMakeContextCurrent(window);
-    glfwSwapInterval(0); // Enable vsync
+    glfwSwapInterval(0); // the render thread is paced by the FrameScheduler, and we only present new frames
 
     glfwSetKeyCallback(window, keyCallback);
     glfwSetWindowSizeCallback(window, windowResizeCallback);
+    glfwSetMouseButtonCallback(window, mouseButtonCallback);
+    glfwSetCursorPosCallback(window, cursorPosCallback);
+    glfwSetScrollCallback(window, scrollCallback);
+    glfwSetWindowRefreshCallback(window, [](GLFWwindow*) { needsPresent = true; });
 
     if (gladLoadGL() == 0) {
         fprintf(stderr, "Failed to initialize OpenGL loader!\n");
@@ -361,54 +1208,75 @@ int main()
     }
     glad_set_post_callback(glErrorCallback);
 
+    subgroupArithmeticSupported = checkSubgroupArithmeticSupport();
+
     compileShaders();
 
-    glGenVertexArrays(1, &quadVao);
-    glBindVertexArray(quadVao);
     glGenBuffers(1, &quadVbo);
     glBindBuffer(GL_ARRAY_BUFFER, quadVbo);
     glBufferData(GL_ARRAY_BUFFER, sizeof(k_quadVerts), k_quadVerts, GL_STATIC_DRAW);
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 0, nullptr);
+    createQuadVao(presentQuadVao);
 
-    glGenBuffers(1, &spheresSsbo);
-    glBindBuffer(GL_SHADER_STORAGE_BUFFER, spheresSsbo);
-    glBufferData(GL_SHADER_STORAGE_BUFFER,
-        sizeof(sceneSpheres), sceneSpheres, GL_STATIC_DRAW);
+    {
+        TL_PROFILE_ZONE("uploadScene");
+        glGenBuffers(1, &spheresSsbo);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, spheresSsbo);
+        glBufferData(GL_SHADER_STORAGE_BUFFER,
+            sizeof(sceneSpheres), sceneSpheres, GL_STATIC_DRAW);
+        envLight.init(k_envMapFile);
+    }
 
-    glGenFramebuffers(1, &fbo);
-    textures.init();
+    for(int i = 0; i < 3; i++) {
+        glGenTextures(1, &renderedFrames[i].tex);
+        initTexParams(renderedFrames[i].tex);
+    }
+    presentGpuTimers.init();
 
-    int srcTexNdx = 0;
+    // the objects created so far must be complete before the render context uses them
+    glFinish();
+    std::thread renderThread(renderThreadMain, renderContext);
 
+    int fbW = 0, fbH = 0;
     while (!glfwWindowShouldClose(window))
     {
-        glfwPollEvents();
+        // the render thread wakes us up with glfwPostEmptyEvent when it publishes a frame
+        if(needsPresent)
+            glfwPollEvents();
+        else
+            glfwWaitEvents();
 
         int w, h;
         glfwGetFramebufferSize(window, &w, &h);
+        if(w != fbW || h != fbH) {
+            fbW = w;
+            fbH = h;
+            shared.fbSize = u64(w) | (u64(h) << 32);
+            requestReset();
+        }
 
-        // draw scene
-        glViewport(0, 0, w, h);
-        glScissor(0, 0, w, h);
-        //if(needToRedraw) {
-            draw(w, h);
-          //  needToRedraw = false;
-        //}
-
-        glBindFramebuffer(GL_FRAMEBUFFER, 0);
-        glDisable(GL_BLEND);
-        glDisable(GL_DEPTH_TEST);
-        glClearColor(1,1,1,1);
-        glClear(GL_COLOR_BUFFER_BIT);
-
-        glUseProgram(postproProg);
-        glUniform1i(0, 0);
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, textures.accum);
-        glBindVertexArray(quadVao);
-        glDrawArrays(GL_TRIANGLES, 0, 6);
+        if(renderedFrames.consume())
+            needsPresent = true;
+        if(!needsPresent)
+            continue;
+        needsPresent = false;
+        RenderedFrame& frame = renderedFrames.front();
+        if(!frame.readyFence)
+            continue; // nothing rendered yet
+        TL_PROFILE_ZONE("frame");
 
-        glfwSwapBuffers(window);
+        present(frame, w, h);
+        updateStatsTitle(frame);
+
+        {
+            TL_PROFILE_ZONE("glfwSwapBuffers");
+            glfwSwapBuffers(window);
+        }
     }
-}
\ No newline at end of file
+
+    shared.quit = true;
+    notifyRenderThread();
+    renderThread.join();
+
+    if(TL_PROFILE_DUMP(k_cpuTraceFile))
+        tl::println("CPU trace written to ", k_cpuTraceFile);
+}
@@ -0,0 +1,35 @@
+#include "orbit_camera.hpp"
+
+#include <math.h>
+#include <tl/basic.hpp>
+
+void OrbitCamera::orbit(float dYaw, float dPitch)
+{
+    constexpr float maxPitch = 0.49f * 3.14159265f; // avoid the singularity at the poles
+    yaw += dYaw;
+    pitch = tl::clamp(pitch + dPitch, -maxPitch, maxPitch);
+}
+
+void OrbitCamera::zoom(float steps)
+{
+    distance = tl::clamp(distance * powf(0.9f, steps), minDistance, maxDistance);
+}
+
+glm::vec3 OrbitCamera::pos()const
+{
+    const float cosPitch = cosf(pitch);
+    return target + distance * glm::vec3(cosPitch * sinf(yaw), sinf(pitch), cosPitch * cosf(yaw));
+}
+
+glm::mat4 OrbitCamera::viewMtx()const
+{
+    const glm::vec3 p = pos();
+    const glm::vec3 z = glm::normalize(p - target);
+    const glm::vec3 x = glm::normalize(glm::cross(glm::vec3(0, 1, 0), z));
+    const glm::vec3 y = glm::cross(z, x);
+    return glm::mat4(
+        glm::vec4(x, 0),
+        glm::vec4(y, 0),
+        glm::vec4(z, 0),
+        glm::vec4(p, 1));
+}
\ No newline at end of file
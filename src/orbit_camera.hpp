@@ -0,0 +1,17 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+// Camera that orbits around a target point, at a given distance
+struct OrbitCamera {
+    glm::vec3 target = {0, 0, 0};
+    float yaw = 0; // radians around the Y axis. With 0 the camera is on +Z, looking towards -Z
+    float pitch = 0; // radians. Positive values look from above
+    float distance = 10;
+    float minDistance = 2.5f, maxDistance = 100;
+
+    void orbit(float dYaw, float dPitch);
+    void zoom(float steps); // positive steps get closer to the target
+    glm::vec3 pos()const;
+    glm::mat4 viewMtx()const; // camera to world (the camera looks towards its -Z)
+};
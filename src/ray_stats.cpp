@@ -0,0 +1,80 @@
+#include "ray_stats.hpp"
+
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+
+void RayStats::init()
+{
+    for(Slot& slot : _slots) {
+        glGenBuffers(1, &slot.ssbo);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, slot.ssbo);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, k_numStats * sizeof(u32), nullptr, GL_DYNAMIC_READ);
+        glGenQueries(2, slot.queries);
+        slot.fence = nullptr;
+    }
+}
+
+void RayStats::beginFrame()
+{
+    Slot& slot = _slots[_frame % k_numFramesInFlight];
+    if(slot.fence) {
+        // the GPU is too far behind, drop the results of this slot instead of waiting
+        glDeleteSync((GLsync)slot.fence);
+        slot.fence = nullptr;
+    }
+    const u32 zero = 0;
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, k_ssboBinding, slot.ssbo);
+    glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, &zero);
+    glQueryCounter(slot.queries[0], GL_TIMESTAMP);
+}
+
+void RayStats::endFrame()
+{
+    Slot& slot = _slots[_frame % k_numFramesInFlight];
+    glQueryCounter(slot.queries[1], GL_TIMESTAMP);
+    slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    _frame++;
+}
+
+void RayStats::poll()
+{
+    // visit the slots from oldest to newest
+    for(u32 i = 0; i < k_numFramesInFlight; i++) {
+        Slot& slot = _slots[(_frame + i) % k_numFramesInFlight];
+        if(!slot.fence)
+            continue;
+        const GLenum status = glClientWaitSync((GLsync)slot.fence, 0, 0);
+        if(status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+            break;
+        glDeleteSync((GLsync)slot.fence);
+        slot.fence = nullptr;
+
+        u32 counts[k_numStats];
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, slot.ssbo);
+        glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(counts), counts);
+        for(int s = 0; s < k_numStats; s++)
+            _sums[s] += counts[s];
+        // the queries were issued before the fence, so their results are available too
+        GLuint64 t0, t1;
+        glGetQueryObjectui64v(slot.queries[0], GL_QUERY_RESULT, &t0);
+        glGetQueryObjectui64v(slot.queries[1], GL_QUERY_RESULT, &t1);
+        _gpuNs += t1 - t0;
+    }
+
+    // the wall clock only paces the reports
+    const double t = glfwGetTime();
+    if(_periodStart < 0)
+        _periodStart = t;
+    if(t - _periodStart < 0.5)
+        return;
+
+    const u64 numRays = _sums[(int)ERayStat::PRIMARY_RAYS] + _sums[(int)ERayStat::BOUNCE_RAYS];
+    const u64 numPaths = _sums[(int)ERayStat::PRIMARY_RAYS];
+    _mraysPerSec = _gpuNs ? 1e3 * numRays / _gpuNs : 0;
+    _testsPerRay = numRays ? double(_sums[(int)ERayStat::SPHERE_TESTS]) / numRays : 0;
+    _terminatedRatio = numPaths ? double(_sums[(int)ERayStat::TERMINATED_PATHS]) / numPaths : 0;
+    for(u64& sum : _sums)
+        sum = 0;
+    _gpuNs = 0;
+    _periodStart = t;
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <tl/int_types.hpp>
+
+enum class ERayStat {
+    PRIMARY_RAYS,
+    BOUNCE_RAYS,
+    SPHERE_TESTS,
+    TERMINATED_PATHS, // paths that escaped the scene before reaching k_numBounces
+    COUNT
+};
+
+// Counters written by the RAY_STATS variant of main_frag.glsl into an SSBO
+// We keep a ring of buffers guarded by fences so the readback never stalls the pipeline
+// The rates are relative to the GPU time spent between beginFrame() and endFrame(), measured in the same slot as the
+// counters: the idle time between frames, the sleep once converged and the dropped slots don't count
+struct RayStats {
+    static constexpr int k_numFramesInFlight = 4;
+    static constexpr int k_numStats = (int)ERayStat::COUNT;
+    static constexpr u32 k_ssboBinding = 1; // must match the binding in main_frag.glsl
+
+    void init();
+    void beginFrame(); // clears and binds the SSBO of the current frame. Must be called right before the traced draws
+    void endFrame(); // must be called right after the instrumented draws
+    void poll(); // read back the frames that finished. Non-blocking
+
+    // rates computed over the frames read back during the last report period (~0.5 seconds)
+    double mraysPerSec()const { return _mraysPerSec; }
+    double testsPerRay()const { return _testsPerRay; }
+    double pathsTerminatedRatio()const { return _terminatedRatio; }
+
+private:
+    struct Slot {
+        u32 ssbo;
+        u32 queries[2]; // GL_TIMESTAMP at beginFrame and endFrame
+        void* fence; // GLsync
+    };
+    Slot _slots[k_numFramesInFlight];
+    u32 _frame = 0;
+
+    u64 _sums[k_numStats] = {};
+    u64 _gpuNs = 0; // time of the frames in _sums
+    double _periodStart = -1;
+    double _mraysPerSec = 0;
+    double _testsPerRay = 0;
+    double _terminatedRatio = 0;
+};
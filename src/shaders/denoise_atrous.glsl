@@ -0,0 +1,54 @@
+layout(local_size_x = 8, local_size_y = 8) in;
+
+// one iteration of the edge-avoiding à-trous wavelet filter [Dammertz et al. 2010]. Same weights as tg::denoiseATrous
+layout(location = 0) uniform sampler2D u_colorTex; // RGB divided by A, so it can be the accumulation or a previous iteration
+layout(location = 1) uniform sampler2D u_hitTex; // world normal, distance of the primary hit
+layout(location = 2) uniform sampler2D u_albedoTex;
+layout(location = 3) uniform int u_step; // distance between the taps
+// 1 / sigma^2 of the edge stopping weights: color, normal, depth (relative to the center), albedo
+layout(location = 4) uniform vec4 u_invSigmas2;
+layout(binding = 0, rgba32f) uniform writeonly image2D u_dst;
+
+const float k_kernel[5] = float[](1.0/16, 1.0/4, 3.0/8, 1.0/4, 1.0/16); // B3 spline
+const float k_minDepth2 = 1e-6;
+
+vec3 loadColor(ivec2 p)
+{
+    vec4 c = texelFetch(u_colorTex, p, 0);
+    return c.a > 0 ? c.rgb / c.a : vec3(0);
+}
+
+void main()
+{
+    ivec2 size = textureSize(u_colorTex, 0);
+    ivec2 p = ivec2(gl_GlobalInvocationID.xy);
+    if(any(greaterThanEqual(p, size)))
+        return;
+
+    vec3 c = loadColor(p);
+    vec4 hit = texelFetch(u_hitTex, p, 0);
+    vec3 albedo = texelFetch(u_albedoTex, p, 0).rgb;
+    float invSigmaDepth2 = u_invSigmas2.z / max(hit.w * hit.w, k_minDepth2);
+
+    vec3 sum = vec3(0);
+    float sumW = 0;
+    for(int ky = -2; ky <= 2; ky++)
+    for(int kx = -2; kx <= 2; kx++) {
+        ivec2 q = p + u_step * ivec2(kx, ky);
+        if(any(lessThan(q, ivec2(0))) || any(greaterThanEqual(q, size)))
+            continue;
+        vec3 qc = loadColor(q);
+        vec4 qHit = texelFetch(u_hitTex, q, 0);
+        vec3 qAlbedo = texelFetch(u_albedoTex, q, 0).rgb;
+        vec3 dc = qc - c;
+        vec3 dn = qHit.xyz - hit.xyz;
+        vec3 da = qAlbedo - albedo;
+        float dd = qHit.w - hit.w;
+        float e = dot(dc, dc) * u_invSigmas2.x + dot(dn, dn) * u_invSigmas2.y +
+            dd * dd * invSigmaDepth2 + dot(da, da) * u_invSigmas2.w;
+        float weight = k_kernel[kx + 2] * k_kernel[ky + 2] * exp(-e);
+        sum += weight * qc;
+        sumW += weight;
+    }
+    imageStore(u_dst, p, vec4(sum / sumW, 1));
+}
\ No newline at end of file
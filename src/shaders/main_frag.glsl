@@ -1,12 +1,19 @@
 #line 2
 
-layout(location = 0) out vec3 o_color;
+layout(location = 0) out vec4 o_color; // added to the accumulation, A counts the samples
+#ifdef COST_HEATMAP
+layout(location = 1) out uvec2 o_cost; // sphere tests, bounce rays
+#endif
+layout(location = 2) out vec4 o_hit; // primary hit: world normal, distance (0 if the ray escaped). Used for reprojection and denoising
+layout(location = 3) out vec4 o_albedo; // albedo of the primary hit, guide of the denoiser
 
 in vec3 v_rayOri;
 in vec3 v_rayDir;
 
 uniform int u_sampleInd;
 uniform int u_numSamples;
+uniform sampler2D u_envTex; // equirectangular environment map, see tg/cubemap.hpp for the convention
+uniform ivec2 u_envSize;
 
 struct SphereObj {
     vec4 pos_rad;
@@ -17,27 +24,55 @@ layout(std430, binding = 0) buffer block_sphereObjs {
     SphereObj s_sphereObjs[];
 };
 
+// alias table of the environment map (tg::buildEnvAliasTable): u_envSize.y entries to choose the row, followed by a
+// table of u_envSize.x entries for each row to choose the pixel
+struct EnvAliasEntry {
+    float prob;
+    uint alias;
+    float pdf; // of the pixel, with respect to the area of the uv square
+};
+layout(std430, binding = 2) buffer block_envAlias {
+    EnvAliasEntry s_envAlias[];
+};
+
+// indices of the ray stats counters (ERayStat in ray_stats.hpp)
+const int k_statPrimaryRays = 0;
+const int k_statBounceRays = 1;
+const int k_statSphereTests = 2;
+const int k_statTerminatedPaths = 3;
+#if defined(RAY_STATS) || defined(COST_HEATMAP)
+uvec4 rayStatCounts = uvec4(0);
+#define COUNT_RAY_STAT(stat, n) rayStatCounts[stat] += uint(n)
+#else
+#define COUNT_RAY_STAT(stat, n)
+#endif
+
+#ifdef RAY_STATS
+layout(std430, binding = 1) buffer block_rayStats {
+    uint s_rayStats[4];
+};
+
+void flushRayStats()
+{
+#ifdef SUBGROUP_ATOMICS
+    // aggregate the whole subgroup so only one invocation hits the atomics
+    uvec4 counts = subgroupAdd(rayStatCounts);
+    if(!subgroupElect())
+        return;
+#else
+    uvec4 counts = rayStatCounts;
+#endif
+    for(int i = 0; i < 4; i++) {
+        if(counts[i] != 0)
+            atomicAdd(s_rayStats[i], counts[i]);
+    }
+}
+#endif
+
 const float near = 0.01;
 //const float near = -3;
 const float far = 1000000;
 
-float rayVsSphere(vec3 ori, vec3 dir, vec3 p, float r)
-{
-    vec3 op = p - ori;
-    if(op == vec3(0,0,0))
-        return r;
-    const float D = dot(dir, op);
-    const float H2 = dot(op, op) - D*D;
-    float K2 = r*r - H2;
-    if(K2 < 0)
-        return -1;
-    float K = sqrt(K2);
-    if(D >= K)
-        return D - K;
-    else
-        return D + K;
-}
-
 vec3 importanceSampleGgx_H(vec2 rnd, float rough2, vec3 N)
 {
     float phi = 2 * PI * rnd.x;
@@ -83,6 +118,117 @@ float geometryGgx(float VdotH, float VdotN, float rough2)
     return 2 / (1 + sqrt(1 + rough4 * tanV2));
 }
 
+// normal distribution matching importanceSampleGgx_H
+float distributionGgx(float NoH, float rough2)
+{
+    float rough4 = rough2 * rough2;
+    float d = NoH * NoH * (rough4 - 1) + 1;
+    return rough4 / (PI * d * d);
+}
+
+vec3 generateCosineSample(vec3 N, vec2 rnd)
+{
+    vec3 up = abs(N.y) < 0.99 ? vec3(0, 1, 0) : vec3(1, 0, 0);
+    vec3 tanX = normalize(cross(up, N));
+    vec3 tanZ = cross(tanX, N);
+    float phi = 2 * PI * rnd.x;
+    float r = sqrt(rnd.y);
+    return r * cos(phi) * tanX + r * sin(phi) * tanZ + sqrt(max(0, 1 - rnd.y)) * N;
+}
+
+// Material of the spheres for one color channel. The specular lobe is chosen with probability pSpec, the Fresnel
+// reflectance in the view direction, and the diffuse lobe is weighted by the rest, so both estimators are simple
+// Below k_minRough2 the specular lobe is a perfect mirror, which can't be reached by light samples
+const float k_minRough2 = 0.001;
+struct Material {
+    float pSpec;
+    float diffuse; // albedo of the diffuse lobe
+    float F0;
+    float rough2;
+};
+
+// BSDF times the cosine with the normal. L must be in the hemisphere of N
+float evalBsdfCos(Material m, vec3 N, vec3 V, vec3 L)
+{
+    float NoL = dot(N, L);
+    float f = m.diffuse * (1 - m.pSpec) / PI;
+    if(m.rough2 >= k_minRough2) {
+        vec3 H = normalize(V + L);
+        float NoV = max(dot(N, V), 1e-4);
+        float VoH = dot(V, H);
+        f += distributionGgx(dot(N, H), m.rough2) * geometryGgx(VoH, NoV, m.rough2) * geometryGgx(VoH, NoL, m.rough2) *
+            fresnelSchlick(VoH, m.F0) / (4 * NoL * NoV);
+    }
+    return f * NoL;
+}
+
+// pdf of choosing L, with respect to the solid angle, leaving out the mirror lobe
+float bsdfPdf(Material m, vec3 N, vec3 V, vec3 L)
+{
+    float pdf = (1 - m.pSpec) * max(dot(N, L), 0) / PI;
+    if(m.rough2 >= k_minRough2) {
+        vec3 H = normalize(V + L);
+        float NoH = dot(N, H);
+        pdf += m.pSpec * distributionGgx(NoH, m.rough2) * NoH / (4 * max(dot(V, H), 1e-4));
+    }
+    return pdf;
+}
+
+float powerHeuristic(float pdf, float otherPdf)
+{
+    return pdf * pdf / (pdf * pdf + otherPdf * otherPdf);
+}
+
+ivec2 envPixel(vec2 uv)
+{
+    return min(ivec2(uv * vec2(u_envSize)), u_envSize - 1);
+}
+
+// converts the pdf of the pixel in the uv square to the solid angle
+float envPdf(ivec2 px, vec2 uv)
+{
+    float sinTheta = sin(PI * uv.y);
+    return sinTheta > 0 ? s_envAlias[u_envSize.y + px.y * u_envSize.x + px.x].pdf / (2 * PI * PI * sinTheta) : 0.0;
+}
+
+// chooses a bucket of an alias table, and rescales the fraction of rnd left to [0, 1), so it can be reused
+int sampleAliasTable(int offset, int n, inout float rnd)
+{
+    float r = rnd * n;
+    int i = min(int(r), n - 1);
+    rnd = r - i;
+    EnvAliasEntry e = s_envAlias[offset + i];
+    if(rnd < e.prob) {
+        rnd /= e.prob;
+    }
+    else {
+        i = int(e.alias);
+        rnd = (rnd - e.prob) / (1 - e.prob);
+    }
+    return i;
+}
+
+// O(1) importance sampling of the environment: a row, a pixel in that row, and a point inside the pixel
+vec3 sampleEnv(vec2 rnd, out vec3 radiance, out float pdf)
+{
+    int y = sampleAliasTable(0, u_envSize.y, rnd.y);
+    int x = sampleAliasTable(u_envSize.y + y * u_envSize.x, u_envSize.x, rnd.x);
+    vec2 uv = (vec2(x, y) + rnd) / vec2(u_envSize);
+    radiance = texelFetch(u_envTex, ivec2(x, y), 0).rgb;
+    pdf = envPdf(ivec2(x, y), uv);
+    return equirectDir(uv);
+}
+
+bool isOccluded(vec3 ori, vec3 dir)
+{
+    COUNT_RAY_STAT(k_statSphereTests, s_sphereObjs.length());
+    for(int i = 0; i < s_sphereObjs.length(); i++) {
+        if(rayVsSphere(ori, dir, s_sphereObjs[i].pos_rad.xyz, s_sphereObjs[i].pos_rad.w) > near)
+            return true;
+    }
+    return false;
+}
+
 void main()
 {
     /*vec3 rayOri = v_rayOri;
@@ -112,13 +258,20 @@ void main()
     float attenuations[k_numBounces];
 
     vec3 initRayDir = normalize(v_rayDir);
+    // the sample sequence is the same for all the pixels, rotate the light samples per pixel to trade banding for noise
+    vec2 pixelRnd = vec2(rand(gl_FragCoord.xy), rand(gl_FragCoord.yx));
+    o_hit = vec4(0);
+    o_albedo = vec4(0);
     for(int c = 0; c < 3; c++)
     {
         vec3 rayOri = v_rayOri;
         vec3 rayDir = initRayDir;
+        float rayPdf = 0; // pdf of sampling rayDir with the BSDF, 0 if the light samples can't find that direction
         int bounce;
         for(bounce = 0; bounce < k_numBounces; bounce++)
         {
+            COUNT_RAY_STAT(bounce == 0 ? k_statPrimaryRays : k_statBounceRays, 1);
+            COUNT_RAY_STAT(k_statSphereTests, s_sphereObjs.length());
             int nearest = -1;
             float nearestDepth = far;
             for(int i = 0; i < s_sphereObjs.length(); i++)
@@ -131,6 +284,14 @@ void main()
                 }
             }
             if(nearest == -1) {
+                COUNT_RAY_STAT(k_statTerminatedPaths, 1);
+                // the environment, weighted against the light sample of the previous bounce
+                vec2 uv = equirectUv(rayDir);
+                ivec2 px = envPixel(uv);
+                float misWeight = rayPdf > 0 ? powerHeuristic(rayPdf, envPdf(px, uv)) : 1.0;
+                emitColors[bounce] = misWeight * texelFetch(u_envTex, px, 0)[c];
+                attenuations[bounce] = 0;
+                bounce++;
                 break;
             }
             emitColors[bounce] = s_sphereObjs[nearest].emitColor_metallic[c];
@@ -140,6 +301,10 @@ void main()
             vec3 spherePos = s_sphereObjs[nearest].pos_rad.xyz;
             vec3 V = -rayDir;
             vec3 N = normalize(intersecPoint - spherePos);
+            if(bounce == 0 && c == 0) {
+                o_hit = vec4(N, nearestDepth);
+                o_albedo = vec4(s_sphereObjs[nearest].albedo_rough2.rgb, 1);
+            }
 
             vec2 rnd2 = hammersleyVec2(
                 3 * (u_sampleInd * k_numBounces + bounce) + c,
@@ -149,31 +314,56 @@ void main()
             float metallic = s_sphereObjs[nearest].emitColor_metallic.a;
             float albedo = s_sphereObjs[nearest].albedo_rough2[c];
             float rough2 = s_sphereObjs[nearest].albedo_rough2.w;
-            rayOri = rayOri + nearestDepth * rayDir;
-            vec3 H = importanceSampleGgx_H(rnd2, rough2, N);
-            float cosThetaH = -dot(H, rayDir);
-            float F0 = mix(0.04, albedo, metallic);
-            float F = fresnelSchlick(cosThetaH, F0);
+            rayOri = intersecPoint;
+            float NoV = max(dot(N, V), 1e-4);
+            Material mat;
+            mat.F0 = mix(0.04, albedo, metallic);
+            mat.pSpec = fresnelSchlick(NoV, mat.F0);
+            mat.diffuse = albedo * (1 - metallic);
+            mat.rough2 = rough2;
 
+            // direct light: sample the environment and trace a shadow ray
+            if(metallic >= 0.0 && (mat.diffuse > 0 || rough2 >= k_minRough2))
+            {
+                vec3 radiance;
+                float lightPdf;
+                vec3 L = sampleEnv(fract(rnd2 + pixelRnd), radiance, lightPdf);
+                if(lightPdf > 0 && dot(N, L) > 0 && !isOccluded(rayOri, L)) {
+                    // the BSDF ray that could also find this light is not traced after the last bounce
+                    float misWeight = bounce + 1 < k_numBounces ?
+                        powerHeuristic(lightPdf, bsdfPdf(mat, N, V, L)) : 1.0;
+                    emitColors[bounce] += misWeight * radiance[c] * evalBsdfCos(mat, N, V, L) / lightPdf;
+                }
+            }
 
-            if(rnd < F) // ray is reflected
+            if(rnd < mat.pSpec) // ray is reflected
             {
+                vec3 H = importanceSampleGgx_H(rnd2, rough2, N);
                 vec3 L = reflect(rayDir, H);
                 float NoL = dot(N, L);
-                float NoV = dot(N, V);
-                float NoH = dot(N, H);
-                float G1 = geometryGgx(dot(V, H), NoL, rough2);
-                float G2 = geometryGgx(dot(L, H), NoV, rough2);
-                attenuations[bounce] =
-                    (F * G1 * G2) /
-                    (4 * NoL * NoV * NoH);
+                if(rough2 < k_minRough2) { // mirror: the Fresnel term and the probability of the lobe cancel out
+                    attenuations[bounce] = 1;
+                    rayPdf = 0;
+                }
+                else if(NoL > 0) {
+                    float VoH = dot(V, H);
+                    float NoH = dot(N, H);
+                    attenuations[bounce] =
+                        fresnelSchlick(VoH, mat.F0) * geometryGgx(VoH, NoV, rough2) * geometryGgx(VoH, NoL, rough2) *
+                        VoH / (NoV * NoH * mat.pSpec);
+                    rayPdf = bsdfPdf(mat, N, V, L);
+                }
+                else {
+                    attenuations[bounce] = 0;
+                }
                 rayDir = L;
             }
             else if(metallic >= 0.0) // opaque object, ray is diffused
             {
-                attenuations[bounce] = s_sphereObjs[nearest].albedo_rough2[c];
-                attenuations[bounce] /= PI;
-                rayDir = generateUniformSample(N, rnd2);
+                // the cosine cancels out with the pdf, and the weight of the lobe with its probability
+                attenuations[bounce] = mat.diffuse;
+                rayDir = generateCosineSample(N, rnd2);
+                rayPdf = bsdfPdf(mat, N, V, rayDir);
             }
             else { // transparent object, ray is refracted
                 attenuations[bounce] = 0;
@@ -195,4 +385,13 @@ void main()
         o_color[c] = color;
         //o_color = emitColors[0];
     }
+
+    o_color.a = 1;
+
+#ifdef RAY_STATS
+    flushRayStats();
+#endif
+#ifdef COST_HEATMAP
+    o_cost = uvec2(rayStatCounts[k_statSphereTests], rayStatCounts[k_statBounceRays]);
+#endif
 }
\ No newline at end of file
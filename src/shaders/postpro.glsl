@@ -1,12 +1,28 @@
 layout(location = 0) out vec4 o_color;
 
-layout(location = 0) uniform sampler2D u_tex;
+layout(location = 0) uniform sampler2D u_tex; // RGB: sum of samples, A: number of samples. Might be a lower resolution preview
+layout(location = 1) uniform usampler2D u_costTex;
+layout(location = 2) uniform int u_debugView; // EDebugView: 0: none, 1: sphere tests, 2: bounces
+layout(location = 3) uniform float u_heatmapMax;
 
 in vec2 v_tc;
 
+vec3 heatmap(float t)
+{
+    t = clamp(t, 0, 1);
+    return clamp(vec3(1.5) - abs(4 * t - vec3(3, 2, 1)), 0, 1);
+}
+
 void main()
 {
-    vec3 color = texture(u_tex, v_tc).rgb;
+    if(u_debugView != 0) {
+        uvec2 cost = texture(u_costTex, v_tc).rg;
+        o_color = vec4(heatmap(float(cost[u_debugView - 1]) / u_heatmapMax), 1);
+        return;
+    }
+
+    vec4 accum = texture(u_tex, v_tc);
+    vec3 color = accum.a > 0 ? accum.rgb / accum.a : vec3(0);
     // reinhard tonemapping
     color = color / (color + 1);
     // gamma correction
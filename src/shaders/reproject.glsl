@@ -0,0 +1,47 @@
+layout(location = 0) out vec4 o_color;
+
+// adds the history of the previous view to the accumulation of the current view (additive blending)
+layout(location = 0) uniform sampler2D u_hitTex; // primary hit of the current view: world normal, distance
+layout(location = 1) uniform sampler2D u_prevAccum; // RGB: sum of samples, A: number of samples
+layout(location = 2) uniform sampler2D u_prevHitTex;
+layout(location = 3) uniform mat4 u_viewMtx; // camera to world
+layout(location = 7) uniform mat4 u_prevViewMtxInv; // world to camera, of the previous view
+layout(location = 11) uniform vec2 u_fovFactor;
+layout(location = 12) uniform float u_maxHistorySamples;
+
+in vec2 v_tc;
+
+// thresholds used to reject the history where the surface seen by the previous view is a different one
+const float k_maxRelativeDistDiff = 0.02;
+const float k_minNormalDot = 0.9;
+
+void main()
+{
+    o_color = vec4(0);
+    vec4 hit = texture(u_hitTex, v_tc);
+    if(hit.w <= 0)
+        return; // the primary ray escaped
+
+    vec3 dir = normalize(mat3(u_viewMtx) * vec3((2 * v_tc - 1) * u_fovFactor, -1));
+    vec3 p = u_viewMtx[3].xyz + hit.w * dir;
+    vec3 prevP = (u_prevViewMtxInv * vec4(p, 1)).xyz;
+    if(prevP.z >= 0)
+        return; // behind the previous camera
+    vec2 prevTc = 0.5 + 0.5 * (prevP.xy / -prevP.z) / u_fovFactor;
+    if(any(lessThan(prevTc, vec2(0))) || any(greaterThan(prevTc, vec2(1))))
+        return; // outside of the previous view
+
+    vec4 prevHit = texture(u_prevHitTex, prevTc);
+    float prevDist = length(prevP);
+    if(abs(prevHit.w - prevDist) > k_maxRelativeDistDiff * prevDist)
+        return; // disoccluded
+    if(dot(prevHit.xyz, hit.xyz) < k_minNormalDot)
+        return;
+
+    vec4 prev = texture(u_prevAccum, prevTc);
+    if(prev.a == 0)
+        return;
+    // the history length is capped so view dependent shading (e.g. reflections) can catch up
+    float n = min(prev.a, u_maxHistorySamples);
+    o_color = vec4(prev.rgb * (n / prev.a), n);
+}
\ No newline at end of file
@@ -0,0 +1,79 @@
+layout(location = 0) out vec4 o_color;
+
+layout(location = 0) uniform sampler2D u_envTex; // equirectangular environment map, see tg/cubemap.hpp for the convention
+layout(location = 1) uniform mat4 u_viewMtx;
+layout(location = 5) uniform vec2 u_fovFactor;
+// irradiance of the environment projected to L2 spherical harmonics (tg::ShL2, same order of the coefficients)
+layout(location = 6) uniform vec3 u_shIrradiance[9];
+
+struct SphereObj {
+    vec4 pos_rad;
+    vec4 emitColor_metallic;
+    vec4 albedo_rough2;
+};
+layout(std430, binding = 0) buffer block_sphereObjs {
+    SphereObj s_sphereObjs[];
+};
+
+in vec2 v_tc;
+
+const float near = 0.01;
+const float far = 1000000;
+
+vec3 shIrradiance(vec3 n)
+{
+    return u_shIrradiance[0] * 0.282095 +
+        u_shIrradiance[1] * (0.488603 * n.y) +
+        u_shIrradiance[2] * (0.488603 * n.z) +
+        u_shIrradiance[3] * (0.488603 * n.x) +
+        u_shIrradiance[4] * (1.092548 * n.x * n.y) +
+        u_shIrradiance[5] * (1.092548 * n.y * n.z) +
+        u_shIrradiance[6] * (0.315392 * (3 * n.z * n.z - 1)) +
+        u_shIrradiance[7] * (1.092548 * n.x * n.z) +
+        u_shIrradiance[8] * (0.546274 * (n.x * n.x - n.y * n.y));
+}
+
+vec3 envRadiance(vec3 dir)
+{
+    ivec2 size = textureSize(u_envTex, 0);
+    ivec2 px = min(ivec2(equirectUv(dir) * vec2(size)), size - 1);
+    return texelFetch(u_envTex, px, 0).rgb;
+}
+
+// Approximation of the path traced image for the first frame after a reset: the primary hit is lit by the diffuse
+// irradiance of the environment and the mirror reflection of it, without shadows nor interreflections
+void main()
+{
+    vec3 rayOri = u_viewMtx[3].xyz;
+    vec3 rayDir = normalize(mat3(u_viewMtx) * vec3((2 * v_tc - 1) * u_fovFactor, -1));
+    int nearest = -1;
+    float nearestDepth = far;
+    for(int i = 0; i < s_sphereObjs.length(); i++)
+    {
+        float d = rayVsSphere(rayOri, rayDir,
+            s_sphereObjs[i].pos_rad.xyz, s_sphereObjs[i].pos_rad.w);
+        if(d > near && d < nearestDepth) {
+            nearest = i;
+            nearestDepth = d;
+        }
+    }
+    if(nearest == -1) {
+        o_color = vec4(envRadiance(rayDir), 1);
+        return;
+    }
+
+    SphereObj sphere = s_sphereObjs[nearest];
+    vec3 N = normalize(rayOri + nearestDepth * rayDir - sphere.pos_rad.xyz);
+    vec3 V = -rayDir;
+    float NoV = max(dot(N, V), 1e-4);
+    vec3 color = sphere.emitColor_metallic.rgb;
+    float metallic = sphere.emitColor_metallic.a;
+    if(metallic >= 0.0) {
+        vec3 albedo = sphere.albedo_rough2.rgb;
+        vec3 F0 = mix(vec3(0.04), albedo, metallic);
+        vec3 F = F0 + (1 - F0) * pow(1 - NoV, 5.0);
+        color += albedo * (1 - metallic) * (1 - F) * shIrradiance(N) / PI;
+        color += F * envRadiance(reflect(rayDir, N));
+    }
+    o_color = vec4(color, 1);
+}
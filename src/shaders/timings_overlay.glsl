@@ -0,0 +1,37 @@
+layout(location = 0) out vec4 o_color;
+
+const int k_maxPasses = 8;
+
+layout(location = 0) uniform int u_numPasses;
+layout(location = 1) uniform float u_scaleMs; // time that corresponds to the full width of the overlay
+layout(location = 2) uniform float u_avgMs[k_maxPasses];
+layout(location = 2 + k_maxPasses) uniform float u_p95Ms[k_maxPasses];
+
+in vec2 v_tc;
+
+const vec3 k_passColors[4] = vec3[](
+    vec3(0.9, 0.3, 0.2),
+    vec3(0.2, 0.8, 0.3),
+    vec3(0.3, 0.5, 1.0),
+    vec3(0.9, 0.8, 0.2)
+);
+
+void main()
+{
+    // one horizontal bar per pass, the first one at the top
+    float rowF = (1 - v_tc.y) * u_numPasses;
+    int row = min(int(rowF), u_numPasses - 1);
+    float rowY = fract(rowF);
+    float ms = v_tc.x * u_scaleMs;
+    float pixelMs = u_scaleMs * fwidth(v_tc.x);
+
+    o_color = vec4(0, 0, 0, 0.5);
+    if(fract(ms) < pixelMs) // 1ms ticks
+        o_color = vec4(0.3, 0.3, 0.3, 0.7);
+    if(rowY < 0.2 || rowY > 0.8)
+        return;
+    if(ms < u_avgMs[row])
+        o_color = vec4(k_passColors[row % 4], 0.9);
+    if(abs(ms - u_p95Ms[row]) < pixelMs)
+        o_color = vec4(1);
+}
@@ -33,4 +33,34 @@ vec3 generateUniformSample(vec3 N, vec2 rnd)
     v += h * N;
     v = normalize(v);
     return v;
-}
\ No newline at end of file
+}
+
+float rayVsSphere(vec3 ori, vec3 dir, vec3 p, float r)
+{
+    vec3 op = p - ori;
+    if(op == vec3(0,0,0))
+        return r;
+    const float D = dot(dir, op);
+    const float H2 = dot(op, op) - D*D;
+    float K2 = r*r - H2;
+    if(K2 < 0)
+        return -1;
+    float K = sqrt(K2);
+    if(D >= K)
+        return D - K;
+    else
+        return D + K;
+}
+
+// equirectangular environment maps, see tg/cubemap.hpp for the convention
+vec3 equirectDir(vec2 uv)
+{
+    float phi = 2 * PI * uv.x;
+    float theta = PI * uv.y;
+    return vec3(-sin(theta) * sin(phi), cos(theta), sin(theta) * cos(phi));
+}
+vec2 equirectUv(vec3 dir)
+{
+    float u = atan(-dir.x, dir.z) / (2 * PI);
+    return vec2(u < 0 ? u + 1 : u, acos(clamp(dir.y, -1, 1)) / PI);
+}
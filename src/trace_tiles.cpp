@@ -0,0 +1,36 @@
+#include "trace_tiles.hpp"
+
+#include <algorithm>
+#include <tl/basic.hpp>
+
+void TraceTiles::resize(int w, int h)
+{
+    if(w == _w && h == _h)
+        return;
+    _w = w;
+    _h = h;
+    cursor = 0;
+    _tiles.resize(0);
+    for(int y = 0; y < h; y += tileSize)
+    for(int x = 0; x < w; x += tileSize)
+        _tiles.push_back({x, y, tl::min(tileSize, w - x), tl::min(tileSize, h - y)});
+
+    // the center of the screen is where we usually look, so it converges first
+    auto distToCenter2 = [w, h](const Tile& t) {
+        const int dx = 2 * t.x + t.w - w;
+        const int dy = 2 * t.y + t.h - h;
+        return dx * dx + dy * dy;
+    };
+    std::stable_sort(_tiles.begin(), _tiles.end(), [&](const Tile& a, const Tile& b) {
+        return distToCenter2(a) < distToCenter2(b);
+    });
+}
+
+bool TraceTiles::advance()
+{
+    cursor++;
+    if(cursor < (int)_tiles.size())
+        return false;
+    cursor = 0;
+    return true;
+}
\ No newline at end of file
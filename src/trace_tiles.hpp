@@ -0,0 +1,23 @@
+#pragma once
+
+#include <tl/containers/vector.hpp>
+
+// Screen tiles of the trace pass, ordered from the center of the screen outwards
+// Each tile is traced with a separate scissored draw. A sample of the whole screen can be spread over several frames,
+// and the draws are flushed in batches that fit a GPU time budget, so no submit keeps the GPU busy for too long
+struct TraceTiles {
+    struct Tile {
+        int x, y, w, h;
+    };
+    int tileSize = 256;
+    int cursor = 0; // next tile to trace of the current sample
+
+    void resize(int w, int h); // recomputes the tiles if the resolution changed
+    const tl::Vector<Tile>& tiles()const { return _tiles; }
+    const Tile& current()const { return _tiles[cursor]; }
+    bool advance(); // moves the cursor to the next tile, returns true when the whole screen was covered
+
+private:
+    tl::Vector<Tile> _tiles;
+    int _w = 0, _h = 0;
+};
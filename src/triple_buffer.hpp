@@ -0,0 +1,44 @@
+#pragma once
+
+#include <atomic>
+#include <assert.h>
+#include <tl/int_types.hpp>
+
+// Lock-free handoff of the latest value from one producer thread to one consumer thread
+// The producer always owns back(), the consumer always owns front(), and the middle slot is exchanged atomically
+// Neither side ever waits: the producer overwrites values that were not consumed yet
+template <typename T>
+class TripleBuffer
+{
+public:
+    // only for initialization, before the threads start using the buffer
+    T& operator[](int i) { assert(i >= 0 && i < 3); return _slots[i]; }
+
+    // --- producer ---
+    T& back() { return _slots[_back]; }
+    void publish()
+    {
+        const u32 prevMiddle = _middle.exchange(_back | k_newBit, std::memory_order_acq_rel);
+        _back = prevMiddle & k_indexMask;
+    }
+
+    // --- consumer ---
+    T& front() { return _slots[_front]; }
+    bool consume() // returns true if a new value was published since the last call, front() is updated
+    {
+        if(!(_middle.load(std::memory_order_relaxed) & k_newBit))
+            return false;
+        const u32 prevMiddle = _middle.exchange(_front, std::memory_order_acq_rel);
+        _front = prevMiddle & k_indexMask;
+        return true;
+    }
+
+private:
+    static constexpr u32 k_indexMask = 0b011;
+    static constexpr u32 k_newBit = 0b100;
+
+    T _slots[3];
+    u32 _back = 0;
+    u32 _front = 1;
+    std::atomic<u32> _middle {2};
+};